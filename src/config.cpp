@@ -0,0 +1,257 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "util/crc32.h"
+#include "util/utils.h"
+
+#define NVS_CONFIG "config"
+
+// legacy single string keys, migrated on first boot
+#define NVS_DEVICENAME "devicename"
+#define NVS_TIMEZONE "timezone"
+
+#define DEFAULT_TIMEZONE "Europe/Berlin"
+
+//------------------------------------------------------------------------------
+Config::Config(NVS& nvs)
+    : LOG("Config"),
+      nvs_(nvs),
+      unreadable_(false)
+//------------------------------------------------------------------------------
+{
+  memset(&data_, 0, sizeof(data_));
+}
+
+//------------------------------------------------------------------------------
+bool Config::load()
+//------------------------------------------------------------------------------
+{
+  setDefaults();
+  unreadable_ = false;
+
+  // a record of a newer firmware (after a downgrade) is longer, it is read completely for the crc
+  size_t length = 0;
+  esp_err_t err = nvs_.existsBlob(NVS_CONFIG, &length);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    LOG.w("No config record, migrating legacy values");
+    return migrateLegacy();
+  }
+  std::vector<uint8_t> buffer(length);
+  if (err != ESP_OK || !nvs_.readBlob(NVS_CONFIG, buffer.data(), buffer.size(), &length)) {
+    // the settings are still there, they must not be overwritten with the defaults
+    LOG.e("Config record not readable (%s), using defaults without saving", esp_err_to_name(err));
+    unreadable_ = true;
+    return false;
+  }
+
+  ConfigHeader_t header;
+  if (length < sizeof(header)) {
+    LOG.e("Config record truncated (%u bytes)", (unsigned)length);
+    return false;
+  }
+  memcpy(&header, buffer.data(), sizeof(header));
+  const uint8_t* data = buffer.data() + sizeof(header);
+
+  if (header.length != length - sizeof(header) || Crc32::compute(data, header.length) != header.crc) {
+    LOG.e("Config record corrupt, using defaults");
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // shorter records keep the defaults of the new fields, of longer ones only the known fields are taken
+    memcpy(&data_, data, min((size_t)header.length, sizeof(data_)));
+    data_.deviceName[CONFIG_DEVICENAME_SIZE - 1] = 0;
+    data_.timezone[CONFIG_TIMEZONE_SIZE - 1] = 0;
+    data_.tzRule[TZ_RULE_SIZE - 1] = 0;
+  }
+
+  // a newer record is left as it is until a setting changes, an upgrade again finds its fields
+  if (header.version < CONFIG_VERSION) {
+    LOG.i("Config record migrated from version %u to %u", header.version, CONFIG_VERSION);
+    save();
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool Config::save(bool commitAfterWrite, NVS::CommitCallback callback)
+//------------------------------------------------------------------------------
+{
+  if (unreadable_) {
+    LOG.e("Config record not readable, not overwritten");
+    if (callback) {
+      callback(false);
+    }
+    return false;
+  }
+
+  uint8_t buffer[sizeof(ConfigHeader_t) + sizeof(ConfigData_t)];
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ConfigHeader_t header;
+    header.version = CONFIG_VERSION;
+    header.length = sizeof(data_);
+    header.crc = Crc32::compute(&data_, sizeof(data_));
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), &data_, sizeof(data_));
+  }
+
+  if (!nvs_.writeBlob(NVS_CONFIG, buffer, sizeof(buffer))) {
+    LOG.e("Could not write config record");
+    if (callback) {
+      callback(false);
+    }
+    return false;
+  }
+  if (commitAfterWrite) {
+    nvs_.commitAsync(callback);
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+String Config::getDeviceName()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return data_.deviceName;
+}
+
+//------------------------------------------------------------------------------
+void Config::setDeviceName(const String& deviceName)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  copy(data_.deviceName, deviceName, sizeof(data_.deviceName));
+}
+
+//------------------------------------------------------------------------------
+String Config::getTimezone()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return data_.timezone;
+}
+
+//------------------------------------------------------------------------------
+void Config::setTimezone(const String& timezone)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (timezone != data_.timezone) {
+    // the cached rule belongs to the old timezone
+    data_.tzRule[0] = 0;
+  }
+  copy(data_.timezone, timezone, sizeof(data_.timezone));
+}
+
+//------------------------------------------------------------------------------
+String Config::getTzRule()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return data_.tzRule;
+}
+
+//------------------------------------------------------------------------------
+void Config::setTzRule(const String& tzRule)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  copy(data_.tzRule, tzRule, sizeof(data_.tzRule));
+}
+
+//------------------------------------------------------------------------------
+bool Config::isNtpServer()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return data_.ntpServer;
+}
+
+//------------------------------------------------------------------------------
+void Config::setNtpServer(bool ntpServer)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  data_.ntpServer = ntpServer;
+}
+
+//------------------------------------------------------------------------------
+uint8_t Config::getTickSync()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return data_.tickSync;
+}
+
+//------------------------------------------------------------------------------
+void Config::setTickSync(uint8_t tickSync)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  data_.tickSync = tickSync;
+}
+
+//------------------------------------------------------------------------------
+void Config::setDefaults()
+//------------------------------------------------------------------------------
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // zero the padding too, it is part of the crc
+    memset(&data_, 0, sizeof(data_));
+  }
+  setDeviceName(Utils::createId());
+  setTimezone(DEFAULT_TIMEZONE);
+}
+
+//------------------------------------------------------------------------------
+bool Config::migrateLegacy()
+//------------------------------------------------------------------------------
+{
+  bool found = false;
+  String value;
+
+  if (nvs_.existsString(NVS_DEVICENAME) == ESP_OK && nvs_.readString(NVS_DEVICENAME, value)) {
+    setDeviceName(value);
+    nvs_.erase(NVS_DEVICENAME);
+    found = true;
+  }
+  if (nvs_.existsString(NVS_TIMEZONE) == ESP_OK && nvs_.readString(NVS_TIMEZONE, value)) {
+    setTimezone(value);
+    nvs_.erase(NVS_TIMEZONE);
+    found = true;
+  }
+
+  if (found) {
+    LOG.i("Legacy values migrated");
+    return save();
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+void Config::copy(char* target, const String& source, size_t size)
+//------------------------------------------------------------------------------
+{
+  strncpy(target, source.c_str(), size - 1);
+  target[size - 1] = 0;
+}
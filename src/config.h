@@ -0,0 +1,86 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <mutex>
+#include <vector>
+
+#include "time/tzdb.h"
+#include "util/logger.h"
+#include "util/nvs.h"
+
+// 2: tzRule
+// 3: ntpServer
+// 4: tickSync
+#define CONFIG_VERSION 4
+
+#define CONFIG_DEVICENAME_SIZE 33
+#define CONFIG_TIMEZONE_SIZE 48
+
+// Persistent settings, stored as one NVS blob: header followed by the data.
+// Fields are only ever appended to ConfigData_t. Records written by an older
+// version are shorter, the missing tail keeps its defaults on load. Records of
+// a newer version are longer, their known prefix is used.
+struct ConfigHeader_t {
+  uint16_t version;
+  uint16_t length;  // of the data that follows
+  uint32_t crc;     // over the data that follows
+};
+
+struct ConfigData_t {
+  char deviceName[CONFIG_DEVICENAME_SIZE];
+  char timezone[CONFIG_TIMEZONE_SIZE];
+  char tzRule[TZ_RULE_SIZE];  // resolved POSIX rule of timezone, empty if not resolved yet
+  uint8_t ntpServer;          // 1: answer SNTP requests from the LAN
+  uint8_t tickSync;           // TickSyncMode_t
+};
+
+// The getters and setters are thread safe, the HTTP API reads the settings from its task.
+class Config {
+ public:
+  Config(NVS& nvs);
+
+  bool load();
+  // the callback reports when the record is durable, see NVS::commitAsync()
+  bool save(bool commitAfterWrite = true, NVS::CommitCallback callback = NULL);
+
+  String getDeviceName();
+  void setDeviceName(const String& deviceName);
+  String getTimezone();
+  void setTimezone(const String& timezone);
+  String getTzRule();
+  void setTzRule(const String& tzRule);
+  bool isNtpServer();
+  void setNtpServer(bool ntpServer);
+  uint8_t getTickSync();
+  void setTickSync(uint8_t tickSync);
+
+ private:
+  void setDefaults();
+  bool migrateLegacy();
+  static void copy(char* target, const String& source, size_t size);
+
+  Logger LOG;
+  NVS& nvs_;
+  std::mutex mutex_;
+  ConfigData_t data_;
+  // the record exists but could not be read, save() would replace it with the defaults
+  bool unreadable_;
+};
\ No newline at end of file
@@ -0,0 +1,121 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "display/clockface.h"
+
+//------------------------------------------------------------------------------
+static void put2(char* p, uint8_t value)
+//------------------------------------------------------------------------------
+{
+  p[0] = '0' + value / 10;
+  p[1] = '0' + value % 10;
+}
+
+//------------------------------------------------------------------------------
+ClockFace::ClockFace(PosixTz& timezone, uint8_t width)
+    : timezone_(timezone),
+      width_(width),
+      markerScale_((((uint64_t)width - CLOCK_FACE_MARKER_WIDTH + 1) << 32) / 60000000),
+      local_(),
+      time_("--:--"),
+      seconds_("--"),
+      date_("--.--.----"),
+      marker_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+uint8_t ClockFace::update(int64_t utc)
+//------------------------------------------------------------------------------
+{
+  int64_t seconds = utc / 1000000;
+  int64_t us = utc % 1000000;
+  if (us < 0) {
+    --seconds;
+    us += 1000000;
+  }
+  timezone_.toLocal(seconds, local_);
+
+  char time[6] = "00:00";
+  put2(time, local_.hour);
+  put2(time + 3, local_.minute);
+
+  char sec[3] = "00";
+  put2(sec, local_.second);
+
+  // full year, the date is right beyond 2099
+  char date[11] = "00.00.0000";
+  put2(date, local_.day);
+  put2(date + 3, local_.month);
+  put2(date + 6, local_.year / 100 % 100);
+  put2(date + 8, local_.year % 100);
+
+  // fixed point, no division and no float per frame
+  uint32_t usOfMinute = local_.second * 1000000 + us;
+  uint8_t marker = ((uint64_t)usOfMinute * markerScale_) >> 32;
+
+  uint8_t changed = FACE_UNCHANGED;
+  if (marker != marker_) {
+    changed |= FACE_MARKER;
+    marker_ = marker;
+  }
+  if (strcmp(sec, seconds_)) {
+    changed |= FACE_SECONDS;
+    strcpy(seconds_, sec);
+  }
+  if (strcmp(time, time_) || strcmp(date, date_)) {
+    changed |= FACE_TEXT;
+    strcpy(time_, time);
+    strcpy(date_, date);
+  }
+  return changed;
+}
+
+//------------------------------------------------------------------------------
+const char* ClockFace::getTime()
+//------------------------------------------------------------------------------
+{
+  return time_;
+}
+
+//------------------------------------------------------------------------------
+const char* ClockFace::getSeconds()
+//------------------------------------------------------------------------------
+{
+  return seconds_;
+}
+
+//------------------------------------------------------------------------------
+const char* ClockFace::getDate()
+//------------------------------------------------------------------------------
+{
+  return date_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t ClockFace::getMarker()
+//------------------------------------------------------------------------------
+{
+  return marker_;
+}
+
+//------------------------------------------------------------------------------
+const LocalTime_t& ClockFace::getLocal()
+//------------------------------------------------------------------------------
+{
+  return local_;
+}
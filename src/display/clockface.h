@@ -0,0 +1,57 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "time/posixtz.h"
+
+#ifndef CLOCK_FACE_MARKER_WIDTH
+#define CLOCK_FACE_MARKER_WIDTH 10
+#endif
+
+// what update() changed
+enum FaceChange_t { FACE_UNCHANGED = 0, FACE_MARKER = 1, FACE_SECONDS = 2, FACE_TEXT = 4 };
+
+// Content of the clock screen for an instant: local time, date and the position of the seconds marker.
+// Independent of the display driver, so the host simulation renders exactly what the device shows.
+class ClockFace {
+ public:
+  ClockFace(PosixTz& timezone, uint8_t width = 128);
+
+  // utc in µs, FaceChange_t bits of what is visibly different from the last update
+  uint8_t update(int64_t utc);
+
+  const char* getTime();     // "HH:MM"
+  const char* getSeconds();  // "SS"
+  const char* getDate();     // "DD.MM.YYYY"
+  // left edge of the seconds marker, moves across the full width once a minute, every position
+  // is shown for the same time
+  uint8_t getMarker();
+  const LocalTime_t& getLocal();
+
+ private:
+  PosixTz& timezone_;
+  uint8_t width_;
+  uint32_t markerScale_;  // marker positions per µs of the minute, 0.32 fixed point
+  LocalTime_t local_;
+  char time_[6];
+  char seconds_[3];
+  char date_[11];
+  uint8_t marker_;
+};
@@ -0,0 +1,195 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "display/framescheduler.h"
+
+//------------------------------------------------------------------------------
+FrameScheduler::FrameScheduler(Clock& clock)
+    :
+#ifdef ESP_PLATFORM
+      timer_(NULL),
+#endif
+      LOG("FrameScheduler"),
+      clock_(clock),
+      periodUs_(1000000 / FRAME_RATE),
+      offset_(0),
+      next_(0),
+      fired_(false),
+      frames_(0),
+      skipped_(0),
+      latency_(0),
+      maxLatency_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool FrameScheduler::begin(uint16_t fps)
+//------------------------------------------------------------------------------
+{
+  setFps(fps);
+#ifdef ESP_PLATFORM
+  esp_timer_create_args_t args = {};
+  args.callback = onTimer;
+  args.arg = this;
+  args.name = "frame";
+  esp_err_t err = esp_timer_create(&args, &timer_);
+  if (err != ESP_OK) {
+    LOG.e("Timer create failed: %s", esp_err_to_name(err));
+    return false;
+  }
+#endif
+  arm(now());
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void FrameScheduler::end()
+//------------------------------------------------------------------------------
+{
+#ifdef ESP_PLATFORM
+  if (timer_) {
+    esp_timer_stop(timer_);
+    esp_timer_delete(timer_);
+    timer_ = NULL;
+  }
+#endif
+}
+
+//------------------------------------------------------------------------------
+bool FrameScheduler::due(int64_t& frameUtc)
+//------------------------------------------------------------------------------
+{
+#ifdef ESP_PLATFORM
+  if (!fired_.exchange(false)) {
+    return false;
+  }
+#endif
+  int64_t now = this->now();
+  if (now < next_) {
+    // the clock was slewed or stepped back since the timer was armed
+#ifdef ESP_PLATFORM
+    arm(now);
+#endif
+    return false;
+  }
+
+  // the newest edge that has passed, older ones are skipped
+  int64_t edge = now - (now - next_) % periodUs_;
+  if (edge - next_ < 1000000) {
+    // not a clock step
+    skipped_ += (edge - next_) / periodUs_;
+  }
+  latency_ = now - edge;
+  maxLatency_ = max(maxLatency_, latency_);
+  ++frames_;
+  frameUtc = edge;
+  arm(now);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int64_t FrameScheduler::now()
+//------------------------------------------------------------------------------
+{
+  int64_t utc = clock_.now();
+  return utc ? utc + offset_ : 0;
+}
+
+//------------------------------------------------------------------------------
+void FrameScheduler::arm(int64_t now)
+//------------------------------------------------------------------------------
+{
+  // edges are multiples of the period in UTC, in phase with the second
+  int64_t phase = now % periodUs_;
+  if (phase < 0) {
+    phase += periodUs_;
+  }
+  next_ = now - phase + periodUs_;
+#ifdef ESP_PLATFORM
+  if (timer_) {
+    // clock µs and timer µs differ by the drift, at most a few µs per frame
+    esp_timer_stop(timer_);
+    esp_timer_start_once(timer_, next_ - now);
+  }
+#endif
+}
+
+#ifdef ESP_PLATFORM
+//------------------------------------------------------------------------------
+void FrameScheduler::onTimer(void* arg)
+//------------------------------------------------------------------------------
+{
+  // esp_timer task, the frame itself is rendered by the loop
+  ((FrameScheduler*)arg)->fired_ = true;
+}
+#endif
+
+//------------------------------------------------------------------------------
+uint16_t FrameScheduler::getFps()
+//------------------------------------------------------------------------------
+{
+  return 1000000 / periodUs_;
+}
+
+//------------------------------------------------------------------------------
+void FrameScheduler::setFps(uint16_t fps)
+//------------------------------------------------------------------------------
+{
+  // a divisor of 1s, so the second edge is always a frame edge
+  fps = max((uint16_t)1, min((uint16_t)1000, fps));
+  while (1000000 % fps) {
+    --fps;
+  }
+  periodUs_ = 1000000 / fps;
+}
+
+//------------------------------------------------------------------------------
+void FrameScheduler::setOffset(int32_t offset)
+//------------------------------------------------------------------------------
+{
+  // the edges stay multiples of the period in shifted time, the armed timer is off by the change for one
+  // frame: early, due() re-arms it, late, the frame still shows its edge
+  offset_ = offset;
+}
+
+//------------------------------------------------------------------------------
+uint32_t FrameScheduler::getFrames()
+//------------------------------------------------------------------------------
+{
+  return frames_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t FrameScheduler::getSkipped()
+//------------------------------------------------------------------------------
+{
+  return skipped_;
+}
+
+//------------------------------------------------------------------------------
+int64_t FrameScheduler::getLatency()
+//------------------------------------------------------------------------------
+{
+  return latency_;
+}
+
+//------------------------------------------------------------------------------
+int64_t FrameScheduler::getMaxLatency()
+//------------------------------------------------------------------------------
+{
+  return maxLatency_;
+}
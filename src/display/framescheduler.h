@@ -0,0 +1,82 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#endif
+
+#include <atomic>
+
+#include "time/clock.h"
+#include "util/logger.h"
+
+// Frames per second of the clock screen
+#ifndef FRAME_RATE
+#define FRAME_RATE 20
+#endif
+
+// Frame clock of the display, locked to the NTP disciplined second.
+// Frames are at the multiples of 1s / fps of the clock, so every second edge is a frame and the seconds
+// marker moves in equal steps. On the device each frame is triggered by a one-shot esp_timer (hardware timer),
+// re-armed for the next frame edge after every frame, so drift and slew of the clock never accumulate.
+// The instant to render is the frame edge itself, not the moment the loop gets to it.
+// Not thread safe, due() and the setters belong to the loop.
+class FrameScheduler {
+ public:
+  FrameScheduler(Clock& clock);
+
+  bool begin(uint16_t fps = FRAME_RATE);
+  void end();
+
+  // call from the loop, true once per frame with the instant (µs UTC) to render
+  bool due(int64_t& frameUtc);
+
+  uint16_t getFps();
+  void setFps(uint16_t fps);
+
+  // µs the frames are shifted against the clock, to flip the seconds in phase with other clocks (TickSync)
+  void setOffset(int32_t offset);
+
+  uint32_t getFrames();
+  // frames the loop came too late for
+  uint32_t getSkipped();
+  // µs the loop handled the last frame after its edge
+  int64_t getLatency();
+  int64_t getMaxLatency();
+
+ private:
+  int64_t now();
+  void arm(int64_t now);
+#ifdef ESP_PLATFORM
+  static void onTimer(void* arg);
+  esp_timer_handle_t timer_;
+#endif
+
+  Logger LOG;
+  Clock& clock_;
+  uint32_t periodUs_;
+  int32_t offset_;
+  int64_t next_;  // edge of the next frame
+  std::atomic<bool> fired_;
+  uint32_t frames_;
+  uint32_t skipped_;
+  int64_t latency_;
+  int64_t maxLatency_;
+};
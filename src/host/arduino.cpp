@@ -0,0 +1,239 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <Esp.h>
+#include <WiFi.h>
+#include <malloc.h>
+#include <nvs.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+EspClass ESP;
+
+// bytes allocated with new, and the most there ever were
+static std::atomic<size_t> heapUsed(0);
+static std::atomic<size_t> heapPeak(0);
+
+static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+//------------------------------------------------------------------------------
+int64_t esp_timer_get_time()
+//------------------------------------------------------------------------------
+{
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+//------------------------------------------------------------------------------
+uint32_t millis()
+//------------------------------------------------------------------------------
+{
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+//------------------------------------------------------------------------------
+uint32_t micros()
+//------------------------------------------------------------------------------
+{
+  return (uint32_t)esp_timer_get_time();
+}
+
+//------------------------------------------------------------------------------
+void delay(uint32_t ms)
+//------------------------------------------------------------------------------
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+//------------------------------------------------------------------------------
+void* operator new(size_t size)
+//------------------------------------------------------------------------------
+{
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  // what the allocator really takes, as heap_caps does on the device
+  size_t used = heapUsed += malloc_usable_size(p);
+  size_t peak = heapPeak;
+  while (used > peak && !heapPeak.compare_exchange_weak(peak, used)) {
+  }
+  return p;
+}
+
+//------------------------------------------------------------------------------
+void* operator new[](size_t size)
+//------------------------------------------------------------------------------
+{
+  return operator new(size);
+}
+
+//------------------------------------------------------------------------------
+void operator delete(void* p) noexcept
+//------------------------------------------------------------------------------
+{
+  if (p) {
+    heapUsed -= malloc_usable_size(p);
+    free(p);
+  }
+}
+
+//------------------------------------------------------------------------------
+void operator delete[](void* p) noexcept
+//------------------------------------------------------------------------------
+{
+  operator delete(p);
+}
+
+//------------------------------------------------------------------------------
+void operator delete(void* p, size_t) noexcept
+//------------------------------------------------------------------------------
+{
+  operator delete(p);
+}
+
+//------------------------------------------------------------------------------
+void operator delete[](void* p, size_t) noexcept
+//------------------------------------------------------------------------------
+{
+  operator delete(p);
+}
+
+//------------------------------------------------------------------------------
+uint32_t EspClass::getHeapSize()
+//------------------------------------------------------------------------------
+{
+  return HOST_HEAP_SIZE;
+}
+
+//------------------------------------------------------------------------------
+uint32_t EspClass::getFreeHeap()
+//------------------------------------------------------------------------------
+{
+  size_t used = heapUsed;
+  return used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+}
+
+//------------------------------------------------------------------------------
+uint32_t EspClass::getMinFreeHeap()
+//------------------------------------------------------------------------------
+{
+  size_t peak = heapPeak;
+  return peak < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - peak : 0;
+}
+
+//------------------------------------------------------------------------------
+size_t Print::printf(const char* format, ...)
+//------------------------------------------------------------------------------
+{
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  return write((const uint8_t*)buffer, min((size_t)n, sizeof(buffer) - 1));
+}
+
+//------------------------------------------------------------------------------
+size_t HardwareSerial::write(uint8_t c)
+//------------------------------------------------------------------------------
+{
+  return fwrite(&c, 1, 1, stdout);
+}
+
+//------------------------------------------------------------------------------
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+//------------------------------------------------------------------------------
+{
+  return fwrite(buffer, 1, size, stdout);
+}
+
+//------------------------------------------------------------------------------
+void WiFiClass::macAddress(uint8_t* mac)
+//------------------------------------------------------------------------------
+{
+  // locally administered, derived from the pid so parallel instances differ
+  pid_t pid = getpid();
+  mac[0] = 0x02;
+  mac[1] = 0x00;
+  mac[2] = (pid >> 24) & 0xff;
+  mac[3] = (pid >> 16) & 0xff;
+  mac[4] = (pid >> 8) & 0xff;
+  mac[5] = pid & 0xff;
+}
+
+//------------------------------------------------------------------------------
+const char* esp_err_to_name(esp_err_t code)
+//------------------------------------------------------------------------------
+{
+  switch (code) {
+    case ESP_OK:
+      return "ESP_OK";
+    case ESP_FAIL:
+      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+      return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+      return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_INITIALIZED:
+      return "ESP_ERR_NVS_NOT_INITIALIZED";
+    case ESP_ERR_NVS_NOT_FOUND:
+      return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH:
+      return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY:
+      return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE:
+      return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_NAME:
+      return "ESP_ERR_NVS_INVALID_NAME";
+    case ESP_ERR_NVS_INVALID_HANDLE:
+      return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG:
+      return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+      return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES:
+      return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_VALUE_TOO_LONG:
+      return "ESP_ERR_NVS_VALUE_TOO_LONG";
+    case ESP_ERR_NVS_PART_NOT_FOUND:
+      return "ESP_ERR_NVS_PART_NOT_FOUND";
+    default:
+      return "UNKNOWN ERROR";
+  }
+}
@@ -0,0 +1,27 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Commands of the host program, see host/main.cpp
+int nvsBench(int argc, char** argv);
+int ntpStandin(int argc, char** argv);
+int sntpSim(int argc, char** argv);
+int faceSim(int argc, char** argv);
+int tickSim(int argc, char** argv);
+int httpBench(int argc, char** argv);
+int webBench(int argc, char** argv);
@@ -0,0 +1,359 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// face-sim: runs Clock, PosixTz and ClockFace on an injected time source. Jumps to DST changes, leap days,
+// 2038 and the turn of the century and checks what the display shows, measures how many frames per second
+// the render path sustains and runs the clock at a time warp to see whether the frames keep up.
+
+#include <Arduino.h>
+#include <time.h>
+
+#include "display/clockface.h"
+#include "display/framescheduler.h"
+#include "host/commands.h"
+#include "time/clock.h"
+#include "time/posixtz.h"
+#include "time/tzdb.h"
+
+#define US_PER_S 1000000LL
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// stepped: time only moves when the simulation says so, deterministic
+static int64_t steppedNow = 0;
+// warped: real time, faster
+static double warp = 1000;
+
+//------------------------------------------------------------------------------
+static int64_t steppedSource()
+//------------------------------------------------------------------------------
+{
+  return steppedNow;
+}
+
+//------------------------------------------------------------------------------
+static int64_t warpedSource()
+//------------------------------------------------------------------------------
+{
+  return (int64_t)(esp_timer_get_time() * warp);
+}
+
+struct Scenario_t {
+  const char* name;
+  const char* zone;
+  const char* utc;     // YYYY-MM-DD HH:MM:SS
+  const char* before;  // shown at utc, HH:MM:SS DD.MM.YYYY
+  const char* after;   // shown one second later
+};
+
+static const Scenario_t scenarios[] = {
+    {"DST start", "Europe/Berlin", "2025-03-30 00:59:59", "01:59:59 30.03.2025", "03:00:00 30.03.2025"},
+    {"DST end", "Europe/Berlin", "2025-10-26 00:59:59", "02:59:59 26.10.2025", "02:00:00 26.10.2025"},
+    {"DST start, south", "Australia/Sydney", "2025-10-04 15:59:59", "01:59:59 05.10.2025", "03:00:00 05.10.2025"},
+    {"DST end, south", "Australia/Sydney", "2026-04-04 15:59:59", "02:59:59 05.04.2026", "02:00:00 05.04.2026"},
+    {"DST of 30 min", "Australia/Lord_Howe", "2025-10-04 15:29:59", "01:59:59 05.10.2025", "02:30:00 05.10.2025"},
+    {"DST at 26:00", "Asia/Jerusalem", "2025-03-27 23:59:59", "01:59:59 28.03.2025", "03:00:00 28.03.2025"},
+    {"negative DST", "Europe/Dublin", "2025-10-26 00:59:59", "01:59:59 26.10.2025", "01:00:00 26.10.2025"},
+    {"leap day", "Etc/UTC", "2024-02-28 23:59:59", "23:59:59 28.02.2024", "00:00:00 29.02.2024"},
+    {"after leap day", "Etc/UTC", "2024-02-29 23:59:59", "23:59:59 29.02.2024", "00:00:00 01.03.2024"},
+    {"32 bit time_t", "Etc/UTC", "2038-01-19 03:14:07", "03:14:07 19.01.2038", "03:14:08 19.01.2038"},
+    {"turn of the century", "Europe/Berlin", "2099-12-31 22:59:59", "23:59:59 31.12.2099", "00:00:00 01.01.2100"},
+    {"2100 no leap year", "Etc/UTC", "2100-02-28 23:59:59", "23:59:59 28.02.2100", "00:00:00 01.03.2100"},
+    {"DST in 2100", "America/New_York", "2100-03-14 06:59:59", "01:59:59 14.03.2100", "03:00:00 14.03.2100"},
+};
+
+//------------------------------------------------------------------------------
+static bool parseUtc(const char* text, int64_t& utc)
+//------------------------------------------------------------------------------
+{
+  int year, month, day, hour, minute, second;
+  if (sscanf(text, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6) {
+    return false;
+  }
+  utc = PosixTz::toUtc(year, month, day, hour, minute, second) * US_PER_S;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+static const char* shown(ClockFace& face)
+//------------------------------------------------------------------------------
+{
+  static char text[20];
+  snprintf(text, sizeof(text), "%s:%s %s", face.getTime(), face.getSeconds(), face.getDate());
+  return text;
+}
+
+//------------------------------------------------------------------------------
+static bool setZone(PosixTz& tz, const char* zone)
+//------------------------------------------------------------------------------
+{
+  const char* rule = TzDb::lookup(zone);
+  if (!rule || !tz.set(rule)) {
+    printf("unknown timezone '%s'\n", zone);
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+static int runScenarios()
+//------------------------------------------------------------------------------
+{
+  // the clock is stepped like after an NTP sync, then time advances by the injected source only
+  Clock clock(steppedSource);
+  PosixTz tz;
+  ClockFace face(tz);
+  int failed = 0;
+
+  for (const Scenario_t& scenario : scenarios) {
+    int64_t utc;
+    if (!setZone(tz, scenario.zone) || !parseUtc(scenario.utc, utc)) {
+      return -1;
+    }
+    steppedNow = 0;
+    clock.set(utc);
+    face.update(clock.now());
+    String before = shown(face);
+    steppedNow += US_PER_S;
+    face.update(clock.now());
+    String after = shown(face);
+
+    bool ok = before == scenario.before && after == scenario.after;
+    printf("  %-4s %-20s %-20s %s -> %s\n", ok ? "ok" : "FAIL", scenario.name, scenario.zone, before.c_str(), after.c_str());
+    if (!ok) {
+      printf("       expected %s -> %s\n", scenario.before, scenario.after);
+      ++failed;
+    }
+  }
+
+  // the marker starts at the left edge and reaches the right edge at the end of the minute
+  tz.set("UTC0");
+  steppedNow = 0;
+  clock.set(PosixTz::toUtc(2025, 1, 1, 12, 0, 0) * US_PER_S);
+  face.update(clock.now());
+  uint8_t left = face.getMarker();
+  steppedNow += 59999000;
+  face.update(clock.now());
+  uint8_t right = face.getMarker();
+  bool ok = left == 0 && right == 128 - CLOCK_FACE_MARKER_WIDTH;
+  printf("  %-4s %-20s %-20s x %u .. %u\n", ok ? "ok" : "FAIL", "seconds marker", "", left, right);
+  if (!ok) {
+    ++failed;
+  }
+  return failed;
+}
+
+//------------------------------------------------------------------------------
+static int verifyZones(int32_t fromYear, int32_t toYear)
+//------------------------------------------------------------------------------
+{
+  // every rule of the table against the libc implementation, every 1799s (drifts over all minutes)
+  PosixTz tz;
+  int failed = 0;
+  uint32_t samples = 0;
+  int64_t from = PosixTz::toUtc(fromYear, 1, 1, 0, 0, 0);
+  int64_t to = PosixTz::toUtc(toYear + 1, 1, 1, 0, 0, 0);
+  for (size_t i = 0; i < TzDb::size(); ++i) {
+    const char* rule = TzDb::getRule(i);
+    if (!tz.set(rule)) {
+      printf("  FAIL %s: can't parse '%s'\n", TzDb::getName(i), rule);
+      ++failed;
+      continue;
+    }
+    setenv("TZ", rule, 1);
+    tzset();
+    for (int64_t t = from; t < to; t += 1799) {
+      LocalTime_t local;
+      tz.toLocal(t, local);
+      time_t libcTime = t;
+      struct tm tm;
+      localtime_r(&libcTime, &tm);
+      ++samples;
+      if (local.year != tm.tm_year + 1900 || local.month != tm.tm_mon + 1 || local.day != tm.tm_mday || local.hour != tm.tm_hour ||
+          local.minute != tm.tm_min || local.second != tm.tm_sec || local.weekday != tm.tm_wday || local.dst != (tm.tm_isdst > 0)) {
+        printf("  FAIL %s '%s' at %" PRId64 ": %04u-%02u-%02u %02u:%02u:%02u%s, libc %04d-%02d-%02d %02d:%02d:%02d%s\n",
+               TzDb::getName(i), rule, t, local.year, local.month, local.day, local.hour, local.minute, local.second,
+               local.dst ? " DST" : "", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+               tm.tm_isdst > 0 ? " DST" : "");
+        ++failed;
+        break;
+      }
+    }
+  }
+  unsetenv("TZ");
+  printf("  %u zones, %u samples %d..%d, %d differ from libc\n", (unsigned)TzDb::size(), samples, fromYear, toYear, failed);
+  return failed;
+}
+
+//------------------------------------------------------------------------------
+static void benchmark(const char* zone, uint32_t frames, uint32_t frameUs)
+//------------------------------------------------------------------------------
+{
+  Clock clock(steppedSource);
+  PosixTz tz;
+  ClockFace face(tz);
+  setZone(tz, zone);
+
+  // consecutive frames at the display rate, the common case
+  steppedNow = 0;
+  clock.set(PosixTz::toUtc(2025, 1, 1, 0, 0, 0) * US_PER_S);
+  uint32_t changed = 0;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < frames; ++i) {
+    steppedNow += frameUs;
+    changed += face.update(clock.now()) != FACE_UNCHANGED;
+  }
+  int64_t consecutive = esp_timer_get_time() - start;
+
+  // random instants 1970..2200, every frame in another year
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  int64_t span = PosixTz::toUtc(2200, 1, 1, 0, 0, 0) * US_PER_S;
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < frames; ++i) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    face.update((seed >> 1) % span);
+  }
+  int64_t jumping = esp_timer_get_time() - start;
+
+  printf("  %u frames of %s, %u of the consecutive ones changed the screen\n", frames, zone, changed);
+  char label[32];
+  snprintf(label, sizeof(label), "consecutive, %uµs apart", frameUs);
+  printf("  %-26s %10.0f frames/s\n", label, frames * 1e6 / max(consecutive, (int64_t)1));
+  printf("  %-26s %10.0f frames/s\n", "random instants", frames * 1e6 / max(jumping, (int64_t)1));
+  printf("  without drawing, on the device the I2C transfer of the frame buffer dominates\n");
+}
+
+//------------------------------------------------------------------------------
+static int warpRun(const char* zone, const char* at, double seconds, uint16_t fps)
+//------------------------------------------------------------------------------
+{
+  // the loop of the device: frames from the FrameScheduler on a clock running warp times faster.
+  // Fails if a frame is off the edges or the marker jumps between two consecutive frames.
+  Clock clock(warpedSource);
+  PosixTz tz;
+  ClockFace face(tz);
+  FrameScheduler scheduler(clock);
+  setZone(tz, zone);
+  int64_t utc;
+  parseUtc(at, utc);
+  clock.set(utc);
+  scheduler.begin(fps);
+
+  int64_t end = utc + (int64_t)(seconds * US_PER_S);
+  int64_t realStart = esp_timer_get_time();
+  LocalTime_t last = {};
+  uint32_t offEdge = 0;
+  uint32_t jumps = 0;
+  uint32_t unexplained = 0;
+  uint8_t lastMarker = 0;
+  int64_t frameUtc = utc;
+  int64_t lastFrameUtc = 0;
+  while (frameUtc < end) {
+    if (!scheduler.due(frameUtc)) {
+      continue;
+    }
+    uint8_t changed = face.update(frameUtc);
+    // every frame is on an edge of the second, the marker never moves by more than a pixel
+    offEdge += (frameUtc % US_PER_S) % (US_PER_S / scheduler.getFps()) != 0;
+    if ((changed & FACE_MARKER) && face.getMarker() != 0 && face.getMarker() != lastMarker + 1) {
+      ++jumps;
+      // a late loop drops frames, then the marker moves on by as many pixels. The skip counter misses
+      // gaps over a second, they look like a clock step, so the gap between the frames decides.
+      unexplained += frameUtc - lastFrameUtc <= US_PER_S / scheduler.getFps();
+    }
+    lastMarker = face.getMarker();
+    lastFrameUtc = frameUtc;
+
+    // one line per hour shown
+    const LocalTime_t& local = face.getLocal();
+    if (local.hour != last.hour || local.day != last.day || local.dst != last.dst || scheduler.getFrames() == 1) {
+      printf("  %s %s%s\n", at, shown(face), local.dst ? " DST" : "");
+      last = local;
+      at = "                   ";
+    }
+  }
+  scheduler.end();
+  double real = (esp_timer_get_time() - realStart) / 1e6;
+  printf("  %.0f simulated s in %.3f real s (%.0fx), %u frames at %u fps, %u skipped\n", seconds, real, seconds / real,
+         scheduler.getFrames(), scheduler.getFps(), scheduler.getSkipped());
+  printf("  max latency %" PRId64 " simulated µs, %u frames off the edges, %u marker jumps, %u of them between consecutive frames\n",
+         scheduler.getMaxLatency(), offEdge, jumps, unexplained);
+  if (offEdge || unexplained) {
+    printf("  FAILED\n");
+  }
+  return offEdge + unexplained;
+}
+
+//------------------------------------------------------------------------------
+int faceSim(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  const char* zone = "Europe/Berlin";
+  const char* at = "2025-03-30 00:30:00";
+  double seconds = 3600;
+  uint32_t frames = 2000000;
+  uint16_t fps = FRAME_RATE;
+  bool verify = false;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--zone") == 0 && hasValue) {
+      zone = argv[++i];
+    } else if (strcmp(argv[i], "--at") == 0 && hasValue) {
+      at = argv[++i];
+    } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--warp") == 0 && hasValue) {
+      warp = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+      frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--fps") == 0 && hasValue) {
+      fps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--verify") == 0) {
+      verify = true;
+    } else {
+      printf(
+          "usage: face-sim [options]\n"
+          "  --zone NAME      timezone of the benchmark and the warp run (default Europe/Berlin)\n"
+          "  --at TIME        UTC start of the warp run, 'YYYY-MM-DD HH:MM:SS' (default 2025-03-30 00:30:00)\n"
+          "  --seconds N      simulated seconds of the warp run (default 3600)\n"
+          "  --warp N         simulated seconds per real second (default 1000)\n"
+          "  --frames N       frames of the benchmark (default 2000000)\n"
+          "  --fps N          frame rate of the display (default " STR(FRAME_RATE) ")\n"
+          "  --verify         compare every rule of the timezone table with libc\n");
+      return 1;
+    }
+  }
+  int64_t utc;
+  if (!TzDb::lookup(zone) || !parseUtc(at, utc)) {
+    printf("unknown timezone '%s' or bad time '%s'\n", zone, at);
+    return 1;
+  }
+
+  printf("scenarios, stepped clock\n");
+  int failed = runScenarios();
+  if (verify) {
+    printf("\ntimezone table %s against libc\n", TzDb::getVersion());
+    failed += verifyZones(2024, 2026);
+    failed += verifyZones(2099, 2101);
+  }
+  printf("\nrender path\n");
+  benchmark(zone, frames, 1000000 / fps);
+  printf("\nwarp run, %s from %s UTC at %.0fx\n", zone, at, warp);
+  failed += warpRun(zone, at, seconds, fps);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,348 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// http-bench: HTTP clients against the HttpServer while the loop renders frames, on the host.
+// Reports requests/s and the frame latency (display jitter), with some clients that send their request
+// byte by byte. --sync serves from the loop instead, one client at a time as WebServer does, for comparison.
+// --keep-alive sends several requests per connection, --pipeline sends them without waiting for the responses.
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "display/framescheduler.h"
+#include "host/commands.h"
+#include "net/httpserver.h"
+#include "time/clock.h"
+
+#define HTTP_BENCH_PORT 18080
+#define HTTP_BENCH_MAX_CLIENTS 64
+// a slow client sends one byte of its request every this many ms
+#define HTTP_BENCH_SLOW_BYTE_MS 100
+
+static const char request[] = "GET /boot HTTP/1.1\r\nHost: clock\r\nConnection: close\r\n\r\n";
+static const char persistentRequest[] = "GET /boot HTTP/1.1\r\nHost: clock\r\n\r\n";
+
+struct ClientResult_t {
+  uint32_t ok;
+  uint32_t failed;
+  int64_t latencySum;
+  int64_t maxLatency;
+};
+
+//------------------------------------------------------------------------------
+static void bootJson(HttpRequest&, HttpResponse& response)
+//------------------------------------------------------------------------------
+{
+  // about the size of the boot timeline
+  response.setContentType("application/json");
+  response.print("{");
+  for (uint8_t i = 0; i < 16; ++i) {
+    response.printf("%s\"stage%u\":%u", i ? "," : "", i, 1000000 + i * 12345);
+  }
+  response.print("}");
+}
+
+//------------------------------------------------------------------------------
+static int connectTo(uint16_t port)
+//------------------------------------------------------------------------------
+{
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = inet_addr("127.0.0.1");
+  // longer than any server timeout, a request is only lost if it is dropped
+  struct timeval timeout = {10, 0};
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (connect(s, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(s);
+    return -1;
+  }
+  return s;
+}
+
+//------------------------------------------------------------------------------
+static bool readResponse(int s, char* input, size_t& length, size_t size)
+//------------------------------------------------------------------------------
+{
+  // one response by its Content-Length, what is received behind it stays in input
+  while (true) {
+    input[length] = 0;
+    char* end = strstr(input, "\r\n\r\n");
+    if (end) {
+      const char* contentLength = strstr(input, "Content-Length: ");
+      size_t total = end + 4 - input + (contentLength && contentLength < end ? strtoul(contentLength + 16, NULL, 10) : 0);
+      if (length >= total) {
+        bool ok = strncmp(input, "HTTP/1.1 200", 12) == 0;
+        length -= total;
+        memmove(input, input + total, length);
+        return ok;
+      }
+    }
+    if (length >= size - 1) {
+      return false;
+    }
+    ssize_t n = recv(s, input + length, size - 1 - length, 0);
+    if (n <= 0) {
+      return false;
+    }
+    length += n;
+  }
+}
+
+//------------------------------------------------------------------------------
+static void session(uint16_t port, bool slow, uint16_t requests, bool pipeline, std::atomic<bool>& stop, ClientResult_t& result)
+//------------------------------------------------------------------------------
+{
+  // requests on one connection, one by one or all at once
+  int s = connectTo(port);
+  if (s < 0) {
+    ++result.failed;
+    return;
+  }
+  const char* text = requests > 1 ? persistentRequest : request;
+  size_t textLength = strlen(text);
+  char input[4096];
+  size_t length = 0;
+  uint16_t done = 0;
+  while (done < requests && !stop) {
+    uint16_t batch = pipeline ? requests - done : 1;
+    int64_t start = esp_timer_get_time();
+    for (uint16_t i = 0; i < batch; ++i) {
+      if (slow) {
+        for (size_t j = 0; j < textLength; ++j) {
+          send(s, text + j, 1, MSG_NOSIGNAL);
+          usleep(HTTP_BENCH_SLOW_BYTE_MS * 1000);
+        }
+      } else {
+        send(s, text, textLength, MSG_NOSIGNAL);
+      }
+    }
+    for (uint16_t i = 0; i < batch; ++i) {
+      if (!readResponse(s, input, length, sizeof(input))) {
+        result.failed += batch - i;
+        close(s);
+        return;
+      }
+      int64_t latency = esp_timer_get_time() - start;
+      ++result.ok;
+      result.latencySum += latency;
+      result.maxLatency = max(result.maxLatency, latency);
+    }
+    done += batch;
+  }
+  close(s);
+}
+
+//------------------------------------------------------------------------------
+static void serveBlocking(int listenSocket)
+//------------------------------------------------------------------------------
+{
+  // WebServer::handleClient(): a waiting client is served to the end, its data is waited for
+  int client = accept(listenSocket, NULL, NULL);
+  if (client < 0) {
+    return;
+  }
+  struct timeval timeout = {HTTP_SERVER_TIMEOUT_MS / 1000, 0};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char input[HTTP_REQUEST_BUFFER_SIZE];
+  size_t length = 0;
+  ssize_t n;
+  input[0] = 0;
+  while (!strstr(input, "\r\n\r\n") && (n = recv(client, input + length, sizeof(input) - 1 - length, 0)) > 0) {
+    length += n;
+    input[length] = 0;
+  }
+  char body[512];
+  int bodyLength = snprintf(body, sizeof(body), "{");
+  for (uint8_t i = 0; i < 16; ++i) {
+    bodyLength += snprintf(body + bodyLength, sizeof(body) - bodyLength, "%s\"stage%u\":%u", i ? "," : "", i, 1000000 + i * 12345);
+  }
+  bodyLength += snprintf(body + bodyLength, sizeof(body) - bodyLength, "}");
+  char head[128];
+  int headLength =
+      snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n", bodyLength);
+  send(client, head, headLength, MSG_NOSIGNAL);
+  send(client, body, bodyLength, MSG_NOSIGNAL);
+  close(client);
+}
+
+//------------------------------------------------------------------------------
+int httpBench(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  uint8_t clients = 8;
+  uint8_t slowClients = 1;
+  double seconds = 5;
+  bool sync = false;
+  uint16_t port = HTTP_BENCH_PORT;
+  uint16_t keepAlive = 1;
+  bool pipeline = false;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--clients") == 0 && hasValue) {
+      clients = max(1, min(HTTP_BENCH_MAX_CLIENTS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--slow") == 0 && hasValue) {
+      slowClients = max(0, min(HTTP_BENCH_MAX_CLIENTS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--sync") == 0) {
+      sync = true;
+    } else if (strcmp(argv[i], "--port") == 0 && hasValue) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--keep-alive") == 0 && hasValue) {
+      keepAlive = max(1, min(HTTP_SERVER_KEEPALIVE_MAX_REQUESTS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      pipeline = true;
+    } else {
+      printf(
+          "usage: http-bench [options]\n"
+          "  --clients N   clients sending requests back to back (default 8)\n"
+          "  --slow N      clients sending their request byte by byte, %u ms per byte (default 1)\n"
+          "  --seconds N   real seconds to run (default 5)\n"
+          "  --sync        serve from the loop, one client at a time like WebServer\n"
+          "  --port N      TCP port (default %u)\n"
+          "  --keep-alive N  requests per connection (default 1)\n"
+          "  --pipeline    send the requests of a connection at once\n",
+          HTTP_BENCH_SLOW_BYTE_MS, HTTP_BENCH_PORT);
+      return 1;
+    }
+  }
+
+  HttpServer server;
+  int listenSocket = -1;
+  if (sync) {
+    // the blocking server closes after every response
+    keepAlive = 1;
+    pipeline = false;
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, HTTP_SERVER_MAX_CONNECTIONS) != 0) {
+      printf("could not listen on TCP %u\n", port);
+      return 1;
+    }
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+  } else {
+    server.on("/boot", HTTP_METHOD_GET, bootJson);
+    if (!server.begin(port)) {
+      return 1;
+    }
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint8_t> finished(0);
+  std::vector<ClientResult_t> results(clients + slowClients);
+  std::vector<std::thread> threads;
+  // the slow clients first, so they are connected before the backlog fills up
+  for (int i = clients + slowClients - 1; i >= 0; --i) {
+    if (i == clients - 1) {
+      usleep(50000);
+    }
+    threads.emplace_back([&, i]() {
+      ClientResult_t& result = results[i];
+      result = {};
+      while (!stop) {
+        // a slow client is one request, byte by byte
+        bool slow = i >= clients;
+        session(port, slow, slow ? 1 : keepAlive, pipeline, stop, result);
+      }
+      ++finished;
+    });
+  }
+
+  // the loop of the device: frames, and in sync mode the web server
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  Clock clock;
+  clock.set((int64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+  FrameScheduler frames(clock);
+  frames.begin();
+  int64_t latencySum = 0;
+  // what the display shows: the longest time it stood still
+  int64_t lastFrame = esp_timer_get_time();
+  int64_t maxGap = 0;
+  int64_t end = esp_timer_get_time() + (int64_t)(seconds * 1000000);
+  while (esp_timer_get_time() < end) {
+    int64_t frameUtc;
+    if (frames.due(frameUtc)) {
+      latencySum += frames.getLatency();
+      maxGap = max(maxGap, esp_timer_get_time() - lastFrame);
+      lastFrame = esp_timer_get_time();
+    }
+    if (sync) {
+      serveBlocking(listenSocket);
+    }
+    usleep(500);
+  }
+  stop = true;
+  // the slow clients finish their request, in sync mode they need the loop for that
+  while (sync && finished < clients + slowClients) {
+    serveBlocking(listenSocket);
+    usleep(500);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ClientResult_t total[2] = {};
+  for (uint8_t i = 0; i < clients + slowClients; ++i) {
+    ClientResult_t& sum = total[i >= clients];
+    sum.ok += results[i].ok;
+    sum.failed += results[i].failed;
+    sum.latencySum += results[i].latencySum;
+    sum.maxLatency = max(sum.maxLatency, results[i].maxLatency);
+  }
+
+  printf("%u clients, %u slow, %.1f s, %u requests per connection%s, %s\n", clients, slowClients, seconds, keepAlive,
+         pipeline ? " pipelined" : "", sync ? "served from the loop (--sync)" : "HttpServer");
+  printf("  requests        %u ok, %u failed, %.1f/s\n", total[0].ok, total[0].failed, total[0].ok / seconds);
+  printf("  latency         avg %.3f ms, max %.3f ms\n", total[0].ok ? total[0].latencySum / 1000.0 / total[0].ok : 0.0,
+         total[0].maxLatency / 1000.0);
+  printf("  slow requests   %u ok, %u failed, max %.3f ms\n", total[1].ok, total[1].failed, total[1].maxLatency / 1000.0);
+  if (!sync) {
+    printf("  server          %u requests, %u connections, %u reused, max %u concurrent, %u timeouts\n", server.getRequests(),
+           server.getConnections(), server.getReused(), server.getMaxConcurrent(), server.getTimeouts());
+  }
+  uint32_t expected = seconds * frames.getFps();
+  printf("  frames          %u of %u at %u fps, latency avg %.3f ms, max %.3f ms\n", frames.getFrames(), expected, frames.getFps(),
+         frames.getFrames() ? latencySum / 1000.0 / frames.getFrames() : 0.0, frames.getMaxLatency() / 1000.0);
+  printf("  display stalled max %.3f ms (frame period %.3f ms)\n", maxGap / 1000.0, 1000.0 / frames.getFps());
+
+  frames.end();
+  server.end();
+  if (listenSocket >= 0) {
+    close(listenSocket);
+  }
+  return 0;
+}
@@ -0,0 +1,37 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// heap of the host "device", about what an ESP32 has free after the WiFi started
+#ifndef HOST_HEAP_SIZE
+#define HOST_HEAP_SIZE (320 * 1024)
+#endif
+
+// Host replacement for the heap figures of the Arduino core. Everything allocated with new counts
+// against HOST_HEAP_SIZE (see host/arduino.cpp), so the low-water mark of a run can be compared with
+// the device, malloc() and thread stacks are not counted.
+class EspClass {
+ public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+};
+
+extern EspClass ESP;
@@ -0,0 +1,91 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+class String {
+ public:
+  String() {}
+  String(const char* value) : value_(value ? value : "") {}
+  String(const String& value) : value_(value.value_) {}
+  explicit String(char c) : value_(1, c) {}
+  explicit String(int value) : value_(std::to_string(value)) {}
+  explicit String(unsigned int value) : value_(std::to_string(value)) {}
+  explicit String(long value) : value_(std::to_string(value)) {}
+  explicit String(unsigned long value) : value_(std::to_string(value)) {}
+
+  String& operator=(const String& value) {
+    value_ = value.value_;
+    return *this;
+  }
+  String& operator=(const char* value) {
+    value_ = value ? value : "";
+    return *this;
+  }
+
+  const char* c_str() const { return value_.c_str(); }
+  unsigned int length() const { return value_.length(); }
+  bool isEmpty() const { return value_.empty(); }
+
+  bool equals(const String& other) const { return value_ == other.value_; }
+  bool equals(const char* other) const { return value_ == other; }
+  bool operator==(const String& other) const { return value_ == other.value_; }
+  bool operator==(const char* other) const { return value_ == other; }
+  bool operator!=(const String& other) const { return value_ != other.value_; }
+  bool operator!=(const char* other) const { return value_ != other; }
+  bool operator<(const String& other) const { return value_ < other.value_; }
+  bool startsWith(const String& prefix) const { return value_.compare(0, prefix.value_.length(), prefix.value_) == 0; }
+
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t i = value_.find(c, from);
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  String substring(unsigned int from) const { return from < value_.length() ? String(value_.substr(from).c_str()) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to && from < value_.length() ? String(value_.substr(from, to - from).c_str()) : String();
+  }
+  long toInt() const { return strtol(value_.c_str(), NULL, 10); }
+
+  String& operator+=(const String& other) {
+    value_ += other.value_;
+    return *this;
+  }
+  String& operator+=(const char* other) {
+    value_ += other;
+    return *this;
+  }
+  String& operator+=(char c) {
+    value_ += c;
+    return *this;
+  }
+  bool concat(const char* other) {
+    value_ += other;
+    return true;
+  }
+
+  friend String operator+(const String& a, const String& b) { return String((a.value_ + b.value_).c_str()); }
+  friend String operator+(const String& a, const char* b) { return String((a.value_ + b).c_str()); }
+  friend String operator+(const char* a, const String& b) { return String((a + b.value_).c_str()); }
+
+ private:
+  std::string value_;
+};
@@ -0,0 +1,63 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host build entry point, bundles the simulation and benchmark tools.
+// Build with 'pio run -e native', run '.pio/build/native/program <command> --help'.
+
+#include <Arduino.h>
+
+#include "host/commands.h"
+
+// the unit tests in test/ bring their own main()
+#ifndef UNIT_TEST
+
+struct Command_t {
+  const char* name;
+  int (*run)(int argc, char** argv);
+  const char* help;
+};
+
+static const Command_t commands[] = {
+    {"nvs-bench", nvsBench, "NVS write pattern benchmark and flash lifetime estimate on the emulator"},
+    {"ntp-standin", ntpStandin, "minimal SNTP server, to test a device against"},
+    {"sntp-sim", sntpSim, "SNTP client and clock discipline against the stand-in, with crystal error and time warp"},
+    {"face-sim", faceSim, "clock face through DST changes, leap years and 2100 on a stepped or warped clock, frames/s"},
+    {"tick-sim", tickSim, "clocks aligning their seconds over multicast on loopback, real and measured skew"},
+    {"http-bench", httpBench, "HTTP clients, some of them slow, against the HttpServer while frames are rendered, requests/s and jitter"},
+    {"web-bench", webBench, "clients against the pages and the REST API, here or on a device, latency percentiles and heap low-water mark"},
+};
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  if (argc >= 2) {
+    for (const Command_t& command : commands) {
+      if (strcmp(argv[1], command.name) == 0) {
+        return command.run(argc - 1, argv + 1);
+      }
+    }
+  }
+
+  printf("usage: %s <command> [options]\n\ncommands:\n", argv[0]);
+  for (const Command_t& command : commands) {
+    printf("  %-12s %s\n", command.name, command.help);
+  }
+  return 1;
+}
+
+#endif
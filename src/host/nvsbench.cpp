@@ -0,0 +1,174 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// nvs-bench: drives the real NVS and Config classes against the flash emulator
+// with a settings update pattern and reports flash cost and expected lifetime.
+
+#include <Arduino.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "config.h"
+#include "host/commands.h"
+#include "host/nvsemulator.h"
+#include "util/nvs.h"
+
+//------------------------------------------------------------------------------
+static int usage()
+//------------------------------------------------------------------------------
+{
+  printf(
+      "usage: nvs-bench [options]\n"
+      "  --image FILE     partition image (default nvs-bench.bin)\n"
+      "  --size BYTES     partition size (default 0x5000)\n"
+      "  --keep           keep image and wear counters of a previous run\n"
+      "  --updates N      settings updates to run (default 10000)\n"
+      "  --per-day N      expected settings updates per day (default 24)\n"
+      "  --coalesce N     updates per commit, as the write-back cache batches them (default 1)\n"
+      "  --pattern P      'config' (one record blob, default) or 'strings' (one key per setting)\n");
+  return 1;
+}
+
+//------------------------------------------------------------------------------
+int nvsBench(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  String image = "nvs-bench.bin";
+  size_t size = 0x5000;
+  bool keep = false;
+  uint32_t updates = 10000;
+  double perDay = 24;
+  uint32_t coalesce = 1;
+  String pattern = "config";
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--image") == 0 && hasValue) {
+      image = argv[++i];
+    } else if (strcmp(argv[i], "--size") == 0 && hasValue) {
+      size = strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--keep") == 0) {
+      keep = true;
+    } else if (strcmp(argv[i], "--updates") == 0 && hasValue) {
+      updates = strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--per-day") == 0 && hasValue) {
+      perDay = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--coalesce") == 0 && hasValue) {
+      coalesce = max(1ul, strtoul(argv[++i], NULL, 0));
+    } else if (strcmp(argv[i], "--pattern") == 0 && hasValue) {
+      pattern = argv[++i];
+    } else {
+      return usage();
+    }
+  }
+  if (pattern != "config" && pattern != "strings") {
+    return usage();
+  }
+
+  if (!keep) {
+    unlink(image.c_str());
+    unlink((image + ".wear").c_str());
+  }
+  if (!NvsEmulator::open(image.c_str(), size)) {
+    return 1;
+  }
+
+  std::vector<uint32_t> wearBefore(size / NVS_EMULATOR_PAGE_SIZE);
+  for (size_t p = 0; p < size / NVS_EMULATOR_PAGE_SIZE; ++p) {
+    wearBefore[p] = NvsEmulator::getPageErases(p);
+  }
+
+  NVS nvs("storage");
+  if (!nvs.begin()) {
+    return 1;
+  }
+  Config config(nvs);
+  config.load();
+
+  // alternate between two values, so every update is a real change
+  const char* timezones[] = {"Europe/Berlin", "America/New_York"};
+  const char* names[] = {"clock-kitchen", "clock-office"};
+  NvsEmulator::resetStats();
+  uint64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < updates; ++i) {
+    if (pattern == "config") {
+      config.setTimezone(timezones[i % 2]);
+      config.setDeviceName(names[(i / 2) % 2]);
+      config.save(false);
+    } else {
+      nvs.writeString("timezone", timezones[i % 2]);
+      nvs.writeString("devicename", names[(i / 2) % 2]);
+    }
+    if ((i + 1) % coalesce == 0 && !nvs.commit()) {
+      printf("commit failed after %u updates\n", i + 1);
+      return 1;
+    }
+  }
+  nvs.commit();
+  uint64_t hostUs = esp_timer_get_time() - start;
+  NvsEmulatorStats_t stats = NvsEmulator::getStats();
+
+  uint32_t maxErases = 0;
+  for (size_t p = 0; p < stats.pages; ++p) {
+    maxErases = max(maxErases, NvsEmulator::getPageErases(p) - wearBefore[p]);
+  }
+
+  // persistence: reopen the image like after a reboot and read the values back
+  nvs.end();
+  NvsEmulator::close();
+  NvsEmulator::open(image.c_str(), size);
+  NVS reopened("storage");
+  reopened.begin();
+  String persisted;
+  String expected;
+  if (pattern == "config") {
+    Config check(reopened);
+    check.load();
+    persisted = check.getTimezone() + " / " + check.getDeviceName();
+    expected = config.getTimezone() + " / " + config.getDeviceName();
+  } else {
+    String tz;
+    String name;
+    reopened.readString("timezone", tz);
+    reopened.readString("devicename", name);
+    persisted = tz + " / " + name;
+    expected = String(timezones[(updates - 1) % 2]) + " / " + names[((updates - 1) / 2) % 2];
+  }
+  reopened.end();
+  NvsEmulator::close();
+
+  printf("\npattern %s, %u updates, %u per commit, %u pages\n", pattern.c_str(), updates, coalesce, stats.pages);
+  printf("  commits            %llu\n", (unsigned long long)stats.commits);
+  printf("  bytes programmed   %llu (%.1f per update)\n", (unsigned long long)stats.bytesProgrammed, (double)stats.bytesProgrammed / updates);
+  printf("  program ops        %llu\n", (unsigned long long)stats.programOps);
+  printf("  page erases        %llu (gc runs %llu)\n", (unsigned long long)stats.eraseOps, (unsigned long long)stats.gcRuns);
+  printf("  illegal writes     %llu\n", (unsigned long long)stats.illegalWrites);
+  printf("  flash time         %.1f ms (%.1f us per update)\n", stats.flashTimeUs / 1000.0, (double)stats.flashTimeUs / updates);
+  printf("  worst commit       %.1f ms\n", stats.maxCommitUs / 1000.0);
+  printf("  host time          %.1f ms\n", hostUs / 1000.0);
+  printf("  max erases on one page %u, lifetime max %u of %u\n", maxErases, stats.maxPageErases, NVS_EMULATOR_ENDURANCE);
+  if (maxErases) {
+    double days = (NVS_EMULATOR_ENDURANCE - stats.maxPageErases) * (double)updates / maxErases / perDay;
+    printf("  remaining lifetime at %.0f updates/day: %.0f years\n", perDay, days / 365.0);
+  } else {
+    printf("  remaining lifetime: no page erased, run more updates\n");
+  }
+  printf("  persistence        %s (%s)\n", persisted == expected ? "ok" : "FAILED", persisted.c_str());
+
+  return persisted == expected ? 0 : 1;
+}
@@ -0,0 +1,908 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host/nvsemulator.h"
+
+#include <fcntl.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "util/crc32.h"
+#include "util/logger.h"
+
+namespace {
+
+const size_t ENTRY_SIZE = 32;
+const size_t ENTRY_COUNT = 126;
+const size_t BITMAP_OFFSET = 32;
+const size_t ENTRIES_OFFSET = 64;
+const size_t MAX_VARIABLE_SIZE = (ENTRY_COUNT - 1) * ENTRY_SIZE;
+
+const uint32_t PAGE_EMPTY = 0xffffffff;
+const uint32_t PAGE_ACTIVE = 0xfffffffe;
+const uint32_t PAGE_FULL = 0xfffffffc;
+const uint8_t PAGE_VERSION = 0xfe;
+
+const uint8_t ENTRY_EMPTY = 3;
+const uint8_t ENTRY_WRITTEN = 2;
+const uint8_t ENTRY_ERASED = 0;
+
+// type codes as used by the IDF
+const uint8_t ITEM_U8 = 0x01;
+const uint8_t ITEM_I8 = 0x11;
+const uint8_t ITEM_U16 = 0x02;
+const uint8_t ITEM_I16 = 0x12;
+const uint8_t ITEM_U32 = 0x04;
+const uint8_t ITEM_I32 = 0x14;
+const uint8_t ITEM_U64 = 0x08;
+const uint8_t ITEM_I64 = 0x18;
+const uint8_t ITEM_STR = 0x21;
+const uint8_t ITEM_BLOB = 0x41;
+
+struct PageHeader_t {
+  uint32_t state;
+  uint32_t seq;
+  uint8_t version;
+  uint8_t reserved[19];
+  uint32_t crc;
+};
+
+struct Item_t {
+  uint8_t ns;
+  uint8_t type;
+  uint8_t span;
+  uint8_t chunk;
+  uint32_t crc;
+  char key[NVS_KEY_NAME_MAX_SIZE];
+  union {
+    uint8_t data[8];
+    struct {
+      uint16_t size;
+      uint16_t reserved;
+      uint32_t crc;
+    } var;
+  };
+};
+
+static_assert(sizeof(PageHeader_t) == ENTRY_SIZE, "page header must be one entry");
+static_assert(sizeof(Item_t) == ENTRY_SIZE, "item must be one entry");
+
+struct Page_t {
+  uint32_t state;
+  uint32_t seq;
+  uint16_t next;  // first free entry
+  uint16_t used;
+  uint16_t erased;
+};
+
+struct Location_t {
+  uint16_t page;
+  uint16_t entry;
+  uint8_t span;
+  uint8_t type;
+};
+
+struct Handle_t {
+  uint8_t ns;
+  bool readOnly;
+};
+
+typedef std::pair<uint8_t, std::string> Key_t;
+
+Logger LOG("NvsEmulator");
+
+int fd_ = -1;
+int wearFd_ = -1;
+uint8_t* image_ = NULL;
+uint32_t* wear_ = NULL;
+size_t pageCount_ = 0;
+bool initialized_ = false;
+
+std::vector<Page_t> pages_;
+int active_ = -1;
+uint32_t nextSeq_ = 0;
+std::map<Key_t, Location_t> items_;  // namespace 0 holds the namespace entries
+std::map<nvs_handle, Handle_t> handles_;
+nvs_handle nextHandle_ = 1;
+
+NvsEmulatorStats_t stats_;
+uint64_t uncommittedUs_ = 0;
+
+//------------------------------------------------------------------------------
+size_t pageOffset(size_t page)
+//------------------------------------------------------------------------------
+{
+  return page * NVS_EMULATOR_PAGE_SIZE;
+}
+
+//------------------------------------------------------------------------------
+size_t entryOffset(size_t page, size_t entry)
+//------------------------------------------------------------------------------
+{
+  return pageOffset(page) + ENTRIES_OFFSET + entry * ENTRY_SIZE;
+}
+
+//------------------------------------------------------------------------------
+bool isVariable(uint8_t type)
+//------------------------------------------------------------------------------
+{
+  return type == ITEM_STR || type == ITEM_BLOB;
+}
+
+//------------------------------------------------------------------------------
+void charge(uint64_t us)
+//------------------------------------------------------------------------------
+{
+  stats_.flashTimeUs += us;
+  uncommittedUs_ += us;
+}
+
+//------------------------------------------------------------------------------
+void program(size_t offset, const void* data, size_t length)
+//------------------------------------------------------------------------------
+{
+  // NOR flash: programming can only clear bits
+  const uint8_t* p = (const uint8_t*)data;
+  bool illegal = false;
+  for (size_t i = 0; i < length; ++i) {
+    illegal |= (image_[offset + i] & p[i]) != p[i];
+    image_[offset + i] &= p[i];
+  }
+  if (illegal) {
+    ++stats_.illegalWrites;
+  }
+
+  stats_.bytesProgrammed += length;
+  ++stats_.programOps;
+  charge(NVS_EMULATOR_PROGRAM_OVERHEAD_US + (length * NVS_EMULATOR_PROGRAM_BYTE_NS) / 1000);
+}
+
+//------------------------------------------------------------------------------
+void erasePage(size_t page)
+//------------------------------------------------------------------------------
+{
+  memset(image_ + pageOffset(page), 0xff, NVS_EMULATOR_PAGE_SIZE);
+  ++wear_[page];
+  ++stats_.eraseOps;
+  charge(NVS_EMULATOR_ERASE_US);
+
+  pages_[page] = {PAGE_EMPTY, 0, 0, 0, 0};
+  if (active_ == (int)page) {
+    active_ = -1;
+  }
+}
+
+//------------------------------------------------------------------------------
+uint8_t entryState(size_t page, size_t entry)
+//------------------------------------------------------------------------------
+{
+  uint8_t b = image_[pageOffset(page) + BITMAP_OFFSET + entry / 4];
+  return (b >> ((entry % 4) * 2)) & 3;
+}
+
+//------------------------------------------------------------------------------
+void setEntryStates(size_t page, size_t first, size_t count, uint8_t state)
+//------------------------------------------------------------------------------
+{
+  // one program operation per touched bitmap byte
+  size_t entry = first;
+  while (entry < first + count) {
+    size_t offset = pageOffset(page) + BITMAP_OFFSET + entry / 4;
+    uint8_t b = image_[offset];
+    do {
+      uint8_t shift = (entry % 4) * 2;
+      b = (b & ~(3 << shift)) | (state << shift);
+      ++entry;
+    } while (entry < first + count && entry % 4 != 0);
+    program(offset, &b, 1);
+  }
+}
+
+//------------------------------------------------------------------------------
+Item_t readItem(size_t page, size_t entry)
+//------------------------------------------------------------------------------
+{
+  Item_t item;
+  memcpy(&item, image_ + entryOffset(page, entry), sizeof(item));
+  return item;
+}
+
+//------------------------------------------------------------------------------
+uint32_t itemCrc(const Item_t& item)
+//------------------------------------------------------------------------------
+{
+  // everything but the crc field itself
+  const uint8_t* p = (const uint8_t*)&item;
+  uint32_t crc = Crc32::compute(p, offsetof(Item_t, crc));
+  return Crc32::compute(p + offsetof(Item_t, key), sizeof(item) - offsetof(Item_t, key), crc);
+}
+
+//------------------------------------------------------------------------------
+uint32_t headerCrc(const PageHeader_t& header)
+//------------------------------------------------------------------------------
+{
+  return Crc32::compute(&header.seq, offsetof(PageHeader_t, crc) - offsetof(PageHeader_t, seq));
+}
+
+//------------------------------------------------------------------------------
+void activatePage(size_t page)
+//------------------------------------------------------------------------------
+{
+  PageHeader_t header;
+  memset(&header, 0xff, sizeof(header));
+  header.state = PAGE_ACTIVE;
+  header.seq = nextSeq_++;
+  header.version = PAGE_VERSION;
+  header.crc = headerCrc(header);
+  program(pageOffset(page), &header, sizeof(header));
+
+  pages_[page] = {PAGE_ACTIVE, header.seq, 0, 0, 0};
+  active_ = page;
+}
+
+//------------------------------------------------------------------------------
+void markPageFull(size_t page)
+//------------------------------------------------------------------------------
+{
+  uint32_t state = PAGE_FULL;
+  program(pageOffset(page), &state, sizeof(state));
+  pages_[page].state = PAGE_FULL;
+  if (active_ == (int)page) {
+    active_ = -1;
+  }
+}
+
+//------------------------------------------------------------------------------
+void eraseItem(const Location_t& location)
+//------------------------------------------------------------------------------
+{
+  setEntryStates(location.page, location.entry, location.span, ENTRY_ERASED);
+  pages_[location.page].used -= location.span;
+  pages_[location.page].erased += location.span;
+}
+
+//------------------------------------------------------------------------------
+int takeEmptyPage(bool spare)
+//------------------------------------------------------------------------------
+{
+  // one empty page is always kept back for the garbage collection,
+  // among the others the least worn one is used
+  int best = -1;
+  size_t empty = 0;
+  for (size_t p = 0; p < pageCount_; ++p) {
+    if (pages_[p].state == PAGE_EMPTY) {
+      ++empty;
+      if (best < 0 || wear_[p] < wear_[best]) {
+        best = p;
+      }
+    }
+  }
+  if (!spare && empty <= 1) {
+    return -1;
+  }
+  return best;
+}
+
+//------------------------------------------------------------------------------
+bool collectGarbage()
+//------------------------------------------------------------------------------
+{
+  // the full page with the most reclaimable entries, erased ones and unused ones at the end
+  int victim = -1;
+  size_t reclaimable = 0;
+  for (size_t p = 0; p < pageCount_; ++p) {
+    size_t r = pages_[p].erased + ENTRY_COUNT - pages_[p].next;
+    if (pages_[p].state == PAGE_FULL && r > reclaimable) {
+      victim = p;
+      reclaimable = r;
+    }
+  }
+  int spare = takeEmptyPage(true);
+  if (victim < 0 || spare < 0) {
+    return false;
+  }
+
+  if (active_ >= 0) {
+    markPageFull(active_);
+  }
+  activatePage(spare);
+
+  // move the live items, in page order
+  std::map<uint16_t, std::map<Key_t, Location_t>::iterator> live;
+  for (auto it = items_.begin(); it != items_.end(); ++it) {
+    if (it->second.page == victim) {
+      live[it->second.entry] = it;
+    }
+  }
+  Page_t& target = pages_[spare];
+  for (auto& l : live) {
+    Location_t& location = l.second->second;
+    program(entryOffset(spare, target.next), image_ + entryOffset(victim, location.entry), location.span * ENTRY_SIZE);
+    setEntryStates(spare, target.next, location.span, ENTRY_WRITTEN);
+    location.page = spare;
+    location.entry = target.next;
+    target.next += location.span;
+    target.used += location.span;
+  }
+
+  erasePage(victim);
+  ++stats_.gcRuns;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t reserve(size_t span)
+//------------------------------------------------------------------------------
+{
+  // every page is collected once at most, after that the space is just not there
+  size_t collected = 0;
+  while (true) {
+    if (active_ >= 0 && ENTRY_COUNT - pages_[active_].next >= span) {
+      return ESP_OK;
+    }
+    if (active_ >= 0) {
+      markPageFull(active_);
+    }
+    int page = takeEmptyPage(false);
+    if (page >= 0) {
+      activatePage(page);
+    } else if (collected++ >= pageCount_ || !collectGarbage()) {
+      return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+bool sameValue(const Location_t& location, const void* data, size_t length)
+//------------------------------------------------------------------------------
+{
+  Item_t item = readItem(location.page, location.entry);
+  if (isVariable(item.type)) {
+    return item.var.size == length && memcmp(image_ + entryOffset(location.page, location.entry + 1), data, length) == 0;
+  }
+  return memcmp(item.data, data, length) == 0;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t writeItem(uint8_t ns, uint8_t type, const char* key, const void* data, size_t length)
+//------------------------------------------------------------------------------
+{
+  Key_t k(ns, key);
+  auto it = items_.find(k);
+  if (it != items_.end()) {
+    if (it->second.type != type) {
+      return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    // like the IDF, unchanged values are not written again
+    if (sameValue(it->second, data, length)) {
+      return ESP_OK;
+    }
+  }
+
+  size_t span = 1;
+  if (isVariable(type)) {
+    if (length > MAX_VARIABLE_SIZE) {
+      return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    span += (length + ENTRY_SIZE - 1) / ENTRY_SIZE;
+  }
+
+  esp_err_t err = reserve(span);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  Item_t item;
+  memset(&item, 0xff, sizeof(item));
+  item.ns = ns;
+  item.type = type;
+  item.span = span;
+  memset(item.key, 0, sizeof(item.key));
+  strncpy(item.key, key, sizeof(item.key) - 1);
+  if (isVariable(type)) {
+    item.var.size = length;
+    item.var.crc = Crc32::compute(data, length);
+  } else {
+    memcpy(item.data, data, length);
+  }
+  item.crc = itemCrc(item);
+
+  Page_t& page = pages_[active_];
+  Location_t location = {(uint16_t)active_, page.next, (uint8_t)span, type};
+  program(entryOffset(active_, location.entry), &item, sizeof(item));
+  if (isVariable(type) && length) {
+    program(entryOffset(active_, location.entry + 1), data, length);
+  }
+  setEntryStates(active_, location.entry, span, ENTRY_WRITTEN);
+  page.next += span;
+  page.used += span;
+
+  // the old copy may have been moved by the garbage collection
+  it = items_.find(k);
+  if (it != items_.end()) {
+    eraseItem(it->second);
+  }
+  items_[k] = location;
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+void load()
+//------------------------------------------------------------------------------
+{
+  pages_.assign(pageCount_, {PAGE_EMPTY, 0, 0, 0, 0});
+  items_.clear();
+  active_ = -1;
+  nextSeq_ = 0;
+
+  std::map<uint32_t, size_t> bySeq;
+  for (size_t p = 0; p < pageCount_; ++p) {
+    PageHeader_t header;
+    memcpy(&header, image_ + pageOffset(p), sizeof(header));
+    if (header.state == PAGE_EMPTY) {
+      continue;
+    }
+    if ((header.state != PAGE_ACTIVE && header.state != PAGE_FULL) || header.version != PAGE_VERSION || header.crc != headerCrc(header)) {
+      LOG.w("Page %u corrupt, erasing", (unsigned)p);
+      erasePage(p);
+      continue;
+    }
+    pages_[p].state = header.state;
+    pages_[p].seq = header.seq;
+    bySeq[header.seq] = p;
+    nextSeq_ = max(nextSeq_, header.seq + 1);
+  }
+
+  for (auto& s : bySeq) {
+    size_t p = s.second;
+    Page_t& page = pages_[p];
+    size_t e = 0;
+    while (e < ENTRY_COUNT) {
+      uint8_t state = entryState(p, e);
+      if (state == ENTRY_EMPTY) {
+        break;
+      }
+      if (state != ENTRY_WRITTEN) {
+        ++page.erased;
+        ++e;
+        continue;
+      }
+
+      Item_t item = readItem(p, e);
+      bool valid = item.crc == itemCrc(item) && item.span >= 1 && e + item.span <= ENTRY_COUNT;
+      if (valid && isVariable(item.type)) {
+        valid = item.var.size <= (item.span - 1) * ENTRY_SIZE && item.var.crc == Crc32::compute(image_ + entryOffset(p, e + 1), item.var.size);
+      }
+      if (!valid) {
+        setEntryStates(p, e, 1, ENTRY_ERASED);
+        ++page.erased;
+        ++e;
+        continue;
+      }
+
+      // a newer copy wins, the older one was left by an interrupted update
+      Key_t k(item.ns, std::string(item.key, strnlen(item.key, sizeof(item.key))));
+      auto it = items_.find(k);
+      if (it != items_.end()) {
+        eraseItem(it->second);
+      }
+      items_[k] = {(uint16_t)p, (uint16_t)e, item.span, item.type};
+      page.used += item.span;
+      e += item.span;
+    }
+    page.next = e;
+
+    if (page.state == PAGE_ACTIVE) {
+      if (active_ >= 0) {
+        markPageFull(active_);
+      }
+      active_ = p;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+esp_err_t checkKey(const char* key)
+//------------------------------------------------------------------------------
+{
+  if (!key || !*key) {
+    return ESP_ERR_NVS_INVALID_NAME;
+  }
+  if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+    return ESP_ERR_NVS_KEY_TOO_LONG;
+  }
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t findHandle(nvs_handle handle, bool write, Handle_t** result)
+//------------------------------------------------------------------------------
+{
+  if (!initialized_) {
+    return ESP_ERR_NVS_NOT_INITIALIZED;
+  }
+  auto it = handles_.find(handle);
+  if (it == handles_.end()) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  if (write && it->second.readOnly) {
+    return ESP_ERR_NVS_READ_ONLY;
+  }
+  *result = &it->second;
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t set(nvs_handle handle, const char* key, uint8_t type, const void* data, size_t length)
+//------------------------------------------------------------------------------
+{
+  Handle_t* h;
+  esp_err_t err = findHandle(handle, true, &h);
+  if (err == ESP_OK) {
+    err = checkKey(key);
+  }
+  if (err == ESP_OK) {
+    err = writeItem(h->ns, type, key, data, length);
+  }
+  return err;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t get(nvs_handle handle, const char* key, uint8_t type, void* out, size_t* length)
+//------------------------------------------------------------------------------
+{
+  Handle_t* h;
+  esp_err_t err = findHandle(handle, false, &h);
+  if (err == ESP_OK) {
+    err = checkKey(key);
+  }
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  auto it = items_.find(Key_t(h->ns, key));
+  if (it == items_.end() || it->second.type != type) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  Item_t item = readItem(it->second.page, it->second.entry);
+  if (!isVariable(type)) {
+    memcpy(out, item.data, *length);
+    return ESP_OK;
+  }
+
+  if (out) {
+    if (*length < item.var.size) {
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, image_ + entryOffset(it->second.page, it->second.entry + 1), item.var.size);
+  }
+  *length = item.var.size;
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+esp_err_t getPrimitive(nvs_handle handle, const char* key, uint8_t type, T* out)
+//------------------------------------------------------------------------------
+{
+  size_t length = sizeof(T);
+  return get(handle, key, type, out, &length);
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+bool NvsEmulator::open(const char* path, size_t size)
+//------------------------------------------------------------------------------
+{
+  close();
+  if (size % NVS_EMULATOR_PAGE_SIZE || size < 2 * NVS_EMULATOR_PAGE_SIZE) {
+    LOG.e("Size must be a multiple of %u and at least two pages", NVS_EMULATOR_PAGE_SIZE);
+    return false;
+  }
+  pageCount_ = size / NVS_EMULATOR_PAGE_SIZE;
+
+  struct stat st;
+  fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0 || fstat(fd_, &st) != 0) {
+    LOG.e("Could not open image '%s'", path);
+    close();
+    return false;
+  }
+  bool fresh = (size_t)st.st_size != size;
+  if (fresh && ftruncate(fd_, size) != 0) {
+    LOG.e("Could not resize image '%s'", path);
+    close();
+    return false;
+  }
+
+  String wearPath = String(path) + ".wear";
+  wearFd_ = ::open(wearPath.c_str(), O_RDWR | O_CREAT, 0644);
+  if (wearFd_ < 0 || fstat(wearFd_, &st) != 0 || ftruncate(wearFd_, pageCount_ * sizeof(uint32_t)) != 0) {
+    LOG.e("Could not open wear file '%s'", wearPath.c_str());
+    close();
+    return false;
+  }
+
+  image_ = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  wear_ = (uint32_t*)mmap(NULL, pageCount_ * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED, wearFd_, 0);
+  if (image_ == MAP_FAILED || wear_ == MAP_FAILED) {
+    image_ = NULL;
+    wear_ = NULL;
+    LOG.e("Could not map image '%s'", path);
+    close();
+    return false;
+  }
+
+  if (fresh) {
+    // a new chip comes erased, that is not an erase cycle
+    memset(image_, 0xff, size);
+    memset(wear_, 0, pageCount_ * sizeof(uint32_t));
+  }
+  resetStats();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void NvsEmulator::close()
+//------------------------------------------------------------------------------
+{
+  if (image_) {
+    msync(image_, pageCount_ * NVS_EMULATOR_PAGE_SIZE, MS_SYNC);
+    munmap(image_, pageCount_ * NVS_EMULATOR_PAGE_SIZE);
+  }
+  if (wear_) {
+    msync(wear_, pageCount_ * sizeof(uint32_t), MS_SYNC);
+    munmap(wear_, pageCount_ * sizeof(uint32_t));
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  if (wearFd_ >= 0) {
+    ::close(wearFd_);
+  }
+  image_ = NULL;
+  wear_ = NULL;
+  fd_ = -1;
+  wearFd_ = -1;
+  initialized_ = false;
+  handles_.clear();
+  items_.clear();
+  pages_.clear();
+}
+
+//------------------------------------------------------------------------------
+bool NvsEmulator::isOpen()
+//------------------------------------------------------------------------------
+{
+  return image_ != NULL;
+}
+
+//------------------------------------------------------------------------------
+NvsEmulatorStats_t NvsEmulator::getStats()
+//------------------------------------------------------------------------------
+{
+  NvsEmulatorStats_t stats = stats_;
+  stats.pages = pageCount_;
+  stats.freePages = 0;
+  stats.usedEntries = 0;
+  stats.erasedEntries = 0;
+  stats.maxPageErases = 0;
+  for (size_t p = 0; p < pages_.size(); ++p) {
+    stats.freePages += pages_[p].state == PAGE_EMPTY ? 1 : 0;
+    stats.usedEntries += pages_[p].used;
+    stats.erasedEntries += pages_[p].erased;
+    stats.maxPageErases = max(stats.maxPageErases, wear_[p]);
+  }
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+void NvsEmulator::resetStats()
+//------------------------------------------------------------------------------
+{
+  memset(&stats_, 0, sizeof(stats_));
+  uncommittedUs_ = 0;
+}
+
+//------------------------------------------------------------------------------
+uint32_t NvsEmulator::getPageErases(size_t page)
+//------------------------------------------------------------------------------
+{
+  return wear_ && page < pageCount_ ? wear_[page] : 0;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_flash_init()
+//------------------------------------------------------------------------------
+{
+  if (!image_) {
+    const char* path = getenv("NVS_IMAGE");
+    if (!NvsEmulator::open(path ? path : "nvs.bin", 0x5000)) {
+      return ESP_ERR_NVS_PART_NOT_FOUND;
+    }
+  }
+  if (!initialized_) {
+    load();
+    initialized_ = true;
+  }
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_flash_deinit()
+//------------------------------------------------------------------------------
+{
+  if (!initialized_) {
+    return ESP_ERR_NVS_NOT_INITIALIZED;
+  }
+  initialized_ = false;
+  handles_.clear();
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_flash_erase()
+//------------------------------------------------------------------------------
+{
+  if (!image_) {
+    return ESP_ERR_NVS_PART_NOT_FOUND;
+  }
+  for (size_t p = 0; p < pageCount_; ++p) {
+    erasePage(p);
+  }
+  if (initialized_) {
+    load();
+  }
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle* out_handle)
+//------------------------------------------------------------------------------
+{
+  if (!initialized_) {
+    return ESP_ERR_NVS_NOT_INITIALIZED;
+  }
+  esp_err_t err = checkKey(name);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint8_t ns;
+  auto it = items_.find(Key_t(0, name));
+  if (it != items_.end()) {
+    ns = readItem(it->second.page, it->second.entry).data[0];
+  } else if (open_mode == NVS_READONLY) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  } else {
+    size_t count = 0;
+    for (auto& i : items_) {
+      count += i.first.first == 0 ? 1 : 0;
+    }
+    if (count >= 254) {
+      return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    ns = count + 1;
+    err = writeItem(0, ITEM_U8, name, &ns, sizeof(ns));
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+
+  handles_[nextHandle_] = {ns, open_mode == NVS_READONLY};
+  *out_handle = nextHandle_++;
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+void nvs_close(nvs_handle handle)
+//------------------------------------------------------------------------------
+{
+  handles_.erase(handle);
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_commit(nvs_handle handle)
+//------------------------------------------------------------------------------
+{
+  // like the IDF, values are on flash as soon as they are set; the commit
+  // closes the accounting period for the cost model
+  Handle_t* h;
+  esp_err_t err = findHandle(handle, true, &h);
+  if (err == ESP_OK) {
+    ++stats_.commits;
+    stats_.maxCommitUs = max(stats_.maxCommitUs, uncommittedUs_);
+    uncommittedUs_ = 0;
+  }
+  return err;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key)
+//------------------------------------------------------------------------------
+{
+  Handle_t* h;
+  esp_err_t err = findHandle(handle, true, &h);
+  if (err == ESP_OK) {
+    err = checkKey(key);
+  }
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  auto it = items_.find(Key_t(h->ns, key));
+  if (it == items_.end()) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  eraseItem(it->second);
+  items_.erase(it);
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t nvs_erase_all(nvs_handle handle)
+//------------------------------------------------------------------------------
+{
+  Handle_t* h;
+  esp_err_t err = findHandle(handle, true, &h);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  for (auto it = items_.begin(); it != items_.end();) {
+    if (it->first.first == h->ns) {
+      eraseItem(it->second);
+      it = items_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return ESP_OK;
+}
+
+// clang-format off
+esp_err_t nvs_set_i8(nvs_handle handle, const char* key, int8_t value) { return set(handle, key, ITEM_I8, &value, sizeof(value)); }
+esp_err_t nvs_set_u8(nvs_handle handle, const char* key, uint8_t value) { return set(handle, key, ITEM_U8, &value, sizeof(value)); }
+esp_err_t nvs_set_i16(nvs_handle handle, const char* key, int16_t value) { return set(handle, key, ITEM_I16, &value, sizeof(value)); }
+esp_err_t nvs_set_u16(nvs_handle handle, const char* key, uint16_t value) { return set(handle, key, ITEM_U16, &value, sizeof(value)); }
+esp_err_t nvs_set_i32(nvs_handle handle, const char* key, int32_t value) { return set(handle, key, ITEM_I32, &value, sizeof(value)); }
+esp_err_t nvs_set_u32(nvs_handle handle, const char* key, uint32_t value) { return set(handle, key, ITEM_U32, &value, sizeof(value)); }
+esp_err_t nvs_set_i64(nvs_handle handle, const char* key, int64_t value) { return set(handle, key, ITEM_I64, &value, sizeof(value)); }
+esp_err_t nvs_set_u64(nvs_handle handle, const char* key, uint64_t value) { return set(handle, key, ITEM_U64, &value, sizeof(value)); }
+esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value) { return set(handle, key, ITEM_STR, value, strlen(value) + 1); }
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length) { return set(handle, key, ITEM_BLOB, value, length); }
+
+esp_err_t nvs_get_i8(nvs_handle handle, const char* key, int8_t* out_value) { return getPrimitive(handle, key, ITEM_I8, out_value); }
+esp_err_t nvs_get_u8(nvs_handle handle, const char* key, uint8_t* out_value) { return getPrimitive(handle, key, ITEM_U8, out_value); }
+esp_err_t nvs_get_i16(nvs_handle handle, const char* key, int16_t* out_value) { return getPrimitive(handle, key, ITEM_I16, out_value); }
+esp_err_t nvs_get_u16(nvs_handle handle, const char* key, uint16_t* out_value) { return getPrimitive(handle, key, ITEM_U16, out_value); }
+esp_err_t nvs_get_i32(nvs_handle handle, const char* key, int32_t* out_value) { return getPrimitive(handle, key, ITEM_I32, out_value); }
+esp_err_t nvs_get_u32(nvs_handle handle, const char* key, uint32_t* out_value) { return getPrimitive(handle, key, ITEM_U32, out_value); }
+esp_err_t nvs_get_i64(nvs_handle handle, const char* key, int64_t* out_value) { return getPrimitive(handle, key, ITEM_I64, out_value); }
+esp_err_t nvs_get_u64(nvs_handle handle, const char* key, uint64_t* out_value) { return getPrimitive(handle, key, ITEM_U64, out_value); }
+esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length) { return get(handle, key, ITEM_STR, out_value, length); }
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length) { return get(handle, key, ITEM_BLOB, out_value, length); }
+// clang-format on
@@ -0,0 +1,72 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#define NVS_EMULATOR_PAGE_SIZE 4096
+
+// Flash timing used for the cost model, typical SPI NOR values
+// (page program 0.7 ms per 256 bytes, 4 KiB sector erase 45 ms, 100k erase cycles).
+#ifndef NVS_EMULATOR_PROGRAM_OVERHEAD_US
+#define NVS_EMULATOR_PROGRAM_OVERHEAD_US 20
+#endif
+#ifndef NVS_EMULATOR_PROGRAM_BYTE_NS
+#define NVS_EMULATOR_PROGRAM_BYTE_NS 2700
+#endif
+#ifndef NVS_EMULATOR_ERASE_US
+#define NVS_EMULATOR_ERASE_US 45000
+#endif
+#ifndef NVS_EMULATOR_ENDURANCE
+#define NVS_EMULATOR_ENDURANCE 100000
+#endif
+
+struct NvsEmulatorStats_t {
+  uint32_t pages;
+  uint32_t freePages;
+  uint32_t usedEntries;
+  uint32_t erasedEntries;
+  uint64_t bytesProgrammed;
+  uint64_t programOps;
+  uint64_t eraseOps;
+  uint64_t gcRuns;
+  uint64_t commits;
+  uint64_t flashTimeUs;    // modelled time spent in program and erase operations
+  uint64_t maxCommitUs;    // flash time between two commits, worst case
+  uint64_t illegalWrites;  // programs that would have to flip bits from 0 to 1
+  uint32_t maxPageErases;  // lifetime, from the wear file
+};
+
+// Host implementation of the ESP-IDF NVS API (see host/include/nvs.h).
+// The partition lives in a memory mapped image file with the layout of the IDF
+// implementation: 4 KiB pages with a header, a 2 bit per entry state bitmap and
+// 126 entries of 32 bytes, written log structured and garbage collected into a
+// spare page. Erase counters per page are kept in '<image>.wear', so wear adds
+// up across runs.
+// nvs_flash_init() opens $NVS_IMAGE (default 'nvs.bin', 20 KiB like the nvs
+// partition in partitions_custom.csv) unless open() was called before.
+class NvsEmulator {
+ public:
+  static bool open(const char* path, size_t size);
+  static void close();
+  static bool isOpen();
+
+  static NvsEmulatorStats_t getStats();
+  static void resetStats();
+  static uint32_t getPageErases(size_t page);
+};
@@ -0,0 +1,378 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// ntp-standin: minimal SNTP server on the host, to point a device or the simulation at.
+// sntp-sim: runs the real SntpClient/ClockDiscipline/Clock against stand-ins on localhost,
+// with a crystal error on the client and time running faster than real time. One stand-in
+// has a jittery asymmetric path, one can be a falseticker.
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include "host/commands.h"
+#include "net/sntp.h"
+#include "net/sntpserver.h"
+#include "statistic.h"
+#include "time/clock.h"
+#include "time/discipline.h"
+
+// simulation parameters, the monotonic source is a plain function pointer
+static double warp = 1;
+static double ppm = 0;
+static int64_t epoch = 0;
+static std::atomic<bool> stop(false);
+
+struct StandIn_t {
+  int socket;
+  int64_t offset;      // µs the served time is off
+  uint32_t latencyUs;  // random real µs the request path takes, 0 for none
+  uint32_t served;
+  bool silent;  // never answers
+};
+
+//------------------------------------------------------------------------------
+static int64_t realUtc()
+//------------------------------------------------------------------------------
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+//------------------------------------------------------------------------------
+static int64_t trueUtc()
+//------------------------------------------------------------------------------
+{
+  return epoch + (int64_t)(esp_timer_get_time() * warp);
+}
+
+//------------------------------------------------------------------------------
+static int64_t clientMonotonic()
+//------------------------------------------------------------------------------
+{
+  // the client crystal runs ppm too fast
+  return (int64_t)(esp_timer_get_time() * warp * (1.0 + ppm / 1000000.0));
+}
+
+//------------------------------------------------------------------------------
+static void writeTimestamp(uint8_t* p, int64_t utc)
+//------------------------------------------------------------------------------
+{
+  NtpTimestamp_t timestamp = SntpClient::fromMicros(utc);
+  uint32_t values[2] = {htonl(timestamp.seconds), htonl(timestamp.fraction)};
+  memcpy(p, values, sizeof(values));
+}
+
+//------------------------------------------------------------------------------
+static int openServer(uint16_t port)
+//------------------------------------------------------------------------------
+{
+  int s = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (s < 0 || bind(s, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    printf("could not bind UDP port %u\n", port);
+    return -1;
+  }
+  // wake up regularly to see the stop flag
+  struct timeval timeout = {0, 100000};
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return s;
+}
+
+//------------------------------------------------------------------------------
+static void serve(StandIn_t* standIn)
+//------------------------------------------------------------------------------
+{
+  uint8_t packet[48];
+  struct sockaddr_in from;
+  while (!stop) {
+    socklen_t fromLength = sizeof(from);
+    ssize_t n = recvfrom(standIn->socket, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLength);
+    if (n < 48 || (packet[0] & 0x07) != 3 || standIn->silent) {
+      continue;
+    }
+    if (standIn->latencyUs) {
+      // only on the way in, so it is asymmetric
+      usleep(random() % standIn->latencyUs);
+    }
+    int64_t received = trueUtc() + standIn->offset;
+    // origin = the client's transmit timestamp
+    memcpy(packet + 24, packet + 40, 8);
+    packet[0] = (4 << 3) | 4;  // no leap, version 4, server
+    packet[1] = 1;             // stratum
+    packet[2] = 6;             // poll
+    packet[3] = (uint8_t)-20;  // precision ~1µs
+    memset(packet + 4, 0, 8);  // root delay and dispersion
+    memcpy(packet + 12, "SIM ", 4);
+    writeTimestamp(packet + 16, received);
+    writeTimestamp(packet + 32, received);
+    writeTimestamp(packet + 40, trueUtc() + standIn->offset);
+    sendto(standIn->socket, packet, sizeof(packet), 0, (struct sockaddr*)&from, fromLength);
+    ++standIn->served;
+  }
+}
+
+//------------------------------------------------------------------------------
+int ntpStandin(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  uint16_t port = 12300;
+  StandIn_t standIn = {-1, 0, 0, 0, false};
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--port") == 0 && hasValue) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--offset-ms") == 0 && hasValue) {
+      standIn.offset = atoll(argv[++i]) * 1000;
+    } else {
+      printf(
+          "usage: ntp-standin [options]\n"
+          "  --port N         UDP port (default 12300)\n"
+          "  --offset-ms N    serve the system time shifted by N ms (default 0)\n");
+      return 1;
+    }
+  }
+
+  epoch = realUtc() - esp_timer_get_time();
+  standIn.socket = openServer(port);
+  if (standIn.socket < 0) {
+    return 1;
+  }
+  printf("serving SNTP on UDP %u\n", port);
+  serve(&standIn);
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+int sntpSim(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  uint16_t port = 12300;
+  double hours = 6;
+  int64_t initialOffset = 50000;
+  uint8_t servers = 3;
+  int64_t falseticker = 200000;
+  uint32_t latency = 100;
+  bool unset = false;
+  bool silent = false;
+  warp = 200;
+  ppm = 35;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--port") == 0 && hasValue) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--hours") == 0 && hasValue) {
+      hours = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--warp") == 0 && hasValue) {
+      warp = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--ppm") == 0 && hasValue) {
+      ppm = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--offset-ms") == 0 && hasValue) {
+      initialOffset = atoll(argv[++i]) * 1000;
+    } else if (strcmp(argv[i], "--servers") == 0 && hasValue) {
+      servers = max(1, min(SNTP_MAX_SERVERS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--falseticker-ms") == 0 && hasValue) {
+      falseticker = atoll(argv[++i]) * 1000;
+    } else if (strcmp(argv[i], "--latency-us") == 0 && hasValue) {
+      latency = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--unset") == 0) {
+      unset = true;
+    } else if (strcmp(argv[i], "--silent") == 0) {
+      silent = true;
+    } else {
+      printf(
+          "usage: sntp-sim [options]\n"
+          "  --hours H        simulated time (default 6)\n"
+          "  --warp N         simulated seconds per real second (default 200)\n"
+          "  --ppm N          rate error of the client crystal (default 35)\n"
+          "  --offset-ms N    initial client offset, below 128 it is slewed (default 50)\n"
+          "  --servers N      stand-ins on consecutive ports (default 3)\n"
+          "  --latency-us N   random asymmetric real latency of the second stand-in (default 100)\n"
+          "  --falseticker-ms N  time offset of the last stand-in, if there are 3 or more (default 200)\n"
+          "  --unset          start with the clock not set, as after power on\n"
+          "  --silent         one more stand-in that never answers, the first round waits for the timeout\n"
+          "  --port N         UDP port of the first stand-in (default 12300)\n");
+      return 1;
+    }
+  }
+
+  if (silent && servers >= SNTP_MAX_SERVERS) {
+    printf("--silent needs less than %u servers\n", SNTP_MAX_SERVERS);
+    return 1;
+  }
+
+  epoch = realUtc() - (int64_t)(esp_timer_get_time() * warp);
+
+  Clock clock(clientMonotonic);
+  ClockDiscipline discipline(clock);
+  SntpClient client(clock, discipline);
+
+  StandIn_t standIns[SNTP_MAX_SERVERS];
+  std::thread threads[SNTP_MAX_SERVERS];
+  uint8_t standInCount = servers + (silent ? 1 : 0);
+  for (uint8_t i = 0; i < standInCount; ++i) {
+    standIns[i].socket = openServer(port + i);
+    if (standIns[i].socket < 0) {
+      return 1;
+    }
+    standIns[i].offset = servers >= 3 && i == servers - 1 ? falseticker : 0;
+    standIns[i].latencyUs = i == 1 ? latency : 0;
+    standIns[i].served = 0;
+    standIns[i].silent = i == servers;
+    threads[i] = std::thread(serve, &standIns[i]);
+    client.addServer("127.0.0.1", port + i);
+  }
+
+  if (!unset) {
+    clock.set(trueUtc() - initialOffset);
+  }
+  client.begin();
+
+  printf("%8s %10s %10s %10s %8s %10s\n", "sim", "offset", "delay", "drift", "poll", "error");
+  int64_t start = trueUtc();
+  int64_t end = start + (int64_t)(hours * 3600 * 1000000);
+  uint32_t samples = 0;
+  int64_t maxError = 0;
+  int64_t maxErrorSettled = 0;
+  double sumSquares = 0;
+  uint32_t measurements = 0;
+  int64_t firstError = 0;
+  while (trueUtc() < end) {
+    client.loop();
+    if (!clock.isSet()) {
+      usleep(20);
+      continue;
+    }
+    if (!measurements) {
+      // right after the first step
+      firstError = clock.now() - trueUtc();
+    }
+    if (discipline.getSamples() != samples) {
+      samples = discipline.getSamples();
+      int64_t error = clock.now() - trueUtc();
+      printf("%7.2fh %8.3fms %8.3fms %7dppb %7us %8.3fms\n", (trueUtc() - start) / 3600e6, discipline.getLastOffset() / 1000.0,
+             discipline.getLastDelay() / 1000.0, (int)clock.getDriftPpb(), discipline.getPollInterval(), error / 1000.0);
+    }
+
+    // the error as it is displayed, also between the samples
+    int64_t error = std::abs(clock.now() - trueUtc());
+    maxError = max(maxError, error);
+    if (trueUtc() - start > 3600 * 1000000LL) {
+      maxErrorSettled = max(maxErrorSettled, error);
+    }
+    sumSquares += (double)error * error;
+    ++measurements;
+    usleep(20);
+  }
+
+  // the synced client serves time to the LAN, asked by a client without crystal error
+  Statistic statistic;
+  SntpServer lanServer(clock, client, statistic);
+  uint16_t lanPort = port + SNTP_MAX_SERVERS;
+  uint32_t lanRequests = 1000;
+  uint32_t lanAnswers = 0;
+  double lanSum = 0;
+  int64_t lanMax = 0;
+  int64_t processingMax = 0;
+  double processingSum = 0;
+  if (lanServer.begin(lanPort)) {
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = {0, 100000};
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(lanPort);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (uint32_t i = 0; i < lanRequests; ++i) {
+      uint8_t packet[48] = {(4 << 3) | 3};
+      int64_t t1 = trueUtc();
+      writeTimestamp(packet + 40, t1);
+      sendto(s, packet, sizeof(packet), 0, (struct sockaddr*)&address, sizeof(address));
+      if (recv(s, packet, sizeof(packet), 0) != sizeof(packet)) {
+        continue;
+      }
+      int64_t t4 = trueUtc();
+      ++lanAnswers;
+      NtpTimestamp_t t2 = {ntohl(*(uint32_t*)(packet + 32)), ntohl(*(uint32_t*)(packet + 36))};
+      NtpTimestamp_t t3 = {ntohl(*(uint32_t*)(packet + 40)), ntohl(*(uint32_t*)(packet + 44))};
+      int64_t received = SntpClient::toMicros(t2);
+      int64_t transmitted = SntpClient::toMicros(t3);
+      int64_t offset = ((received - t1) + (transmitted - t4)) / 2;
+      lanSum += offset;
+      lanMax = max(lanMax, (int64_t)std::abs(offset));
+      processingSum += transmitted - received;
+      processingMax = max(processingMax, transmitted - received);
+    }
+    close(s);
+    lanServer.end();
+  }
+  stop = true;
+  for (uint8_t i = 0; i < standInCount; ++i) {
+    threads[i].join();
+    close(standIns[i].socket);
+  }
+  client.end();
+
+  double simSeconds = hours * 3600;
+  if (unset) {
+    printf("\n%.1f simulated hours at %.0fx, crystal %+.1f ppm, clock not set initially\n", hours, warp, ppm);
+    printf("  first sync error   %.3f ms\n", firstError / 1000.0);
+  } else {
+    printf("\n%.1f simulated hours at %.0fx, crystal %+.1f ppm, initial offset %.1f ms\n", hours, warp, ppm, initialOffset / 1000.0);
+  }
+  printf("  polls              %u (%u spikes ignored)\n", client.getRounds(), discipline.getSpikes());
+  printf("  fixed 60s polling  %.0f requests\n", simSeconds / 60);
+  printf("  drift estimate     %d ppb (true %.0f ppb)\n", (int)clock.getDriftPpb(), -ppm * 1000 / (1 + ppm / 1000000));
+  printf("  final poll         %u s\n", discipline.getPollInterval());
+  printf("  error rms          %.3f ms\n", sqrt(sumSquares / measurements) / 1000.0);
+  printf("  error max          %.3f ms (after the first hour %.3f ms)\n", maxError / 1000.0, maxErrorSettled / 1000.0);
+  printf("  simulated time per real µs %.0f µs, scheduling latency shows up as error\n", warp);
+  printf("  LAN server         %u/%u answered (stratum %u), served offset mean %.3f ms, max %.3f ms\n", lanAnswers, lanRequests,
+         client.getStratum() + 1, lanSum / max(lanAnswers, 1u) / 1000.0, lanMax / 1000.0);
+  printf("                     receive to transmit %.1f µs mean, %.1f µs max (real time)\n",
+         processingSum / max(lanAnswers, 1u) / warp, processingMax / warp);
+
+  printf("\n  %-6s %10s %10s %10s %8s %6s %s\n", "server", "offset", "delay", "jitter", "answers", "reach", "");
+  for (uint8_t i = 0; i < standInCount; ++i) {
+    SntpServerStats_t stats = client.getServerStats(i);
+    const char* role = "";
+    if (standIns[i].silent) {
+      role = " (silent)";
+    } else if (standIns[i].offset) {
+      role = " (falseticker)";
+    } else if (standIns[i].latencyUs) {
+      role = " (asymmetric latency)";
+    }
+    printf("  %-6u %8.3fms %8.3fms %8.3fms %4u/%-3u %6o %s%s\n", port + i, stats.offset / 1000.0, stats.delay / 1000.0,
+           stats.jitter / 1000.0, stats.answers, stats.requests, stats.reach, stats.selected ? "selected" : "rejected", role);
+  }
+  return 0;
+}
@@ -0,0 +1,151 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// tick-sim: several clocks in one process, each with its own TickSync on the loopback interface and a
+// clock that is off by a few ms, as after an NTP sync. Compares the skew the clocks measure among each
+// other with the real one, and the skew of what they show before and after aligning.
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cmath>
+
+#include "host/commands.h"
+#include "net/ticksync.h"
+#include "time/clock.h"
+
+#define TICK_SIM_MAX_CLOCKS TICK_SYNC_MAX_PEERS
+
+//------------------------------------------------------------------------------
+int tickSim(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  uint8_t count = 4;
+  double seconds = 15;
+  double spreadMs = 5;
+  TickSyncMode_t mode = TICK_SYNC_ALIGN;
+  const char* group = TICK_SYNC_GROUP;
+  uint16_t port = TICK_SYNC_PORT;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--clocks") == 0 && hasValue) {
+      count = max(2, min(TICK_SIM_MAX_CLOCKS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--spread-ms") == 0 && hasValue) {
+      spreadMs = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--measure") == 0) {
+      mode = TICK_SYNC_MEASURE;
+    } else if (strcmp(argv[i], "--group") == 0 && hasValue) {
+      group = argv[++i];
+    } else if (strcmp(argv[i], "--port") == 0 && hasValue) {
+      port = atoi(argv[++i]);
+    } else {
+      printf(
+          "usage: tick-sim [options]\n"
+          "  --clocks N       clocks side by side (default 4)\n"
+          "  --seconds N      real seconds to run (default 15)\n"
+          "  --spread-ms N    clock errors are spread over +-N ms (default 5)\n"
+          "  --measure        only measure the skew, don't align\n"
+          "  --group ADDRESS  multicast group (default " TICK_SYNC_GROUP ")\n"
+          "  --port N         UDP port (default %u)\n",
+          TICK_SYNC_PORT);
+      return 1;
+    }
+  }
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int64_t utc = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+  Clock* clocks[TICK_SIM_MAX_CLOCKS];
+  TickSync* syncs[TICK_SIM_MAX_CLOCKS];
+  int64_t errors[TICK_SIM_MAX_CLOCKS];
+  for (uint8_t i = 0; i < count; ++i) {
+    // evenly over the spread, so the run is reproducible
+    errors[i] = (int64_t)(spreadMs * 1000 * (2.0 * i / (count - 1) - 1));
+    clocks[i] = new Clock();
+    clocks[i]->set(utc + errors[i]);
+    syncs[i] = new TickSync(*clocks[i]);
+    syncs[i]->setStratum(2);
+    if (!syncs[i]->begin(0x1000 + i, mode, group, port, inet_addr("127.0.0.1"))) {
+      printf("multicast on the loopback interface not possible\n");
+      return 1;
+    }
+  }
+
+  // what is shown: clock + render offset, against the first clock (the leader)
+  auto shown = [&](uint8_t i) { return clocks[i]->now() + syncs[i]->getRenderOffset(); };
+
+  printf("%4s", "s");
+  for (uint8_t i = 1; i < count; ++i) {
+    printf("  %08x real/measured", syncs[i]->getId());
+  }
+  printf("\n");
+
+  int64_t maxSkew = 0;
+  int64_t maxError = 0;
+  double sumSquares = 0;
+  uint32_t measurements = 0;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t second = 1; esp_timer_get_time() - start < seconds * 1000000; ++second) {
+    usleep(1000000);
+    TickPeer_t peers[TICK_SYNC_MAX_PEERS];
+    uint8_t peerCount = syncs[0]->getPeers(peers, TICK_SYNC_MAX_PEERS);
+    printf("%4u", second);
+    for (uint8_t i = 1; i < count; ++i) {
+      int64_t real = shown(i) - shown(0);
+      const TickPeer_t* peer = NULL;
+      for (uint8_t p = 0; p < peerCount; ++p) {
+        if (peers[p].id == syncs[i]->getId()) {
+          peer = &peers[p];
+        }
+      }
+      if (peer && peer->samples) {
+        printf("  %8.3f/%-8.3fms", real / 1000.0, peer->skew / 1000.0);
+        // after the first exchanges
+        if (second > 3) {
+          int64_t error = peer->skew - real;
+          maxSkew = max(maxSkew, (int64_t)std::abs(real));
+          maxError = max(maxError, (int64_t)std::abs(error));
+          sumSquares += (double)real * real;
+          ++measurements;
+        }
+      } else {
+        printf("  %8.3f/%-8sms", real / 1000.0, "-");
+      }
+    }
+    printf("\n");
+  }
+
+  for (uint8_t i = 0; i < count; ++i) {
+    syncs[i]->end();
+  }
+  printf("\n%u clocks, errors spread over +-%.1f ms, %s\n", count, spreadMs, mode == TICK_SYNC_ALIGN ? "aligned" : "measured only");
+  printf("  leader                %08x\n", syncs[0]->getLeader());
+  printf("  shown skew rms        %.3f ms, max %.3f ms (after 3 s)\n", measurements ? sqrt(sumSquares / measurements) / 1000.0 : 0.0,
+         maxSkew / 1000.0);
+  printf("  measurement error max %.3f ms\n", maxError / 1000.0);
+  for (uint8_t i = 0; i < count; ++i) {
+    delete syncs[i];
+    delete clocks[i];
+  }
+  return 0;
+}
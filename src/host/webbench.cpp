@@ -0,0 +1,514 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// web-bench: clients against the web stack, the pages and the REST API, on the host or on a device.
+// Without --host the real WebApi and WebAssets are served here by the HttpServer, with a loop that applies
+// the settings and publishes the events, like the device does. Reports per route requests/s and the
+// latency percentiles, and the free heap and its low-water mark from /api/status. On the host the heap
+// is HOST_HEAP_SIZE minus what was allocated with new (host/include/Esp.h).
+
+#include <Arduino.h>
+#include <Esp.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "display/framescheduler.h"
+#include "host/commands.h"
+#include "host/nvsemulator.h"
+#include "net/httpserver.h"
+#include "net/sntp.h"
+#include "net/ticksync.h"
+#include "net/webapi.h"
+#include "net/webassets.h"
+#include "statistic.h"
+#include "time/clock.h"
+#include "time/discipline.h"
+#include "time/posixtz.h"
+#include "time/tzdb.h"
+#include "util/json.h"
+#include "util/nvs.h"
+
+#define WEB_BENCH_PORT 18081
+#define WEB_BENCH_MAX_CLIENTS 64
+#define WEB_BENCH_MAX_STREAMS 8
+// <16 µs exact, above 16 buckets per power of two (6%), up to 2^32 µs
+#define WEB_BENCH_BUCKETS 464
+
+struct Route_t {
+  const char* name;
+  const char* method;
+  const char* path;
+};
+
+// the workload, a client sends them in turn. The PUT sends the settings read at the start, so a device
+// keeps its configuration.
+static const Route_t routes[] = {
+    {"/", "GET", "/"},
+    {"config", "GET", WEB_API_CONFIG},
+    {"config put", "PUT", WEB_API_CONFIG},
+    {"status", "GET", WEB_API_STATUS},
+};
+#define WEB_BENCH_ROUTES (sizeof(routes) / sizeof(routes[0]))
+
+struct RouteResult_t {
+  uint32_t ok;
+  uint32_t failed;
+  uint32_t buckets[WEB_BENCH_BUCKETS];
+};
+
+struct HeapStatus_t {
+  bool valid;
+  int64_t freeHeap;
+  int64_t minFreeHeap;
+};
+
+// static, so the clients allocate nothing while the host heap is measured
+static RouteResult_t results[WEB_BENCH_MAX_CLIENTS][WEB_BENCH_ROUTES];
+static std::atomic<uint32_t> events(0);
+static char settings[256];
+
+//------------------------------------------------------------------------------
+static uint16_t bucketOf(int64_t us)
+//------------------------------------------------------------------------------
+{
+  uint32_t value = (uint32_t)min(max(us, (int64_t)0), (int64_t)UINT32_MAX);
+  if (value < 16) {
+    return value;
+  }
+  uint8_t exponent = 31 - __builtin_clz(value);
+  return (exponent - 3) * 16 + ((value >> (exponent - 4)) & 15);
+}
+
+//------------------------------------------------------------------------------
+static uint32_t bucketStart(uint16_t bucket)
+//------------------------------------------------------------------------------
+{
+  if (bucket < 16) {
+    return bucket;
+  }
+  return (16u + bucket % 16) << (bucket / 16 - 1);
+}
+
+//------------------------------------------------------------------------------
+static uint32_t percentile(const RouteResult_t& result, double fraction)
+//------------------------------------------------------------------------------
+{
+  uint32_t rank = (uint32_t)ceil(result.ok * fraction);
+  uint32_t count = 0;
+  for (uint16_t i = 0; i < WEB_BENCH_BUCKETS; ++i) {
+    count += result.buckets[i];
+    if (count >= max(rank, 1u)) {
+      return bucketStart(i);
+    }
+  }
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+static int connectTo(const struct sockaddr_in& address)
+//------------------------------------------------------------------------------
+{
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  struct timeval timeout = {10, 0};
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (connect(s, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(s);
+    return -1;
+  }
+  return s;
+}
+
+//------------------------------------------------------------------------------
+static int readResponse(int s, char* input, size_t& length, size_t size, char* body = NULL, size_t bodySize = 0)
+//------------------------------------------------------------------------------
+{
+  // one response by its Content-Length, the status code or -1. What follows it stays in input.
+  while (true) {
+    input[length] = 0;
+    char* end = strstr(input, "\r\n\r\n");
+    if (end) {
+      const char* contentLength = strstr(input, "Content-Length: ");
+      size_t header = end + 4 - input;
+      size_t content = contentLength && contentLength < end ? strtoul(contentLength + 16, NULL, 10) : 0;
+      if (length >= header + content) {
+        int status = strncmp(input, "HTTP/1.", 7) == 0 ? atoi(input + 9) : -1;
+        if (body && bodySize) {
+          size_t n = min(content, bodySize - 1);
+          memcpy(body, input + header, n);
+          body[n] = 0;
+        }
+        length -= header + content;
+        memmove(input, input + header + content, length);
+        return status;
+      }
+    }
+    // the largest response, the index page, fits
+    if (length >= size - 1) {
+      return -1;
+    }
+    ssize_t n = recv(s, input + length, size - 1 - length, 0);
+    if (n <= 0) {
+      return -1;
+    }
+    length += n;
+  }
+}
+
+//------------------------------------------------------------------------------
+static int sendRequest(int s, const Route_t& route, bool close, char* text, size_t size)
+//------------------------------------------------------------------------------
+{
+  bool put = strcmp(route.method, "PUT") == 0;
+  int length = snprintf(text, size, "%s %s HTTP/1.1\r\nHost: clock\r\nAccept-Encoding: gzip\r\n%s", route.method, route.path,
+                        close ? "Connection: close\r\n" : "");
+  if (put) {
+    length += snprintf(text + length, size - length, "Content-Type: application/json\r\nContent-Length: %u\r\n\r\n%s",
+                       (unsigned)strlen(settings), settings);
+  } else {
+    length += snprintf(text + length, size - length, "\r\n");
+  }
+  return send(s, text, length, MSG_NOSIGNAL) == length ? length : -1;
+}
+
+//------------------------------------------------------------------------------
+static int get(const struct sockaddr_in& address, const char* path, char* body, size_t size)
+//------------------------------------------------------------------------------
+{
+  int s = connectTo(address);
+  if (s < 0) {
+    return -1;
+  }
+  Route_t route = {path, "GET", path};
+  char text[512];
+  char input[2048];
+  size_t length = 0;
+  int status = sendRequest(s, route, true, text, sizeof(text)) < 0 ? -1 : readResponse(s, input, length, sizeof(input), body, size);
+  close(s);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+static HeapStatus_t readHeap(const struct sockaddr_in& address)
+//------------------------------------------------------------------------------
+{
+  HeapStatus_t heap = {false, 0, 0};
+  char body[2048];
+  if (get(address, WEB_API_STATUS, body, sizeof(body)) != 200) {
+    return heap;
+  }
+  // the members of the top level object, the nested ones are passed over
+  JsonReader reader(body, strlen(body));
+  uint8_t found = 0;
+  for (JsonToken_t token = reader.next(); token != JSON_END && token != JSON_ERROR; token = reader.next()) {
+    if (token != JSON_NUMBER || reader.getDepth() != 1) {
+      continue;
+    }
+    if (strcmp(reader.getKey(), "freeHeap") == 0) {
+      heap.freeHeap = (int64_t)reader.getNumber();
+      ++found;
+    } else if (strcmp(reader.getKey(), "minFreeHeap") == 0) {
+      heap.minFreeHeap = (int64_t)reader.getNumber();
+      ++found;
+    }
+  }
+  heap.valid = found == 2;
+  return heap;
+}
+
+//------------------------------------------------------------------------------
+static void client(const struct sockaddr_in& address, uint8_t index, uint16_t keepAlive, std::atomic<bool>& stop)
+//------------------------------------------------------------------------------
+{
+  // connections of keepAlive requests, the routes in turn, the next one waits for the response
+  RouteResult_t* result = results[index];
+  uint8_t next = index % WEB_BENCH_ROUTES;
+  char text[512];
+  static thread_local char input[16384];
+  while (!stop) {
+    int s = connectTo(address);
+    if (s < 0) {
+      ++result[next].failed;
+      usleep(10000);
+      continue;
+    }
+    size_t length = 0;
+    for (uint16_t i = 0; i < keepAlive && !stop; ++i) {
+      const Route_t& route = routes[next];
+      int64_t start = esp_timer_get_time();
+      int status = sendRequest(s, route, i + 1 == keepAlive, text, sizeof(text)) < 0 ? -1 : readResponse(s, input, length, sizeof(input));
+      if (status != 200) {
+        ++result[next].failed;
+        break;
+      }
+      ++result[next].ok;
+      ++result[next].buckets[bucketOf(esp_timer_get_time() - start)];
+      next = (next + 1) % WEB_BENCH_ROUTES;
+    }
+    close(s);
+  }
+}
+
+//------------------------------------------------------------------------------
+static void listener(const struct sockaddr_in& address, std::atomic<bool>& stop)
+//------------------------------------------------------------------------------
+{
+  // a status page, counts the events it gets
+  int s = connectTo(address);
+  if (s < 0) {
+    return;
+  }
+  struct timeval timeout = {0, 200000};
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char text[512];
+  Route_t route = {"events", "GET", WEB_API_EVENTS};
+  sendRequest(s, route, false, text, sizeof(text));
+  char input[1024];
+  size_t length = 0;
+  while (!stop) {
+    ssize_t n = recv(s, input + length, sizeof(input) - 1 - length, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      break;
+    }
+    if (n < 0) {
+      continue;
+    }
+    length += n;
+    input[length] = 0;
+    // whole events only, the rest waits for more
+    char* p = input;
+    char* end;
+    while ((end = strstr(p, "\n\n"))) {
+      if (strncmp(p, "event: ", 7) == 0) {
+        ++events;
+      }
+      p = end + 2;
+    }
+    length -= p - input;
+    memmove(input, p, length);
+  }
+  close(s);
+}
+
+//------------------------------------------------------------------------------
+static void applyChange(Config& config, const ConfigChange_t& change)
+//------------------------------------------------------------------------------
+{
+  // the loop of the device in short, only the settings themselves
+  bool changed = false;
+  if (change.hasDeviceName && !config.getDeviceName().equals(change.deviceName)) {
+    config.setDeviceName(change.deviceName);
+    changed = true;
+  }
+  if (change.hasTimezone && !config.getTimezone().equals(change.timezone)) {
+    config.setTimezone(change.timezone);
+    changed = true;
+  }
+  if (change.hasNtpServer && config.isNtpServer() != change.ntpServer) {
+    config.setNtpServer(change.ntpServer);
+    changed = true;
+  }
+  if (change.hasTickSync && config.getTickSync() != change.tickSync) {
+    config.setTickSync(change.tickSync);
+    changed = true;
+  }
+  if (changed) {
+    config.save(true);
+  }
+}
+
+//------------------------------------------------------------------------------
+int webBench(int argc, char** argv)
+//------------------------------------------------------------------------------
+{
+  uint8_t clients = 4;
+  uint8_t streams = 1;
+  uint16_t keepAlive = 1;
+  double seconds = 5;
+  const char* host = NULL;
+  int port = -1;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--clients") == 0 && hasValue) {
+      clients = max(1, min(WEB_BENCH_MAX_CLIENTS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--streams") == 0 && hasValue) {
+      streams = max(0, min(WEB_BENCH_MAX_STREAMS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--keep-alive") == 0 && hasValue) {
+      keepAlive = max(1, min(HTTP_SERVER_KEEPALIVE_MAX_REQUESTS, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--host") == 0 && hasValue) {
+      host = argv[++i];
+    } else if (strcmp(argv[i], "--port") == 0 && hasValue) {
+      port = atoi(argv[++i]);
+    } else {
+      printf(
+          "usage: web-bench [options]\n"
+          "  --clients N     clients sending requests back to back, the routes in turn (default 4)\n"
+          "  --streams N     status pages listening to %s (default 1)\n"
+          "  --keep-alive N  requests per connection (default 1)\n"
+          "  --seconds N     real seconds to run (default 5)\n"
+          "  --host NAME     a device instead of the web stack served here, e.g. esp32clock.local\n"
+          "  --port N        TCP port (default %u here, 80 on a device)\n",
+          WEB_API_EVENTS, WEB_BENCH_PORT);
+      return 1;
+    }
+  }
+  if (port < 0) {
+    port = host ? 80 : WEB_BENCH_PORT;
+  }
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (host) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    struct addrinfo* info;
+    if (getaddrinfo(host, NULL, &hints, &info) != 0) {
+      printf("could not resolve %s\n", host);
+      return 1;
+    }
+    address.sin_addr = ((struct sockaddr_in*)info->ai_addr)->sin_addr;
+    freeaddrinfo(info);
+  }
+
+  // the web stack of the device, with what it reads from
+  NvsEmulator::open("web-bench.bin", 0x5000);
+  NVS nvs("storage");
+  Config config(nvs);
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  Clock clock;
+  clock.set((int64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+  ClockDiscipline discipline(clock);
+  SntpClient sntp(clock, discipline);
+  TickSync tickSync(clock);
+  FrameScheduler frames(clock);
+  Statistic statistics;
+  WebApi webApi(config, clock, sntp, discipline, tickSync, frames, statistics);
+  HttpServer server;
+  PosixTz timezone;
+  if (!host) {
+    if (!nvs.begin()) {
+      printf("could not open web-bench.bin\n");
+      return 1;
+    }
+    // the defaults without a record
+    config.load();
+    timezone.set(TzDb::lookup(config.getTimezone().c_str()) ? TzDb::lookup(config.getTimezone().c_str()) : "UTC0");
+    WebAssets::addRoutes(server);
+    webApi.addRoutes(server);
+    if (!server.begin(port)) {
+      return 1;
+    }
+    statistics.begin();
+    frames.begin();
+  }
+
+  // the settings to PUT back
+  if (get(address, WEB_API_CONFIG, settings, sizeof(settings)) != 200) {
+    printf("no %s on %s:%u\n", WEB_API_CONFIG, host ? host : "localhost", port);
+    return 1;
+  }
+  HeapStatus_t before = readHeap(address);
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  threads.reserve(clients + streams);
+  for (uint8_t i = 0; i < streams; ++i) {
+    threads.emplace_back(listener, std::cref(address), std::ref(stop));
+  }
+  for (uint8_t i = 0; i < clients; ++i) {
+    threads.emplace_back(client, std::cref(address), i, keepAlive, std::ref(stop));
+  }
+
+  // the loop of the device, or just waiting
+  int64_t end = esp_timer_get_time() + (int64_t)(seconds * 1000000);
+  while (esp_timer_get_time() < end) {
+    if (!host) {
+      nvs.loop();
+      statistics.loop();
+      ConfigChange_t change;
+      if (webApi.takeChange(change)) {
+        applyChange(config, change);
+      }
+      int64_t frameUtc;
+      frames.due(frameUtc);
+      webApi.publishEvents(&timezone);
+    }
+    usleep(500);
+  }
+  stop = true;
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  HeapStatus_t after = readHeap(address);
+
+  printf("%u clients, %u streams, %.1f s, %u requests per connection, %s\n", clients, streams, seconds, keepAlive,
+         host ? host : "served here");
+  printf("  %-12s %9s %8s %9s %9s %9s %9s %9s\n", "route", "ok", "failed", "req/s", "p50 ms", "p90 ms", "p99 ms", "max ms");
+  RouteResult_t all = {};
+  for (uint8_t r = 0; r < WEB_BENCH_ROUTES; ++r) {
+    RouteResult_t sum = {};
+    for (uint8_t i = 0; i < clients; ++i) {
+      sum.ok += results[i][r].ok;
+      sum.failed += results[i][r].failed;
+      for (uint16_t b = 0; b < WEB_BENCH_BUCKETS; ++b) {
+        sum.buckets[b] += results[i][r].buckets[b];
+      }
+    }
+    all.ok += sum.ok;
+    all.failed += sum.failed;
+    for (uint16_t b = 0; b < WEB_BENCH_BUCKETS; ++b) {
+      all.buckets[b] += sum.buckets[b];
+    }
+    printf("  %-12s %9u %8u %9.1f %9.3f %9.3f %9.3f %9.3f\n", routes[r].name, sum.ok, sum.failed, sum.ok / seconds,
+           percentile(sum, 0.5) / 1000.0, percentile(sum, 0.9) / 1000.0, percentile(sum, 0.99) / 1000.0, percentile(sum, 1) / 1000.0);
+  }
+  printf("  %-12s %9u %8u %9.1f %9.3f %9.3f %9.3f %9.3f\n", "all", all.ok, all.failed, all.ok / seconds, percentile(all, 0.5) / 1000.0,
+         percentile(all, 0.9) / 1000.0, percentile(all, 0.99) / 1000.0, percentile(all, 1) / 1000.0);
+  printf("  events       %u received by %u streams\n", (uint32_t)events, streams);
+  if (before.valid && after.valid) {
+    // on a device the low-water mark is since the boot
+    printf("  heap         %lld free before, %lld after, low-water mark %lld%s\n", (long long)before.freeHeap, (long long)after.freeHeap,
+           (long long)after.minFreeHeap, host ? " (since boot)" : "");
+  } else {
+    printf("  heap         not in %s\n", WEB_API_STATUS);
+  }
+  if (!host) {
+    printf("  server       %u requests, %u connections, %u reused, max %u concurrent, %u timeouts, %u evicted\n", server.getRequests(),
+           server.getConnections(), server.getReused(), server.getMaxConcurrent(), server.getTimeouts(), server.getEvicted());
+  }
+
+  frames.end();
+  server.end();
+  nvs.end();
+  NvsEmulator::close();
+  return 0;
+}
@@ -1,560 +1,1059 @@
-/*
- * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
- * Copyright (c) 2019 Lars Brandt.
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but
- * WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
- * General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program. If not, see <http://www.gnu.org/licenses/>.
- */
-
-/* #region  includes */
-#include <Arduino.h>
-#include <ESPmDNS.h>
-#include <Esp.h>
-#include <WebServer.h>
-#include <WiFi.h>
-
-#include <AutoConnect.h>
-#include <U8g2lib.h>
-#include <ezTime.h>
-
-#include "net/ota.h"
-#include "statistic.h"
-#include "util/logger.h"
-#include "util/nvs.h"
-#include "util/reset.h"
-#include "util/utils.h"
-#include "wifiutils.h"
-/* #endregion */
-
-/* #region  Variables */
-Logger LOG("MAIN");
-U8G2_SSD1306_128X64_NONAME_F_SW_I2C u8g2(U8G2_R0, 33, 32, /* reset=*/U8X8_PIN_NONE);
-Timezone myTimezone;
-OTA ota;
-Statistic statistics;
-WebServer webServer;
-AutoConnect autoConnect(webServer);
-NVS nvs("storage");
-Reset reset;
-
-String timezone = "Europe/Berlin";
-String currentIP;
-String id;
-EspClass esp;
-
-bool autoConnectionmode = false;
-bool connected = false;
-enum { STATE_BOOT = 0, STATE_BOOT_DONE, STATE_HAS_NTP_TIME, STATE_HAS_TIMEZONE, STATE_NO_TIMEZONE } state;
-/* #endregion */
-
-/* #region  Resources */
-extern const char configServerMenu[] asm("_binary_configserver_menu_json_start");
-/* #endregion */
-
-/* #region  Constants */
-#define AP_NAME "Esp32Clock"
-#define NVS_DEVICENAME "devicename"
-#define NVS_TIMEZONE "timezone"
-
-#define ROOT "/"
-#define AC_ROOT "/_ac"
-
-#define AC_DEVICE_SECTION "/device"
-#define AC_DEVICE_SECTION_SET "/device_set"
-#define AC_DEVICE_SECTION_DEVICENAME "devicename"
-
-#define AC_TIMEZONE_SECTION "/timezone"
-#define AC_TIMEZONE_SECTION_SET "/timezone_set"
-#define AC_TIMEZONE_SECTION_TIMEZONE "timezone"
-
-#define AC_FACTORYRESET_SECTION "/factory_reset"
-#define AC_FACTORYRESET_SECTION_SET "/factory_reset_set"
-#define AC_FACTORYRESET_SECTION_SURE "sure"
-/* #endregion */
-
-/* #region  Predeclarations */
-void setup();
-void loop();
-bool webserverGetParameter(const String& key, String& result);
-bool autoconfigSet(const String& section, const String& name, const String& value);
-void setMDNSName(const String name);
-void redirect(const String toLocation);
-const char* getWifiEventName(WiFiEvent_t e);
-const char* getWifiFailReason(uint8_t r);
-void showBootScreen();
-void showConnectScreen();
-void showAPStart();
-void showConnectionFailed(uint8_t reason);
-void showTime();
-void factoryReset();
-/* #endregion */
-
-/* #region setupDetails */
-// --------------------------------------------------------------------------------
-void setupDisplay()
-// --------------------------------------------------------------------------------
-{
-  u8g2.begin();
-}
-
-// --------------------------------------------------------------------------------
-void setupSerial()
-// --------------------------------------------------------------------------------
-{
-  // Serial
-  Serial.begin(115200);
-}
-
-// --------------------------------------------------------------------------------
-void setupNVS()
-// --------------------------------------------------------------------------------
-{
-  // NVS Storage
-  if (nvs.begin()) {
-    LOG.i("Storage initialized");
-  } else {
-    LOG.e("Storage not initialized");
-  }
-
-  //         ID / name
-  if (nvs.readString(NVS_DEVICENAME, id)) {
-    LOG.i("Got devicename from nvs.");
-  } else {
-    id = Utils::createId();
-    LOG.w("Could not read devicename from nvs. Using generated");
-  }
-  LOG.i("ID: '%s'", id.c_str());
-
-  //         Timezone
-  if (nvs.readString(NVS_TIMEZONE, timezone)) {
-    LOG.i("Got timezone from nvs.");
-  } else {
-    id = Utils::createId();
-    LOG.w("Could not read timezone from nvs. Using default");
-  }
-  LOG.i("TIMEZONE: '%s'", timezone.c_str());
-}
-
-// --------------------------------------------------------------------------------
-void setupDNS()
-// --------------------------------------------------------------------------------
-{
-  // DNS
-  setMDNSName(id);
-}
-
-// --------------------------------------------------------------------------------
-void setupWiFi()
-// --------------------------------------------------------------------------------
-{
-  // WiFI
-  WiFi.begin();
-
-  WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
-    LOG.i("WiFi event: %u -> %s", event, getWifiEventName(event));
-    switch (event) {
-      case SYSTEM_EVENT_STA_GOT_IP: {
-        LOG.i("WiFi connected");
-        currentIP = WiFi.localIP().toString();
-        LOG.i("IP is: %s", currentIP.c_str());
-        connected = true;
-      } break;
-
-      case SYSTEM_EVENT_STA_DISCONNECTED: {
-        showConnectionFailed(info.disconnected.reason);
-        LOG.i("WiFi disconnected, Reason: %u -> %s", info.disconnected.reason, getWifiFailReason(info.disconnected.reason));
-        currentIP = "<disconnected>";
-        connected = false;
-        if (info.disconnected.reason == 202) {
-          LOG.i("WiFi Bug, REBOOT/SLEEP!");
-          esp_sleep_enable_timer_wakeup(10);
-          esp_deep_sleep_start();
-          delay(100);
-        }
-      } break;
-
-      case SYSTEM_EVENT_AP_START: {
-        if(autoConnectionmode){
-          showAPStart();
-        }
-      } break;
-
-      case SYSTEM_EVENT_AP_STOP: {
-        if(autoConnectionmode){
-          showConnectScreen();
-        }
-      } break;
-
-      default:
-        break;
-    }
-  });
-}
-
-// --------------------------------------------------------------------------------
-void setupOTA()
-// --------------------------------------------------------------------------------
-{
-  // OTA
-  if (ota.begin()) {
-    LOG.i("OTA startetd");
-  } else {
-    LOG.e("OTA failed");
-  }
-  LOG.i("OTA4");
-}
-
-// --------------------------------------------------------------------------------
-void setupAutoconnectAndWebserver()
-// --------------------------------------------------------------------------------
-{
-  // Autoconnect + Webserver
-
-  //      Root
-  webServer.on("/", []() { redirect(AC_ROOT); });
-
-  //      Devicename
-  webServer.on(AC_FACTORYRESET_SECTION_SET, []() {
-    String sure = "false";
-    webserverGetParameter(AC_FACTORYRESET_SECTION_SURE, sure);
-    if (sure.equals("true")) {
-      LOG.w("Perform Factory Reset", sure.c_str());
-      reset.factoryReset();
-    }
-    redirect(AC_FACTORYRESET_SECTION);
-  });
-
-  //      Devicename
-  webServer.on(AC_DEVICE_SECTION_SET, []() {
-    String deviceName;
-    if (webserverGetParameter(AC_DEVICE_SECTION_DEVICENAME, deviceName)) {
-      autoconfigSet(AC_DEVICE_SECTION, AC_DEVICE_SECTION_DEVICENAME, deviceName);
-      id = deviceName;
-      setMDNSName(id);
-      if (!nvs.writeString(NVS_DEVICENAME, deviceName, true)) {
-        LOG.e("Could not write devicename to nvs");
-      }
-    }
-    redirect(AC_DEVICE_SECTION);
-  });
-
-  //      Timezone
-  webServer.on(AC_TIMEZONE_SECTION_SET, []() {
-    String tz;
-    if (webserverGetParameter(AC_TIMEZONE_SECTION_TIMEZONE, tz)) {
-      autoconfigSet(AC_TIMEZONE_SECTION, AC_TIMEZONE_SECTION_TIMEZONE, tz);
-      timezone = tz;
-      if (state == STATE_HAS_NTP_TIME || state == STATE_HAS_TIMEZONE || state == STATE_NO_TIMEZONE) {
-        state = STATE_HAS_NTP_TIME;
-      }
-      if (!nvs.writeString(NVS_TIMEZONE, timezone, true)) {
-        LOG.e("Could not write timezone to nvs");
-      }
-    }
-    redirect(AC_TIMEZONE_SECTION);
-  });
-
-  //        Load AC config
-  AutoConnectConfig autoConnectConfig;
-  autoConnectConfig.title = AP_NAME;
-  autoConnectConfig.apid = AP_NAME;
-  autoConnectConfig.hostName = id;
-  // autoConnectConfig.autoReconnect = true;
-  autoConnectConfig.autoReconnect = false;
-  autoConnect.config(autoConnectConfig);
-
-  if (autoConnect.load(configServerMenu)) {
-    LOG.i("AutoConnect loaded.");
-    autoConnectionmode = true;
-    if (autoConnect.begin()) {
-      LOG.i("AutoConnect started.");
-    } else {
-      LOG.e(" Autoconnect start failed.");
-    }
-    autoConnectionmode = false;
-  } else {
-    LOG.e("Autoconnect load failed.");
-  }
-  autoconfigSet(AC_DEVICE_SECTION, AC_DEVICE_SECTION_DEVICENAME, id);
-  autoconfigSet(AC_TIMEZONE_SECTION, AC_TIMEZONE_SECTION_TIMEZONE, timezone);
-}
-
-// --------------------------------------------------------------------------------
-void setupEzTime()
-// --------------------------------------------------------------------------------
-{
-  // ezTime
-  // setDebug(DEBUG);
-  setInterval(60);
-}
-
-// --------------------------------------------------------------------------------
-void setupStatistics()
-// --------------------------------------------------------------------------------
-{
-  // Statistics
-  if (statistics.begin()) {
-    LOG.i("Statistics start");
-  } else {
-    LOG.e("Statistics start failed");
-  }
-}
-/* #endregion */
-
-/* #region  Main stuff */
-// --------------------------------------------------------------------------------
-void setup()
-// --------------------------------------------------------------------------------
-{
-  state = STATE_BOOT;
-
-  setupDisplay();
-  setupSerial();
-
-  showBootScreen();
-
-  delay(1500);
-
-  // Boot msg
-  LOG.i("+-----------------------+");
-  LOG.i("|        Booting        |");
-  LOG.i("+-----------------------+");
-  LOG.i("+ CPU frequency: %uMHz", esp.getCpuFreqMHz());
-  LOG.i("+ Flash size: %u", esp.getFlashChipSize());
-  LOG.i("+ SDK: %s", esp.getSdkVersion());
-  LOG.i("+ CPU0 reset reason: %s -> %s ", reset.getResetReason0(), reset.getResetReasonVerbose0());
-  LOG.i("+ CPU1 reset reason: %s -> %s ", reset.getResetReason1(), reset.getResetReasonVerbose1());
-  LOG.i("+-----------------------+");
-
-  setupNVS();
-  setupDNS();
-  setupWiFi();
-  setupOTA();
-  setupAutoconnectAndWebserver();
-  setupEzTime();
-  setupStatistics();
-
-  state = STATE_BOOT_DONE;
-}
-
-uint64_t nextEvent = 0;
-// --------------------------------------------------------------------------------
-void loop()
-// --------------------------------------------------------------------------------
-{
-  ota.loop();
-  statistics.loop();
-  if (!ota.isUpdating()) {
-    switch (state) {
-      case STATE_BOOT_DONE:
-        if (lastNtpUpdateTime()) {
-          state = STATE_HAS_NTP_TIME;
-        }
-        break;
-      case STATE_HAS_NTP_TIME:
-        // https://en.wikipedia.org/wiki/List_of_tz_database_time_zones
-        if (myTimezone.setLocation(timezone)) {
-          LOG.i("Timezone set to ", myTimezone.getTimezoneName());
-          state = STATE_HAS_TIMEZONE;
-        } else {
-          LOG.e("Timezone set failed, %s", errorString());
-          state = STATE_NO_TIMEZONE;
-        }
-        break;
-      case STATE_BOOT:
-      case STATE_HAS_TIMEZONE:
-      case STATE_NO_TIMEZONE:
-        break;
-    }
-
-    events();
-
-    autoConnect.handleClient();
-
-    uint64_t now = millis();
-    if (now > nextEvent) {
-      nextEvent = now + 250;
-      showTime();
-    }
-  }
-}
-/* #endregion */
-
-/* #region  autocofig/webserver utils */
-// --------------------------------------------------------------------------------
-bool webserverGetParameter(const String& key, String& result)
-// --------------------------------------------------------------------------------
-{
-  if (webServer.hasArg(key)) {
-    result = webServer.arg(key);
-    return true;
-  } else {
-    LOG.e("[ConfigServer] Error: arg '%s' not found in parameters", key.c_str());
-  }
-  return false;
-}
-
-// --------------------------------------------------------------------------------
-bool autoconfigSet(const String& section, const String& name, const String& value)
-// --------------------------------------------------------------------------------
-{
-  AutoConnectAux* device = autoConnect.aux(section);
-  if (device) {
-    AutoConnectInput& deviceNameInput = device->getElement<AutoConnectInput>(name);
-    if (&deviceNameInput) {
-      deviceNameInput.value = value;
-      return true;
-    } else {
-      LOG.e("[ConfigServer] Error: could not found %s section in configuration", section.c_str());
-    }
-  } else {
-    LOG.e("[ConfigServer] Error: could not found %s section in configuration", section.c_str());
-  }
-  return false;
-}
-
-// --------------------------------------------------------------------------------
-void redirect(const String toLocation)
-// --------------------------------------------------------------------------------
-{
-  webServer.sendHeader("Location", toLocation, true);
-  webServer.send(302, "text/plain", "");  // Empty content inhibits Content-length header so we have to close the socket ourselves.
-  webServer.client().stop();
-}
-/* #endregion */
-
-/* #region  dns stuff */
-// --------------------------------------------------------------------------------
-void setMDNSName(const String name)
-// --------------------------------------------------------------------------------
-{
-  MDNS.end();
-  if (MDNS.begin(name.c_str())) {
-    LOG.i("mDNS start name: %s", id.c_str());
-  } else {
-    LOG.e("mDNS failed");
-  }
-}
-/* #endregion */
-
-/* #region  display stuff */
-// --------------------------------------------------------------------------------
-void showBootScreen()
-// --------------------------------------------------------------------------------
-{
-  u8g2.clearBuffer();
-  u8g2.setFont(u8g2_font_ncenB10_tr);
-  u8g2.drawStr(0, 20, "Booting...");
-  u8g2.sendBuffer();
-}
-
-// --------------------------------------------------------------------------------
-void showConnectScreen()
-// --------------------------------------------------------------------------------
-{
-  u8g2.clearBuffer();
-  u8g2.setFont(u8g2_font_ncenB10_tr);
-  u8g2.drawStr(0, 20, "Connect");
-  u8g2.drawStr(0, 40, "to WiFi...");
-  u8g2.drawStr(0, 60, WiFi.SSID().c_str());
-  u8g2.sendBuffer();
-}
-
-// --------------------------------------------------------------------------------
-void showConnectionFailed(uint8_t reason)
-// --------------------------------------------------------------------------------
-{
-  u8g2.clearBuffer();
-  u8g2.setFont(u8g2_font_ncenB10_tr);
-  u8g2.drawStr(0, 20, "WiFi failed");
-  u8g2.drawStr(0, 40, "reason:");
-  u8g2.drawStr(0, 60, getWifiFailReason(reason));
-  u8g2.sendBuffer();
-}
-
-// --------------------------------------------------------------------------------
-void showAPStart()
-// --------------------------------------------------------------------------------
-{
-  u8g2.clearBuffer();
-  u8g2.setFont(u8g2_font_ncenB08_tr);
-  u8g2.drawStr(0, 20, "Access point mode");
-  u8g2.drawStr(0, 40, (String("SSID: ") + AP_NAME).c_str());
-  u8g2.drawStr(0, 60, "PSK:  12345678");
-  u8g2.sendBuffer();
-}
-
-// --------------------------------------------------------------------------------
-void showTime()
-// --------------------------------------------------------------------------------
-{
-  char temp[3];
-  uint8_t w;
-
-  // hour + min
-  char t[6];
-  strcpy(temp, u8x8_u8toa(myTimezone.hour(), 2));
-  t[0] = temp[0];
-  t[1] = temp[1];
-  t[2] = ':';
-  strcpy(temp, u8x8_u8toa(myTimezone.minute(), 2));
-  t[3] = temp[0];
-  t[4] = temp[1];
-  t[5] = 0;
-
-  // second
-  char sec[3];
-  strcpy(sec, u8x8_u8toa(myTimezone.second(), 2));
-  uint8_t s = (128 * ((float)myTimezone.second() + ((float)myTimezone.ms()) / 1000.0)) / 59;
-
-  // date
-  // works only from 2000...2099
-  char d[11];
-  strcpy(temp, u8x8_u8toa(myTimezone.day(), 2));
-  d[0] = temp[0];
-  d[1] = temp[1];
-  d[2] = '.';
-  strcpy(temp, u8x8_u8toa(myTimezone.month(), 2));
-  d[3] = temp[0];
-  d[4] = temp[1];
-  d[5] = '.';
-  d[6] = '2';
-  d[7] = '0';
-  strcpy(temp, u8x8_u8toa(myTimezone.year() - 2000, 2));
-  d[8] = temp[0];
-  d[9] = temp[1];
-  d[10] = 0;
-
-  // print
-  u8g2.clearBuffer();
-  u8g2.setDrawColor(1);
-
-  // time
-  u8g2.drawHLine(s - 5, 0, 10);
-  u8g2.drawHLine(s - 5, 1, 10);
-  u8g2.setFont(u8g2_font_freedoomr25_mn);
-  w = u8g2.getStrWidth(t);
-  u8g2.drawStr((128 - w) / 2, 32, t);
-
-  // date
-  u8g2.setFont(u8g2_font_t0_16_tn);
-  w = u8g2.getStrWidth(d);
-  u8g2.drawStr((128 - w) / 2, 46, d);
-
-  // ip
-  u8g2.setFont(u8g2_font_profont10_tf);
-  w = u8g2.getStrWidth(currentIP.c_str());
-  u8g2.drawStr(128 - w, 63, currentIP.c_str());
-
-  u8g2.sendBuffer();
-}
-/* #endregion */
+/*
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* #region  includes */
+#include <Arduino.h>
+#include <Esp.h>
+#include <WebServer.h>
+#include <WiFi.h>
+
+#include <AutoConnect.h>
+#include <U8g2lib.h>
+#include <esp_pthread.h>
+#include <ezTime.h>
+
+#include <atomic>
+#include <thread>
+
+#include "config.h"
+#include "display/clockface.h"
+#include "display/framescheduler.h"
+#include "net/discovery.h"
+#include "net/fastconnect.h"
+#include "net/httpserver.h"
+#include "net/sntp.h"
+#include "net/sntpserver.h"
+#include "net/webassets.h"
+#include "net/webapi.h"
+#include "net/ticksync.h"
+#include "net/ota.h"
+#include "statistic.h"
+#include "time/clock.h"
+#include "time/discipline.h"
+#include "time/posixtz.h"
+#include "time/rtcclock.h"
+#include "time/tzdb.h"
+#include "util/boottimeline.h"
+#include "util/json.h"
+#include "util/logger.h"
+#include "util/nvs.h"
+#include "util/reset.h"
+#include "util/utils.h"
+#include "wifiutils.h"
+/* #endregion */
+
+/* #region  Variables */
+Logger LOG("MAIN");
+U8G2_SSD1306_128X64_NONAME_F_SW_I2C u8g2(U8G2_R0, 33, 32, /* reset=*/U8X8_PIN_NONE);
+PosixTz localTimezone;
+ClockFace clockFace(localTimezone);
+OTA ota;
+Statistic statistics;
+// the AutoConnect pages. Port 80 is the HttpServer's, it redirects what it doesn't know to here
+#define AC_PORT 8080
+WebServer webServer(AC_PORT);
+AutoConnect autoConnect(webServer);
+NVS nvs("storage");
+Config config(nvs);
+FastConnect fastConnect(nvs);
+Reset reset;
+BootTimeline bootTimeline;
+Clock utcClock;
+RtcClock rtcClock(utcClock);
+ClockDiscipline discipline(utcClock);
+SntpClient sntp(utcClock, discipline);
+FrameScheduler frameScheduler(utcClock);
+SntpServer sntpServer(utcClock, sntp, statistics);
+TickSync tickSync(utcClock);
+HttpServer httpServer;
+Discovery discovery;
+WebApi webApi(config, utcClock, sntp, discipline, tickSync, frameScheduler, statistics);
+
+String timezone;
+String currentIP;
+String id;
+EspClass esp;
+
+bool autoConnectionmode = false;
+// the AutoConnect access point is up, set from the WiFi events
+std::atomic<bool> portalActive(false);
+bool connected = false;
+bool displayReady = false;
+bool clockRestored = false;
+// something else was drawn or the IP changed, the next frame is drawn completely
+std::atomic<bool> redrawFace(true);
+
+enum { STATE_BOOT = 0, STATE_BOOT_DONE, STATE_HAS_NTP_TIME, STATE_HAS_TIMEZONE, STATE_NO_TIMEZONE } state;
+/* #endregion */
+
+/* #region  Resources */
+// the AutoConnect pages, generated from configserver_menu.json by tools/configmenu.py
+#include "configmenu_data.h"
+/* #endregion */
+
+/* #region  Constants */
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "1.1.0"
+#endif
+#define AP_NAME "Esp32Clock"
+#define AP_PSK "12345678"
+// AutoConnect is started from the loop. Without WiFi after this long it opens the portal right away, the
+// directed connect and the scan of FastConnect fit in.
+#define AC_PORTAL_DELAY_MS 10000
+// an open portal closes this long after the WiFi connected, the phone still gets the result page
+#define AC_PORTAL_CLOSE_MS 60000
+// queried in parallel, the pool hands out different servers for each name
+#define NTP_SERVER_0 "0.pool.ntp.org"
+#define NTP_SERVER_1 "1.pool.ntp.org"
+#define NTP_SERVER_2 "2.pool.ntp.org"
+
+#define ROOT "/"
+#define AC_ROOT "/_ac"
+
+#define AC_DEVICE_SECTION "/device"
+#define AC_DEVICE_SECTION_SET "/device_set"
+#define AC_DEVICE_SECTION_DEVICENAME "devicename"
+
+#define AC_TIMEZONE_SECTION "/timezone"
+#define AC_TIMEZONE_SECTION_SET "/timezone_set"
+#define AC_TIMEZONE_SECTION_TIMEZONE "timezone"
+
+#define AC_NTPSERVER_SECTION "/ntp_server"
+#define AC_NTPSERVER_SECTION_SET "/ntp_server_set"
+#define AC_NTPSERVER_SECTION_ENABLED "enabled"
+
+#define AC_TICKSYNC_SECTION "/tick_sync"
+#define AC_TICKSYNC_SECTION_SET "/tick_sync_set"
+#define AC_TICKSYNC_SECTION_MODE "mode"
+// the radio values in configserver_menu.json, by TickSyncMode_t
+const char* tickSyncModes[] = {"Off", "Align seconds with clocks nearby", "Measure skew only"};
+
+#define AC_FACTORYRESET_SECTION "/factory_reset"
+#define AC_FACTORYRESET_SECTION_SET "/factory_reset_set"
+#define AC_FACTORYRESET_SECTION_SURE "sure"
+
+#define BOOT_TIMELINE "/boot"
+/* #endregion */
+
+/* #region  Predeclarations */
+void setup();
+void loop();
+bool webserverGetParameter(const String& key, String& result);
+void redirectToPortal(HttpRequest& request, HttpResponse& response);
+void applyDeviceName(const String& deviceName);
+void applyTimezone(const String& tz);
+void applyNtpServer(bool ntpServer);
+void applyTickSync(uint8_t mode);
+void applyConfigChange();
+void saveConfig();
+bool autoconfigSet(const String& section, const String& name, const String& value);
+bool autoconfigCheck(const String& section, const String& name, bool checked);
+bool autoconfigRadio(const String& section, const String& name, uint8_t index);
+void redirect(const String toLocation);
+const char* getWifiEventName(WiFiEvent_t e);
+const char* getWifiFailReason(uint8_t r);
+void showBootScreen();
+void showConnectScreen();
+void showAPStart();
+void showConnectionFailed(uint8_t reason);
+void showTime(int64_t frameUtc);
+void factoryReset();
+void onNtpSync();
+bool resolveTimezone(bool online = true);
+void startTickSync();
+void startAutoConnect();
+void closePortal();
+/* #endregion */
+
+/* #region setupDetails */
+// --------------------------------------------------------------------------------
+void setupDisplay()
+// --------------------------------------------------------------------------------
+{
+  u8g2.begin();
+  // frames at the edges of the NTP disciplined second
+  if (!frameScheduler.begin(FRAME_RATE)) {
+    LOG.e("Frame scheduler start failed");
+  }
+}
+
+// --------------------------------------------------------------------------------
+void setupSerial()
+// --------------------------------------------------------------------------------
+{
+  // Serial
+  Serial.begin(115200);
+}
+
+// --------------------------------------------------------------------------------
+void setupNVS()
+// --------------------------------------------------------------------------------
+{
+  // NVS Storage
+  if (nvs.begin()) {
+    LOG.i("Storage initialized");
+    // commits happen in the background from now on, the web handlers never wait for the flash
+    nvs.beginAsync();
+  } else {
+    LOG.e("Storage not initialized");
+  }
+}
+
+// --------------------------------------------------------------------------------
+void setupConfig()
+// --------------------------------------------------------------------------------
+{
+  //         Config, one record with all settings
+  if (config.load()) {
+    LOG.i("Got config from nvs.");
+  } else {
+    LOG.w("Could not read config from nvs. Using defaults");
+  }
+  id = config.getDeviceName();
+  timezone = config.getTimezone();
+  LOG.i("ID: '%s'", id.c_str());
+  LOG.i("TIMEZONE: '%s'", timezone.c_str());
+}
+
+// --------------------------------------------------------------------------------
+void setupClock()
+// --------------------------------------------------------------------------------
+{
+  // time and timezone survive resets and deep sleep, NTP only refines them
+  char tzRule[TZ_RULE_SIZE];
+  if (rtcClock.restore(tzRule, sizeof(tzRule)) && tzRule[0]) {
+    if (localTimezone.set(tzRule)) {
+      clockRestored = true;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------------
+void setupDNS()
+// --------------------------------------------------------------------------------
+{
+  // mDNS, the services are announced once WiFi is up
+  discovery.begin(id.c_str(), FIRMWARE_VERSION, timezone.c_str());
+}
+
+// --------------------------------------------------------------------------------
+void setupWiFi()
+// --------------------------------------------------------------------------------
+{
+  // WiFI
+  WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+    // AP flaps produce event storms, keep them from flooding the UART
+    static LogLimit eventLimit(10, 1000);
+    static LogLimit disconnectLimit(3, 5000);
+
+    LOG.i(eventLimit, "WiFi event: %u -> %s", event, getWifiEventName(event));
+    switch (event) {
+      case SYSTEM_EVENT_STA_GOT_IP: {
+        LOG.i("WiFi connected");
+        currentIP = WiFi.localIP().toString();
+        redrawFace = true;
+        LOG.i("IP is: %s", currentIP.c_str());
+        connected = true;
+        bootTimeline.mark("wifi_connected");
+        fastConnect.onConnected();
+      } break;
+
+      case SYSTEM_EVENT_STA_DISCONNECTED: {
+        if (displayReady) {
+          showConnectionFailed(info.disconnected.reason);
+        }
+        LOG.i(disconnectLimit, "WiFi disconnected, Reason: %u -> %s", info.disconnected.reason, getWifiFailReason(info.disconnected.reason));
+        currentIP = "<disconnected>";
+        redrawFace = true;
+        connected = false;
+        fastConnect.onDisconnected(info.disconnected.reason);
+        if (info.disconnected.reason == 202) {
+          LOG.i("WiFi Bug, REBOOT/SLEEP!");
+          nvs.commit();
+          esp_sleep_enable_timer_wakeup(10);
+          esp_deep_sleep_start();
+          delay(100);
+        }
+      } break;
+
+      case SYSTEM_EVENT_AP_START: {
+        portalActive = true;
+        redrawFace = true;
+        if(autoConnectionmode){
+          showAPStart();
+        }
+      } break;
+
+      case SYSTEM_EVENT_AP_STOP: {
+        portalActive = false;
+        redrawFace = true;
+        if(autoConnectionmode){
+          showConnectScreen();
+        }
+      } break;
+
+      default:
+        break;
+    }
+  });
+
+  // register the handler first, a fast reconnect may report before we are back
+  fastConnect.begin();
+}
+
+// --------------------------------------------------------------------------------
+void setupOTA()
+// --------------------------------------------------------------------------------
+{
+  // OTA
+  ota.onStart([]() { nvs.commit(); });
+  if (ota.begin()) {
+    LOG.i("OTA startetd");
+  } else {
+    LOG.e("OTA failed");
+  }
+  LOG.i("OTA4");
+}
+
+// --------------------------------------------------------------------------------
+void setupHttpServer()
+// --------------------------------------------------------------------------------
+{
+  // runs in its own task, the handlers must not block and only use thread safe state
+
+  //      Pages, gzip compressed in flash
+  WebAssets::addRoutes(httpServer);
+
+  //      REST API
+  webApi.addRoutes(httpServer);
+  webApi.onStatus([](JsonWriter& json) { json.boolean("portal", portalActive); });
+
+  //      Everything else to the AutoConnect pages, the captive portal checks of the phones too
+  httpServer.onNotFound(redirectToPortal);
+
+  //      Boot timeline
+  httpServer.on(BOOT_TIMELINE, HTTP_METHOD_GET, [](HttpRequest& request, HttpResponse& response) {
+    response.setContentType("application/json");
+    response.print(bootTimeline.toJson());
+  });
+
+  if (!httpServer.begin()) {
+    LOG.e("HTTP server start failed");
+  }
+}
+
+// --------------------------------------------------------------------------------
+void setupAutoconnectAndWebserver()
+// --------------------------------------------------------------------------------
+{
+  // Autoconnect + Webserver
+
+  //      Root
+  webServer.on("/", []() { redirect(AC_ROOT); });
+
+  //      Devicename
+  webServer.on(AC_FACTORYRESET_SECTION_SET, []() {
+    String sure = "false";
+    webserverGetParameter(AC_FACTORYRESET_SECTION_SURE, sure);
+    if (sure.equals("true")) {
+      LOG.w("Perform Factory Reset", sure.c_str());
+      reset.factoryReset();
+    }
+    redirect(AC_FACTORYRESET_SECTION);
+  });
+
+  //      Devicename
+  webServer.on(AC_DEVICE_SECTION_SET, []() {
+    String deviceName;
+    if (webserverGetParameter(AC_DEVICE_SECTION_DEVICENAME, deviceName)) {
+      applyDeviceName(deviceName);
+      saveConfig();
+    }
+    redirect(AC_DEVICE_SECTION);
+  });
+
+  //      Timezone
+  webServer.on(AC_TIMEZONE_SECTION_SET, []() {
+    String tz;
+    if (webserverGetParameter(AC_TIMEZONE_SECTION_TIMEZONE, tz)) {
+      applyTimezone(tz);
+      saveConfig();
+    }
+    redirect(AC_TIMEZONE_SECTION);
+  });
+
+  //      NTP server
+  webServer.on(AC_NTPSERVER_SECTION_SET, []() {
+    String enabled = "false";
+    webserverGetParameter(AC_NTPSERVER_SECTION_ENABLED, enabled);
+    applyNtpServer(enabled.equals("true"));
+    saveConfig();
+    redirect(AC_NTPSERVER_SECTION);
+  });
+
+  //      Tick sync
+  webServer.on(AC_TICKSYNC_SECTION_SET, []() {
+    String mode;
+    if (webserverGetParameter(AC_TICKSYNC_SECTION_MODE, mode)) {
+      for (uint8_t i = 0; i < sizeof(tickSyncModes) / sizeof(tickSyncModes[0]); ++i) {
+        if (mode.equals(tickSyncModes[i])) {
+          applyTickSync(i);
+          saveConfig();
+        }
+      }
+    }
+    redirect(AC_TICKSYNC_SECTION);
+  });
+
+  // built at compile time, nothing to parse. Started by startAutoConnect() from the loop.
+  for (AutoConnectAux* aux : configMenu) {
+    autoConnect.join(*aux);
+  }
+  LOG.i("AutoConnect menu: %u pages.", CONFIG_MENU_PAGES);
+  autoconfigSet(AC_DEVICE_SECTION, AC_DEVICE_SECTION_DEVICENAME, id);
+  autoconfigSet(AC_TIMEZONE_SECTION, AC_TIMEZONE_SECTION_TIMEZONE, timezone);
+  autoconfigCheck(AC_NTPSERVER_SECTION, AC_NTPSERVER_SECTION_ENABLED, config.isNtpServer());
+  autoconfigRadio(AC_TICKSYNC_SECTION, AC_TICKSYNC_SECTION_MODE, config.getTickSync());
+}
+
+// --------------------------------------------------------------------------------
+void setupEzTime()
+// --------------------------------------------------------------------------------
+{
+  // ezTime, only resolves timezones the table doesn't know. NTP is done by the SntpClient,
+  // local time by PosixTz
+  // setDebug(DEBUG);
+  setInterval(0);
+}
+
+// --------------------------------------------------------------------------------
+void setupSntp()
+// --------------------------------------------------------------------------------
+{
+  // polls adaptively from 64s up to hours, corrections are slewed.
+  // With three servers a falseticker is outvoted.
+  sntp.addServer(NTP_SERVER_0);
+  sntp.addServer(NTP_SERVER_1);
+  sntp.addServer(NTP_SERVER_2);
+  sntp.onSync(onNtpSync);
+  if (!sntp.begin()) {
+    LOG.e("SNTP start failed");
+  }
+
+  // optional, answers only once we are synced ourselves
+  if (config.isNtpServer() && !sntpServer.begin()) {
+    LOG.e("NTP server start failed");
+  }
+}
+
+// --------------------------------------------------------------------------------
+void setupStatistics()
+// --------------------------------------------------------------------------------
+{
+  // Statistics
+  statistics.addReport([](Logger& log) {
+    for (uint8_t i = 0; i < sntp.getServerCount(); ++i) {
+      SntpServerStats_t stats = sntp.getServerStats(i);
+      log.i("[SNTP] %s: offset %.3fms, delay %.3fms, jitter %.3fms, reach %03o, %s", sntp.getServerName(i), stats.offset / 1000.0,
+            stats.delay / 1000.0, stats.jitter / 1000.0, stats.reach, stats.selected ? "selected" : "not selected");
+    }
+  });
+  statistics.addReport([](Logger& log) {
+    uint32_t requests = httpServer.getRequests();
+    log.i("[HTTP] %u requests, %u connections, %u%% reused, max %u concurrent, %u timed out, %u streams, %u evicted", requests,
+          httpServer.getConnections(), requests ? (uint32_t)(100ull * httpServer.getReused() / requests) : 0, httpServer.getMaxConcurrent(),
+          httpServer.getTimeouts(), httpServer.getStreams(), httpServer.getEvicted());
+    log.i("[HTTP] assets: %u sent (%u bytes gzip), %u not modified", WebAssets::getSent(), WebAssets::getBytes(),
+          WebAssets::getNotModified());
+  });
+  statistics.addReport([](Logger& log) {
+    log.i("[FRAMES] %u at %u fps, %u skipped, latency %" PRId64 "µs, max %" PRId64 "µs", frameScheduler.getFrames(),
+          frameScheduler.getFps(), frameScheduler.getSkipped(), frameScheduler.getLatency(), frameScheduler.getMaxLatency());
+  });
+  statistics.addReport([](Logger& log) {
+    if (!tickSync.isRunning()) {
+      return;
+    }
+    TickPeer_t peers[TICK_SYNC_MAX_PEERS];
+    uint8_t count = tickSync.getPeers(peers, TICK_SYNC_MAX_PEERS);
+    log.i("[TICK] %08x, leader %08x, render offset %dµs, %u peers", (unsigned)tickSync.getId(), (unsigned)tickSync.getLeader(),
+          (int)tickSync.getRenderOffset(), count);
+    for (uint8_t i = 0; i < count; ++i) {
+      log.i("[TICK] %08x: skew %.3fms, clock offset %.3fms, delay %.3fms, stratum %u%s", (unsigned)peers[i].id, peers[i].skew / 1000.0,
+            peers[i].offset / 1000.0, peers[i].delay / 1000.0, peers[i].stratum, peers[i].leader ? ", leader" : "");
+    }
+  });
+  if (statistics.begin()) {
+    LOG.i("Statistics start");
+  } else {
+    LOG.e("Statistics start failed");
+  }
+}
+/* #endregion */
+
+/* #region  Main stuff */
+// --------------------------------------------------------------------------------
+void setup()
+// --------------------------------------------------------------------------------
+{
+  state = STATE_BOOT;
+  bootTimeline.mark("setup");
+
+  setupSerial();
+
+  setupClock();
+  bootTimeline.mark("clock");
+
+  // only opens the storage, the connect needs the cached AP
+  setupNVS();
+  bootTimeline.mark("nvs_open");
+
+  // the connect runs in the WiFi task, everything up to the first use of the network overlaps with it
+  setupWiFi();
+  bootTimeline.mark("wifi_begin");
+
+  // the config is read from flash on core 0 while this core bit-bangs the display
+  esp_pthread_cfg_t loaderCfg = {};
+  loaderCfg.stack_size = 8192;
+  loaderCfg.prio = 1;
+  esp_pthread_set_cfg(&loaderCfg);
+  std::thread nvsLoader([]() {
+    setupConfig();
+    bootTimeline.mark("config");
+  });
+
+  setupDisplay();
+  showBootScreen();
+  displayReady = true;
+  bootTimeline.mark("display");
+
+  // Boot msg
+  LOG.i("+-----------------------+");
+  LOG.i("|        Booting        |");
+  LOG.i("+-----------------------+");
+  LOG.i("+ CPU frequency: %uMHz", esp.getCpuFreqMHz());
+  LOG.i("+ Flash size: %u", esp.getFlashChipSize());
+  LOG.i("+ SDK: %s", esp.getSdkVersion());
+  LOG.i("+ CPU0 reset reason: %s -> %s ", reset.getResetReason0(), reset.getResetReasonVerbose0());
+  LOG.i("+ CPU1 reset reason: %s -> %s ", reset.getResetReason1(), reset.getResetReasonVerbose1());
+  LOG.i("+-----------------------+");
+
+  // everything below needs the device name
+  nvsLoader.join();
+
+  setupDNS();
+  bootTimeline.mark("mdns");
+  setupOTA();
+  bootTimeline.mark("ota");
+  // before the portal, in access point mode it sends the clients to it
+  setupHttpServer();
+  bootTimeline.mark("httpserver");
+  setupAutoconnectAndWebserver();
+  bootTimeline.mark("webserver");
+  setupEzTime();
+  setupSntp();
+  setupStatistics();
+
+  // a restored clock is shown right away. The rule from RTC memory survives an OTA update, the table of the
+  // new firmware may have other DST rules for the zone.
+  if (clockRestored) {
+    String restored = localTimezone.get();
+    if (resolveTimezone(false) && restored != localTimezone.get()) {
+      LOG.i("Timezone rule changed to %s", localTimezone.get());
+      rtcClock.save(localTimezone.get());
+    }
+  }
+  state = clockRestored ? STATE_HAS_TIMEZONE : STATE_BOOT_DONE;
+  bootTimeline.mark("setup_done");
+}
+
+// --------------------------------------------------------------------------------
+void loop()
+// --------------------------------------------------------------------------------
+{
+  ota.loop();
+  nvs.loop();
+  fastConnect.loop();
+  discovery.loop();
+  statistics.loop();
+  Logger::loop();
+  if (!ota.isUpdating()) {
+    if (connected) {
+      sntp.loop();
+      // joins the multicast group, so only with an interface
+      startTickSync();
+    }
+    frameScheduler.setOffset(tickSync.getRenderOffset());
+    applyConfigChange();
+
+    switch (state) {
+      case STATE_BOOT_DONE:
+        if (sntp.isSynced()) {
+          state = STATE_HAS_NTP_TIME;
+          bootTimeline.mark("ntp_synced");
+        }
+        break;
+      case STATE_HAS_NTP_TIME:
+        // https://en.wikipedia.org/wiki/List_of_tz_database_time_zones
+        if (resolveTimezone()) {
+          LOG.i("Timezone set to %s", localTimezone.get());
+          state = STATE_HAS_TIMEZONE;
+          bootTimeline.mark("timezone");
+          rtcClock.save(localTimezone.get());
+        } else {
+          LOG.e("Timezone set failed, %s", errorString());
+          state = STATE_NO_TIMEZONE;
+        }
+        break;
+      case STATE_BOOT:
+      case STATE_HAS_TIMEZONE:
+      case STATE_NO_TIMEZONE:
+        break;
+    }
+
+    events();
+
+    // only the AutoConnect pages and the portal, the HttpServer runs in its own task
+    startAutoConnect();
+    closePortal();
+
+    int64_t frameUtc;
+    if (frameScheduler.due(frameUtc)) {
+      showTime(frameUtc);
+      if (state == STATE_HAS_TIMEZONE && !bootTimeline.has("time_shown")) {
+        bootTimeline.mark("time_shown");
+        bootTimeline.print();
+      }
+    }
+    webApi.publishEvents(state == STATE_HAS_TIMEZONE ? &localTimezone : NULL);
+  }
+}
+
+// --------------------------------------------------------------------------------
+void onNtpSync()
+// --------------------------------------------------------------------------------
+{
+  rtcClock.save(state == STATE_HAS_TIMEZONE ? localTimezone.get() : "");
+  tickSync.setStratum(sntp.getStratum() + 1);
+  LOG.i("NTP sync, offset %" PRId64 "µs, drift %dppb, next in %us", discipline.getLastOffset(), (int)utcClock.getDriftPpb(),
+        discipline.getPollInterval());
+}
+
+// --------------------------------------------------------------------------------
+void startTickSync()
+// --------------------------------------------------------------------------------
+{
+  static uint32_t nextTry = 0;
+  if (config.getTickSync() == TICK_SYNC_OFF || tickSync.isRunning() || millis() < nextTry) {
+    return;
+  }
+  nextTry = millis() + 10000;
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  uint32_t id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+  if (tickSync.begin(id, (TickSyncMode_t)config.getTickSync())) {
+    tickSync.setStratum(sntp.isSynced() ? sntp.getStratum() + 1 : 0);
+  }
+}
+
+// --------------------------------------------------------------------------------
+void startAutoConnect()
+// --------------------------------------------------------------------------------
+{
+  // AutoConnect::begin() blocks until the WiFi is connected or the portal is done. Here it is started
+  // when the WiFi is connected anyway, or with the portal right away, which it then keeps open and serves
+  // from handleClient() while the clock runs.
+  static bool started = false;
+  if (started) {
+    autoConnect.handleClient();
+    return;
+  }
+  bool portal = !connected;
+  if (portal && millis() < AC_PORTAL_DELAY_MS) {
+    return;
+  }
+  started = true;
+
+  AutoConnectConfig autoConnectConfig;
+  autoConnectConfig.title = AP_NAME;
+  autoConnectConfig.apid = AP_NAME;
+  autoConnectConfig.psk = AP_PSK;
+  autoConnectConfig.hostName = id;
+  // autoConnectConfig.autoReconnect = true;
+  autoConnectConfig.autoReconnect = false;
+  autoConnectConfig.immediateStart = portal;
+  // return as soon as the portal is up and keep it
+  autoConnectConfig.portalTimeout = 1;
+  autoConnectConfig.retainPortal = true;
+  autoConnect.config(autoConnectConfig);
+
+  autoConnectionmode = true;
+  if (autoConnect.begin()) {
+    LOG.i("AutoConnect started.");
+  } else if (portal) {
+    LOG.i("AutoConnect started, portal %s open.", AP_NAME);
+  } else {
+    LOG.e(" Autoconnect start failed.");
+  }
+  autoConnectionmode = false;
+  bootTimeline.mark("autoconnect");
+}
+
+// --------------------------------------------------------------------------------
+void closePortal()
+// --------------------------------------------------------------------------------
+{
+  // the portal is only for getting connected
+  static uint32_t connectedSince = 0;
+  if (!portalActive || !connected) {
+    connectedSince = 0;
+    return;
+  }
+  if (connectedSince == 0) {
+    connectedSince = millis() | 1;
+  } else if (millis() - connectedSince > AC_PORTAL_CLOSE_MS) {
+    LOG.i("WiFi connected, portal closed");
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_STA);
+    portalActive = false;
+  }
+}
+
+// --------------------------------------------------------------------------------
+bool resolveTimezone(bool online)
+// --------------------------------------------------------------------------------
+{
+  // the compiled-in table first, it is updated with the firmware
+  const char* rule = TzDb::lookup(timezone.c_str());
+  if (rule) {
+    return localTimezone.set(rule);
+  }
+
+  // names the table doesn't know are resolved online once, and then kept with the config
+  String cached = config.getTzRule();
+  if (cached.length() > 0) {
+    return localTimezone.set(cached.c_str());
+  }
+  if (!online) {
+    return false;
+  }
+  LOG.w("Timezone '%s' not in tz %s, asking the timezone server", timezone.c_str(), TzDb::getVersion());
+  Timezone lookup;
+  if (lookup.setLocation(timezone) && localTimezone.set(lookup.getPosix().c_str())) {
+    config.setTzRule(lookup.getPosix());
+    config.save();
+    return true;
+  }
+  return false;
+}
+/* #endregion */
+
+/* #region  settings */
+// --------------------------------------------------------------------------------
+void applyDeviceName(const String& deviceName)
+// --------------------------------------------------------------------------------
+{
+  autoconfigSet(AC_DEVICE_SECTION, AC_DEVICE_SECTION_DEVICENAME, deviceName);
+  id = deviceName;
+  discovery.setHostname(id.c_str());
+  config.setDeviceName(deviceName);
+}
+
+// --------------------------------------------------------------------------------
+void applyTimezone(const String& tz)
+// --------------------------------------------------------------------------------
+{
+  autoconfigSet(AC_TIMEZONE_SECTION, AC_TIMEZONE_SECTION_TIMEZONE, tz);
+  timezone = tz;
+  if (state == STATE_HAS_NTP_TIME || state == STATE_HAS_TIMEZONE || state == STATE_NO_TIMEZONE) {
+    state = STATE_HAS_NTP_TIME;
+  }
+  config.setTimezone(timezone);
+  discovery.setTimezone(timezone.c_str());
+}
+
+// --------------------------------------------------------------------------------
+void applyNtpServer(bool ntpServer)
+// --------------------------------------------------------------------------------
+{
+  autoconfigCheck(AC_NTPSERVER_SECTION, AC_NTPSERVER_SECTION_ENABLED, ntpServer);
+  if (ntpServer) {
+    sntpServer.begin();
+  } else {
+    sntpServer.end();
+  }
+  config.setNtpServer(ntpServer);
+}
+
+// --------------------------------------------------------------------------------
+void applyTickSync(uint8_t mode)
+// --------------------------------------------------------------------------------
+{
+  autoconfigRadio(AC_TICKSYNC_SECTION, AC_TICKSYNC_SECTION_MODE, mode);
+  config.setTickSync(mode);
+  // restarted by the loop with the new mode
+  tickSync.end();
+}
+
+// --------------------------------------------------------------------------------
+void applyConfigChange()
+// --------------------------------------------------------------------------------
+{
+  // the API validates in the HTTP task, the settings are changed here in the loop
+  ConfigChange_t change;
+  if (!webApi.takeChange(change)) {
+    return;
+  }
+
+  // the same settings again change nothing, so a fleet can be sent its whole config
+  bool changed = false;
+  if (change.hasDeviceName && !config.getDeviceName().equals(change.deviceName)) {
+    applyDeviceName(change.deviceName);
+    changed = true;
+  }
+  if (change.hasTimezone && !config.getTimezone().equals(change.timezone)) {
+    applyTimezone(change.timezone);
+    changed = true;
+  }
+  if (change.hasNtpServer && config.isNtpServer() != change.ntpServer) {
+    applyNtpServer(change.ntpServer);
+    changed = true;
+  }
+  if (change.hasTickSync && config.getTickSync() != change.tickSync) {
+    applyTickSync(change.tickSync);
+    changed = true;
+  }
+  if (changed) {
+    saveConfig();
+  }
+}
+
+// --------------------------------------------------------------------------------
+void saveConfig()
+// --------------------------------------------------------------------------------
+{
+  config.save(true, [](bool success) {
+    if (!success) {
+      LOG.e("Could not write config to nvs");
+    }
+  });
+}
+/* #endregion */
+
+/* #region  autocofig/webserver utils */
+// --------------------------------------------------------------------------------
+bool webserverGetParameter(const String& key, String& result)
+// --------------------------------------------------------------------------------
+{
+  static LogLimit limit;
+
+  if (webServer.hasArg(key)) {
+    result = webServer.arg(key);
+    return true;
+  } else {
+    LOG.e(limit, "[ConfigServer] Error: arg '%s' not found in parameters", key.c_str());
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------------
+bool autoconfigSet(const String& section, const String& name, const String& value)
+// --------------------------------------------------------------------------------
+{
+  static LogLimit limit;
+
+  AutoConnectAux* device = autoConnect.aux(section);
+  if (device) {
+    AutoConnectInput& deviceNameInput = device->getElement<AutoConnectInput>(name);
+    if (&deviceNameInput) {
+      deviceNameInput.value = value;
+      return true;
+    } else {
+      LOG.e(limit, "[ConfigServer] Error: could not found %s section in configuration", section.c_str());
+    }
+  } else {
+    LOG.e(limit, "[ConfigServer] Error: could not found %s section in configuration", section.c_str());
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------------
+bool autoconfigCheck(const String& section, const String& name, bool checked)
+// --------------------------------------------------------------------------------
+{
+  static LogLimit limit;
+
+  AutoConnectAux* aux = autoConnect.aux(section);
+  if (aux) {
+    AutoConnectCheckbox& checkbox = aux->getElement<AutoConnectCheckbox>(name);
+    if (&checkbox) {
+      checkbox.checked = checked;
+      return true;
+    }
+  }
+  LOG.e(limit, "[ConfigServer] Error: could not found %s section in configuration", section.c_str());
+  return false;
+}
+
+// --------------------------------------------------------------------------------
+bool autoconfigRadio(const String& section, const String& name, uint8_t index)
+// --------------------------------------------------------------------------------
+{
+  static LogLimit limit;
+
+  AutoConnectAux* aux = autoConnect.aux(section);
+  if (aux) {
+    AutoConnectRadio& radio = aux->getElement<AutoConnectRadio>(name);
+    if (&radio) {
+      // 1 based, 0 is none
+      radio.checked = index + 1;
+      return true;
+    }
+  }
+  LOG.e(limit, "[ConfigServer] Error: could not found %s section in configuration", section.c_str());
+  return false;
+}
+
+// --------------------------------------------------------------------------------
+void redirectToPortal(HttpRequest& request, HttpResponse& response)
+// --------------------------------------------------------------------------------
+{
+  // same host and path on the AutoConnect port, a cut-off URL is never sent
+  String host = IPAddress(request.getLocalAddress()).toString();
+  char location[HTTP_LOCATION_SIZE];
+  int n = snprintf(location, sizeof(location), "http://%s:%u%s%s%s", host.c_str(), AC_PORT, request.getPath(),
+                   *request.getQuery() ? "?" : "", request.getQuery());
+  if (n < 0 || (size_t)n >= sizeof(location)) {
+    // without the query the page still opens
+    n = snprintf(location, sizeof(location), "http://%s:%u%s", host.c_str(), AC_PORT, request.getPath());
+  }
+  if (n < 0 || (size_t)n >= sizeof(location)) {
+    response.send(414, "text/plain", "URI too long");
+    return;
+  }
+  response.redirect(location);
+}
+
+// --------------------------------------------------------------------------------
+void redirect(const String toLocation)
+// --------------------------------------------------------------------------------
+{
+  // WebServer sends Content-Length: 0 and Connection: close, the browser ends the connection when it has the
+  // response. Stopping the client here could cut the response off.
+  webServer.sendHeader("Location", toLocation, true);
+  webServer.send(302, "text/plain", "");
+}
+/* #endregion */
+
+/* #region  display stuff */
+// --------------------------------------------------------------------------------
+void showBootScreen()
+// --------------------------------------------------------------------------------
+{
+  redrawFace = true;
+  u8g2.clearBuffer();
+  u8g2.setFont(u8g2_font_ncenB10_tr);
+  u8g2.drawStr(0, 20, "Booting...");
+  u8g2.sendBuffer();
+}
+
+// --------------------------------------------------------------------------------
+void showConnectScreen()
+// --------------------------------------------------------------------------------
+{
+  redrawFace = true;
+  u8g2.clearBuffer();
+  u8g2.setFont(u8g2_font_ncenB10_tr);
+  u8g2.drawStr(0, 20, "Connect");
+  u8g2.drawStr(0, 40, "to WiFi...");
+  u8g2.drawStr(0, 60, WiFi.SSID().c_str());
+  u8g2.sendBuffer();
+}
+
+// --------------------------------------------------------------------------------
+void showConnectionFailed(uint8_t reason)
+// --------------------------------------------------------------------------------
+{
+  redrawFace = true;
+  u8g2.clearBuffer();
+  u8g2.setFont(u8g2_font_ncenB10_tr);
+  u8g2.drawStr(0, 20, "WiFi failed");
+  u8g2.drawStr(0, 40, "reason:");
+  u8g2.drawStr(0, 60, getWifiFailReason(reason));
+  u8g2.sendBuffer();
+}
+
+// --------------------------------------------------------------------------------
+void showAPStart()
+// --------------------------------------------------------------------------------
+{
+  redrawFace = true;
+  u8g2.clearBuffer();
+  u8g2.setFont(u8g2_font_ncenB08_tr);
+  u8g2.drawStr(0, 20, "Access point mode");
+  u8g2.drawStr(0, 40, (String("SSID: ") + AP_NAME).c_str());
+  u8g2.drawStr(0, 60, "PSK:  " AP_PSK);
+  u8g2.sendBuffer();
+}
+
+// --------------------------------------------------------------------------------
+void showTime(int64_t frameUtc)
+// --------------------------------------------------------------------------------
+{
+  uint8_t w;
+  // the frame edge, not now: the marker moves in equal steps however late the loop is
+  uint8_t changed = clockFace.update(frameUtc);
+  uint8_t marker = clockFace.getMarker();
+
+  if (!redrawFace.exchange(false) && !(changed & FACE_TEXT)) {
+    // most frames only move the marker, its tile row is 128 of the 1024 bytes to transfer
+    if (changed & FACE_MARKER) {
+      u8g2.setDrawColor(0);
+      u8g2.drawBox(0, 0, 128, 2);
+      u8g2.setDrawColor(1);
+      u8g2.drawHLine(marker, 0, CLOCK_FACE_MARKER_WIDTH);
+      u8g2.drawHLine(marker, 1, CLOCK_FACE_MARKER_WIDTH);
+      u8g2.updateDisplayArea(0, 0, u8g2.getBufferTileWidth(), 1);
+    }
+    return;
+  }
+
+  // print
+  u8g2.clearBuffer();
+  u8g2.setDrawColor(1);
+
+  // time
+  u8g2.drawHLine(marker, 0, CLOCK_FACE_MARKER_WIDTH);
+  u8g2.drawHLine(marker, 1, CLOCK_FACE_MARKER_WIDTH);
+  u8g2.setFont(u8g2_font_freedoomr25_mn);
+  w = u8g2.getStrWidth(clockFace.getTime());
+  u8g2.drawStr((128 - w) / 2, 32, clockFace.getTime());
+
+  // date
+  u8g2.setFont(u8g2_font_t0_16_tn);
+  w = u8g2.getStrWidth(clockFace.getDate());
+  u8g2.drawStr((128 - w) / 2, 46, clockFace.getDate());
+
+  // ip, or how to reach the portal while it is open
+  const char* status = portalActive ? "AP " AP_NAME " " AP_PSK : currentIP.c_str();
+  u8g2.setFont(u8g2_font_profont10_tf);
+  w = u8g2.getStrWidth(status);
+  u8g2.drawStr(128 - w, 63, status);
+
+  u8g2.sendBuffer();
+}
+/* #endregion */
@@ -0,0 +1,109 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/discovery.h"
+
+#include <ESPmDNS.h>
+#include <mdns.h>
+
+#define SERVICE_HTTP "http"
+#define SERVICE_CLOCK "esp32clock"
+#define PROTO_TCP "tcp"
+
+//------------------------------------------------------------------------------
+Discovery::Discovery() : LOG("Discovery"), running_(false), lastUptime_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool Discovery::begin(const char* hostname, const char* version, const char* timezone, uint16_t httpPort)
+//------------------------------------------------------------------------------
+{
+  if (!MDNS.begin(hostname)) {
+    LOG.e("mDNS failed");
+    return false;
+  }
+  running_ = true;
+  MDNS.setInstanceName(hostname);
+
+  MDNS.addService(SERVICE_HTTP, PROTO_TCP, httpPort);
+  MDNS.addServiceTxt(SERVICE_HTTP, PROTO_TCP, "path", "/");
+
+  MDNS.addService(SERVICE_CLOCK, PROTO_TCP, httpPort);
+  setTxt("version", version);
+  setTxt("timezone", timezone);
+  lastUptime_ = millis();
+  setTxt("uptime", "0");
+
+  // ArduinoOTA leaves the responder to us, see OTA::begin()
+  MDNS.enableArduino();
+
+  LOG.i("mDNS start name: %s", hostname);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void Discovery::loop()
+//------------------------------------------------------------------------------
+{
+  if (!running_ || millis() - lastUptime_ < DISCOVERY_UPTIME_PERIOD_MS) {
+    return;
+  }
+  lastUptime_ = millis();
+  char uptime[12];
+  snprintf(uptime, sizeof(uptime), "%u", (uint32_t)(esp_timer_get_time() / 1000000));
+  setTxt("uptime", uptime);
+}
+
+//------------------------------------------------------------------------------
+void Discovery::setHostname(const char* hostname)
+//------------------------------------------------------------------------------
+{
+  if (!running_) {
+    return;
+  }
+  // the responder probes the new name and announces it, the services go along
+  esp_err_t err = mdns_hostname_set(hostname);
+  if (err == ESP_OK) {
+    err = mdns_instance_name_set(hostname);
+  }
+  if (err != ESP_OK) {
+    LOG.e("mDNS name %s failed: %s", hostname, esp_err_to_name(err));
+    return;
+  }
+  LOG.i("mDNS name: %s", hostname);
+}
+
+//------------------------------------------------------------------------------
+void Discovery::setTimezone(const char* timezone)
+//------------------------------------------------------------------------------
+{
+  if (running_) {
+    setTxt("timezone", timezone);
+  }
+}
+
+//------------------------------------------------------------------------------
+void Discovery::setTxt(const char* key, const char* value)
+//------------------------------------------------------------------------------
+{
+  // a changed record is announced by the responder
+  esp_err_t err = mdns_service_txt_item_set("_" SERVICE_CLOCK, "_" PROTO_TCP, key, value);
+  if (err != ESP_OK) {
+    LOG.w("mDNS TXT %s failed: %s", key, esp_err_to_name(err));
+  }
+}
@@ -0,0 +1,51 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "util/logger.h"
+
+// The uptime in the TXT record is refreshed this often. Every change is announced to the whole
+// network, so not more often than a browser would notice.
+#ifndef DISCOVERY_UPTIME_PERIOD_MS
+#define DISCOVERY_UPTIME_PERIOD_MS 600000
+#endif
+
+// mDNS responder of the clock: the host name, the web pages as _http._tcp and the clock itself as
+// _esp32clock._tcp with TXT records (version, timezone, uptime), so all clocks of a network are found
+// with one browse. The OTA port is advertised as _arduino._tcp for the IDE.
+// The responder is started once. A new name or timezone is changed in place and announced, the
+// services stay up, in contrast to MDNS.end() and MDNS.begin().
+class Discovery {
+ public:
+  Discovery();
+
+  bool begin(const char* hostname, const char* version, const char* timezone, uint16_t httpPort = 80);
+  void loop();
+
+  void setHostname(const char* hostname);
+  void setTimezone(const char* timezone);
+
+ private:
+  void setTxt(const char* key, const char* value);
+
+  Logger LOG;
+  bool running_;
+  uint32_t lastUptime_;
+};
@@ -0,0 +1,242 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/fastconnect.h"
+
+#include <esp_attr.h>
+#include <esp_clk.h>
+#include <esp_wifi.h>
+#include <lwip/dhcp.h>
+#include <tcpip_adapter.h>
+
+#include "util/crc32.h"
+
+#define NVS_WIFI_CACHE "wificache"
+#define RTC_MAGIC 0x57494649  // "WIFI"
+
+//------------------------------------------------------------------------------
+static uint32_t rtcSeconds()
+//------------------------------------------------------------------------------
+{
+  // the RTC timer runs on through resets and deep sleep, and unlike the system time it is never stepped
+  return esp_clk_rtc_time() / 1000000;
+}
+
+// Not initialized on boot, so it keeps its content across software resets and deep sleep.
+// After power on it holds garbage, the magic and the CRC tell.
+RTC_NOINIT_ATTR static uint32_t rtcMagic;
+RTC_NOINIT_ATTR static FastConnectCache_t rtcCache;
+
+//------------------------------------------------------------------------------
+FastConnect::FastConnect(NVS& nvs)
+    : LOG("FastConnect"),
+      nvs_(nvs),
+      mode_(MODE_IDLE),
+      connected_(false),
+      renewLease_(false),
+      startTime_(0)
+//------------------------------------------------------------------------------
+{
+  ssid_[0] = 0;
+  password_[0] = 0;
+}
+
+//------------------------------------------------------------------------------
+void FastConnect::begin()
+//------------------------------------------------------------------------------
+{
+  bool fromRtc = false;
+  if (!loadCache(fromRtc)) {
+    mode_ = MODE_SCAN;
+    WiFi.begin();
+    return;
+  }
+
+  // the credentials stored by the WiFi driver, same as WiFi.begin() without arguments uses
+  WiFi.mode(WIFI_STA);
+  wifi_config_t conf;
+  if (esp_wifi_get_config(WIFI_IF_STA, &conf) != ESP_OK || !conf.sta.ssid[0]) {
+    mode_ = MODE_SCAN;
+    WiFi.begin();
+    return;
+  }
+  strncpy(ssid_, (const char*)conf.sta.ssid, sizeof(conf.sta.ssid));
+  ssid_[sizeof(ssid_) - 1] = 0;
+  strncpy(password_, (const char*)conf.sta.password, sizeof(conf.sta.password));
+  password_[sizeof(password_) - 1] = 0;
+
+  if (fromRtc && FASTCONNECT_REUSE_LEASE && isLeaseValid()) {
+    WiFi.config(IPAddress(rtcCache.ip), IPAddress(rtcCache.gateway), IPAddress(rtcCache.netmask), IPAddress(rtcCache.dns));
+    mode_ = MODE_STATIC;
+  } else {
+    mode_ = MODE_DIRECTED;
+  }
+
+  LOG.i("Connecting on channel %u to %02X:%02X:%02X:%02X:%02X:%02X%s", rtcCache.channel, rtcCache.bssid[0], rtcCache.bssid[1],
+        rtcCache.bssid[2], rtcCache.bssid[3], rtcCache.bssid[4], rtcCache.bssid[5], mode_ == MODE_STATIC ? " with the last lease" : "");
+  startTime_ = millis();
+  // channel and BSSID must not end up in the stored config, a plain WiFi.begin() would be pinned to them
+  WiFi.persistent(false);
+  WiFi.begin(ssid_, password_, rtcCache.channel, rtcCache.bssid);
+  WiFi.persistent(true);
+}
+
+//------------------------------------------------------------------------------
+void FastConnect::loop()
+//------------------------------------------------------------------------------
+{
+  if ((mode_ == MODE_DIRECTED || mode_ == MODE_STATIC) && !connected_ && millis() - startTime_ > FASTCONNECT_TIMEOUT_MS) {
+    fallback("timeout");
+  }
+
+  if (renewLease_) {
+    // back to DHCP, the router renews the lease and the next onConnected() stores it
+    renewLease_ = false;
+    mode_ = MODE_DIRECTED;
+    LOG.i("Renewing the lease");
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+  }
+}
+
+//------------------------------------------------------------------------------
+void FastConnect::onConnected()
+//------------------------------------------------------------------------------
+{
+  connected_ = true;
+  if (mode_ == MODE_DIRECTED || mode_ == MODE_STATIC) {
+    LOG.i("Connected in %ums", millis() - startTime_);
+  }
+  if (mode_ == MODE_STATIC) {
+    // the cached address is no lease of its own, it is not stored again
+    renewLease_ = true;
+    return;
+  }
+  saveCache();
+}
+
+//------------------------------------------------------------------------------
+void FastConnect::onDisconnected(uint8_t reason)
+//------------------------------------------------------------------------------
+{
+  connected_ = false;
+  if (mode_ == MODE_DIRECTED || mode_ == MODE_STATIC) {
+    fallback(reason == WIFI_REASON_NO_AP_FOUND ? "AP not found" : "disconnected");
+  }
+}
+
+//------------------------------------------------------------------------------
+FastConnect::Mode_t FastConnect::getMode()
+//------------------------------------------------------------------------------
+{
+  return mode_;
+}
+
+//------------------------------------------------------------------------------
+const char* FastConnect::getModeName()
+//------------------------------------------------------------------------------
+{
+  switch (mode_.load()) {
+    case MODE_IDLE:
+      return "idle";
+    case MODE_DIRECTED:
+      return "directed";
+    case MODE_STATIC:
+      return "static";
+    case MODE_SCAN:
+      return "scan";
+  }
+  return "?";
+}
+
+//------------------------------------------------------------------------------
+bool FastConnect::loadCache(bool& fromRtc)
+//------------------------------------------------------------------------------
+{
+  if (rtcMagic == RTC_MAGIC && Crc32::compute(&rtcCache, offsetof(FastConnectCache_t, crc)) == rtcCache.crc) {
+    fromRtc = true;
+    return true;
+  }
+
+  FastConnectCache_t cache;
+  size_t length;
+  if (nvs_.readBlob(NVS_WIFI_CACHE, &cache, sizeof(cache), &length) && length == sizeof(cache) &&
+      Crc32::compute(&cache, offsetof(FastConnectCache_t, crc)) == cache.crc) {
+    rtcCache = cache;
+    rtcMagic = RTC_MAGIC;
+    fromRtc = false;
+    return true;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+bool FastConnect::isLeaseValid()
+//------------------------------------------------------------------------------
+{
+  return rtcCache.leaseExpiry && rtcCache.ip && (int64_t)rtcCache.leaseExpiry - rtcSeconds() > FASTCONNECT_LEASE_MARGIN_S;
+}
+
+//------------------------------------------------------------------------------
+void FastConnect::saveCache()
+//------------------------------------------------------------------------------
+{
+  FastConnectCache_t cache;
+  memset(&cache, 0, sizeof(cache));
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.netmask = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP(0);
+  // from the DHCP client, a lease without a known duration is not reused
+  struct netif* netif = NULL;
+  if (tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void**)&netif) == ESP_OK && netif && netif_dhcp_data(netif) &&
+      netif_dhcp_data(netif)->offered_t0_lease) {
+    cache.leaseExpiry = rtcSeconds() + netif_dhcp_data(netif)->offered_t0_lease;
+  }
+  cache.crc = Crc32::compute(&cache, offsetof(FastConnectCache_t, crc));
+
+  rtcCache = cache;
+  rtcMagic = RTC_MAGIC;
+
+  // after a power loss the lease is not reused, so it is left out of the NVS record. Then the record only
+  // changes with the AP, and unchanged records are not written by the NVS cache.
+  cache.leaseExpiry = 0;
+  cache.crc = Crc32::compute(&cache, offsetof(FastConnectCache_t, crc));
+  nvs_.writeBlob(NVS_WIFI_CACHE, &cache, sizeof(cache), true);
+}
+
+//------------------------------------------------------------------------------
+void FastConnect::fallback(const char* reason)
+//------------------------------------------------------------------------------
+{
+  Mode_t mode = mode_;
+  if ((mode != MODE_DIRECTED && mode != MODE_STATIC) || !mode_.compare_exchange_strong(mode, MODE_SCAN)) {
+    return;
+  }
+
+  LOG.w("Fast connect failed (%s), scanning", reason);
+  rtcMagic = 0;
+  nvs_.erase(NVS_WIFI_CACHE, true);
+
+  // back to DHCP
+  WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+  WiFi.disconnect();
+  WiFi.persistent(false);
+  WiFi.begin(ssid_, password_);
+  WiFi.persistent(true);
+}
@@ -0,0 +1,97 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <atomic>
+
+#include "util/logger.h"
+#include "util/nvs.h"
+
+// Give up on the directed connect after this many ms and scan for the AP.
+#ifndef FASTCONNECT_TIMEOUT_MS
+#define FASTCONNECT_TIMEOUT_MS 3000
+#endif
+
+// Opt-in: after a reset or deep sleep connect with the address of the last DHCP lease, without waiting for
+// DHCP, as long as the lease has not expired. DHCP is restarted right after, so the lease is renewed.
+#ifndef FASTCONNECT_REUSE_LEASE
+#define FASTCONNECT_REUSE_LEASE 0
+#endif
+
+// A lease that expires within this many s is not reused.
+#ifndef FASTCONNECT_LEASE_MARGIN_S
+#define FASTCONNECT_LEASE_MARGIN_S 60
+#endif
+
+// What the last successful connect used.
+struct FastConnectCache_t {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t netmask;
+  uint32_t dns;
+  uint32_t leaseExpiry;  // RTC timer (s) the lease ends, 0 if unknown or from NVS
+  uint32_t crc;          // over the fields above
+};
+
+// Connects to the stored AP without the full channel scan and, with FASTCONNECT_REUSE_LEASE, after a short
+// reset or deep sleep without waiting for DHCP.
+// The channel, BSSID and lease of the last connect are kept in RTC memory (survives resets and deep sleep)
+// and in NVS (survives power loss). The lease is only reused from RTC memory and before it expires (the
+// RTC timer runs on through resets and deep sleep), afterwards it may have been given away. DHCP is
+// restarted once connected, so the router renews it. After a power loss only channel and BSSID are taken.
+// If the directed connect fails or times out, the cache is dropped and WiFi.begin() scans as usual.
+class FastConnect {
+ public:
+  enum Mode_t { MODE_IDLE, MODE_DIRECTED, MODE_STATIC, MODE_SCAN };
+
+  FastConnect(NVS& nvs);
+
+  // Call with the NVS opened, instead of WiFi.begin().
+  void begin();
+  void loop();
+
+  // Call from the WiFi event handler.
+  void onConnected();
+  void onDisconnected(uint8_t reason);
+
+  Mode_t getMode();
+  const char* getModeName();
+
+ private:
+  bool loadCache(bool& fromRtc);
+  bool isLeaseValid();
+  void saveCache();
+  void fallback(const char* reason);
+
+  Logger LOG;
+  NVS& nvs_;
+  char ssid_[33];
+  char password_[65];
+  // the event handler and loop() may both give up on the directed connect
+  std::atomic<Mode_t> mode_;
+  volatile bool connected_;
+  // connected with the cached address, loop() restarts DHCP
+  volatile bool renewLease_;
+  uint32_t startTime_;
+};
@@ -0,0 +1,920 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/httpserver.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+static_assert(HTTP_STREAM_BUFFER_SIZE <= HTTP_RESPONSE_HEAD_SIZE + HTTP_RESPONSE_BODY_SIZE, "the stream buffer is the response buffer");
+static_assert(HTTP_RESPONSE_HEADERS_SIZE >= HTTP_LOCATION_SIZE + 12, "a Location header fits");
+static_assert(HTTP_RESPONSE_HEAD_SIZE >= HTTP_RESPONSE_HEADERS_SIZE + 128, "the fixed part of the head fits");
+
+//------------------------------------------------------------------------------
+static const char* statusText(uint16_t status)
+//------------------------------------------------------------------------------
+{
+  switch (status) {
+    case 200:
+      return "OK";
+    case 204:
+      return "No Content";
+    case 302:
+      return "Found";
+    case 304:
+      return "Not Modified";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 413:
+      return "Payload Too Large";
+    case 414:
+      return "URI Too Long";
+    case 431:
+      return "Request Header Fields Too Large";
+    case 500:
+      return "Internal Server Error";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "";
+  }
+}
+
+//------------------------------------------------------------------------------
+HttpMethod_t HttpRequest::getMethod()
+//------------------------------------------------------------------------------
+{
+  return method_;
+}
+
+//------------------------------------------------------------------------------
+const char* HttpRequest::getPath()
+//------------------------------------------------------------------------------
+{
+  return path_;
+}
+
+//------------------------------------------------------------------------------
+const char* HttpRequest::getQuery()
+//------------------------------------------------------------------------------
+{
+  return query_;
+}
+
+//------------------------------------------------------------------------------
+const char* HttpRequest::getHeader(const char* name)
+//------------------------------------------------------------------------------
+{
+  // parse() has replaced each CRLF with two NULs
+  size_t nameLength = strlen(name);
+  for (const char* line = headers_; line < headersEnd_ && *line; line += strlen(line) + 2) {
+    if (strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':') {
+      const char* value = line + nameLength + 1;
+      while (*value == ' ' || *value == '\t') {
+        ++value;
+      }
+      return value;
+    }
+  }
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+const char* HttpRequest::getBody()
+//------------------------------------------------------------------------------
+{
+  return body_;
+}
+
+//------------------------------------------------------------------------------
+size_t HttpRequest::getBodyLength()
+//------------------------------------------------------------------------------
+{
+  return bodyLength_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t HttpRequest::getLocalAddress()
+//------------------------------------------------------------------------------
+{
+  return localAddress_;
+}
+
+//------------------------------------------------------------------------------
+bool HttpRequest::parse(char* buffer, size_t headerLength)
+//------------------------------------------------------------------------------
+{
+  // in place: every CRLF of the head becomes two NULs, so lines and values are strings
+  for (size_t i = 0; i + 1 < headerLength; ++i) {
+    if (buffer[i] == '\r' && buffer[i + 1] == '\n') {
+      buffer[i] = buffer[i + 1] = 0;
+    }
+  }
+  headers_ = buffer + strlen(buffer) + 2;
+  headersEnd_ = buffer + headerLength;
+  body_ = headersEnd_;
+  bodyLength_ = 0;
+
+  // request line: METHOD TARGET HTTP/1.x
+  char* target = strchr(buffer, ' ');
+  if (!target) {
+    return false;
+  }
+  *target++ = 0;
+  char* version = strchr(target, ' ');
+  if (!version || strncmp(version + 1, "HTTP/1.", 7) != 0) {
+    return false;
+  }
+  *version = 0;
+  http10_ = strcmp(version + 1, "HTTP/1.0") == 0;
+
+  if (strcmp(buffer, "GET") == 0) {
+    method_ = HTTP_METHOD_GET;
+  } else if (strcmp(buffer, "HEAD") == 0) {
+    method_ = HTTP_METHOD_HEAD;
+  } else if (strcmp(buffer, "POST") == 0) {
+    method_ = HTTP_METHOD_POST;
+  } else if (strcmp(buffer, "PUT") == 0) {
+    method_ = HTTP_METHOD_PUT;
+  } else {
+    method_ = HTTP_METHOD_OTHER;
+  }
+
+  path_ = target;
+  char* query = strchr(target, '?');
+  if (query) {
+    *query++ = 0;
+    query_ = query;
+  } else {
+    query_ = "";
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::setStatus(uint16_t status)
+//------------------------------------------------------------------------------
+{
+  status_ = status;
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::setContentType(const char* contentType)
+//------------------------------------------------------------------------------
+{
+  contentType_ = contentType;
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::addHeader(const char* name, const char* value)
+//------------------------------------------------------------------------------
+{
+  int n = snprintf(headers_ + headersLength_, sizeof(headers_) - headersLength_, "%s: %s\r\n", name, value);
+  if (n < 0 || (size_t)n >= sizeof(headers_) - headersLength_) {
+    overflow_ = true;
+    return;
+  }
+  headersLength_ += n;
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::send(uint16_t status, const char* contentType, const char* body)
+//------------------------------------------------------------------------------
+{
+  status_ = status;
+  contentType_ = contentType;
+  print(body);
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::sendStatic(uint16_t status, const char* contentType, const uint8_t* body, size_t length)
+//------------------------------------------------------------------------------
+{
+  status_ = status;
+  contentType_ = contentType;
+  staticBody_ = body;
+  bodyLength_ = length;
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::redirect(const char* location)
+//------------------------------------------------------------------------------
+{
+  status_ = 302;
+  contentType_ = NULL;
+  addHeader("Location", location);
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::stream()
+//------------------------------------------------------------------------------
+{
+  stream_ = true;
+  contentType_ = "text/event-stream";
+  addHeader("Cache-Control", "no-cache");
+}
+
+//------------------------------------------------------------------------------
+size_t HttpResponse::write(uint8_t c)
+//------------------------------------------------------------------------------
+{
+  return write(&c, 1);
+}
+
+//------------------------------------------------------------------------------
+size_t HttpResponse::write(const uint8_t* buffer, size_t size)
+//------------------------------------------------------------------------------
+{
+  if (staticBody_ || bodyLength_ + size > HTTP_RESPONSE_BODY_SIZE) {
+    overflow_ = true;
+    return 0;
+  }
+  memcpy(data_ + HTTP_RESPONSE_HEAD_SIZE + bodyLength_, buffer, size);
+  bodyLength_ += size;
+  return size;
+}
+
+//------------------------------------------------------------------------------
+void HttpResponse::reset()
+//------------------------------------------------------------------------------
+{
+  status_ = 200;
+  contentType_ = "text/plain";
+  overflow_ = false;
+  stream_ = false;
+  keepAlive_ = false;
+  headersLength_ = 0;
+  start_ = HTTP_RESPONSE_HEAD_SIZE;
+  headLength_ = 0;
+  staticBody_ = NULL;
+  bodyLength_ = 0;
+}
+
+//------------------------------------------------------------------------------
+bool HttpResponse::finish(bool headOnly)
+//------------------------------------------------------------------------------
+{
+  char head[HTTP_RESPONSE_HEAD_SIZE];
+  int n = snprintf(head, sizeof(head), "HTTP/1.1 %u %s\r\n", status_, statusText(status_));
+  if (contentType_ && n >= 0 && (size_t)n < sizeof(head)) {
+    n += snprintf(head + n, sizeof(head) - n, "Content-Type: %s\r\n", contentType_);
+  }
+  // a 304 has no body, but a Content-Length would be the one of the full response. A stream ends with the connection.
+  if (!stream_ && status_ != 304 && status_ != 204 && n >= 0 && (size_t)n < sizeof(head)) {
+    n += snprintf(head + n, sizeof(head) - n, "Content-Length: %u\r\n", (unsigned)bodyLength_);
+  }
+  if (n >= 0 && (size_t)n < sizeof(head)) {
+    n += snprintf(head + n, sizeof(head) - n, "Connection: %s\r\n%.*s\r\n", keepAlive_ ? "keep-alive" : "close", (int)headersLength_,
+                  headers_);
+  }
+  if (n < 0 || (size_t)n >= sizeof(head)) {
+    return false;
+  }
+  headLength_ = n;
+  start_ = HTTP_RESPONSE_HEAD_SIZE - headLength_;
+  memcpy(data_ + start_, head, headLength_);
+  if (headOnly) {
+    staticBody_ = NULL;
+    bodyLength_ = 0;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+HttpServer::HttpServer()
+    : LOG("HttpServer"),
+      routeCount_(0),
+      notFound_(NULL),
+      socket_(-1),
+      stop_(false),
+      requests_(0),
+      accepted_(0),
+      timeouts_(0),
+      maxConcurrent_(0),
+      reused_(0),
+      streams_(0),
+      evicted_(0)
+//------------------------------------------------------------------------------
+{
+  for (Connection_t& connection : connections_) {
+    connection.state = CONNECTION_FREE;
+    connection.socket = -1;
+  }
+}
+
+//------------------------------------------------------------------------------
+HttpServer::~HttpServer()
+//------------------------------------------------------------------------------
+{
+  end();
+}
+
+//------------------------------------------------------------------------------
+bool HttpServer::on(const char* path, HttpHandler handler)
+//------------------------------------------------------------------------------
+{
+  return on(path, HTTP_METHOD_ANY, handler);
+}
+
+//------------------------------------------------------------------------------
+bool HttpServer::on(const char* path, HttpMethod_t method, HttpHandler handler)
+//------------------------------------------------------------------------------
+{
+  if (routeCount_ >= HTTP_SERVER_MAX_ROUTES || isRunning()) {
+    LOG.e("Route %s not added", path);
+    return false;
+  }
+  routes_[routeCount_++] = {path, method, handler};
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::onNotFound(HttpHandler handler)
+//------------------------------------------------------------------------------
+{
+  notFound_ = handler;
+}
+
+//------------------------------------------------------------------------------
+bool HttpServer::begin(uint16_t port)
+//------------------------------------------------------------------------------
+{
+  if (isRunning()) {
+    return true;
+  }
+
+  socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  int one = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (socket_ < 0 || bind(socket_, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(socket_, HTTP_SERVER_MAX_CONNECTIONS) != 0) {
+    LOG.e("Could not listen on TCP %u", port);
+    if (socket_ >= 0) {
+      ::close(socket_);
+      socket_ = -1;
+    }
+    return false;
+  }
+  // a client that is gone before accept() must not block the task
+  fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL, 0) | O_NONBLOCK);
+
+#ifdef ESP_PLATFORM
+  esp_pthread_cfg_t cfg = {};
+  cfg.stack_size = HTTP_SERVER_TASK_STACK_SIZE;
+  cfg.prio = HTTP_SERVER_TASK_PRIORITY;
+  esp_pthread_set_cfg(&cfg);
+#endif
+
+  stop_ = false;
+  task_ = std::thread(&HttpServer::run, this);
+  LOG.i("Listening on TCP %u", port);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::end()
+//------------------------------------------------------------------------------
+{
+  if (!isRunning()) {
+    return;
+  }
+  stop_ = true;
+  task_.join();
+  for (Connection_t& connection : connections_) {
+    closeConnection(connection);
+  }
+  ::close(socket_);
+  socket_ = -1;
+  LOG.i("Stopped");
+}
+
+//------------------------------------------------------------------------------
+bool HttpServer::isRunning()
+//------------------------------------------------------------------------------
+{
+  return task_.joinable();
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::publish(const char* event, const char* data)
+//------------------------------------------------------------------------------
+{
+  if (streams_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(streamMutex_);
+  for (Connection_t& connection : connections_) {
+    if (connection.state != CONNECTION_STREAMING || connection.evict) {
+      continue;
+    }
+    char* buffer = connection.response.data_;
+    size_t space = HTTP_STREAM_BUFFER_SIZE - connection.pending;
+    int n = snprintf(buffer + connection.pending, space, "event: %s\ndata: %s\n\n", event, data);
+    if (n < 0 || (size_t)n >= space) {
+      // still has the earlier events, it doesn't keep up
+      connection.evict = true;
+      ++evicted_;
+      continue;
+    }
+    connection.pending += n;
+    flush(connection);
+  }
+}
+
+//------------------------------------------------------------------------------
+uint32_t HttpServer::getRequests()
+//------------------------------------------------------------------------------
+{
+  return requests_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t HttpServer::getConnections()
+//------------------------------------------------------------------------------
+{
+  return accepted_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t HttpServer::getTimeouts()
+//------------------------------------------------------------------------------
+{
+  return timeouts_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t HttpServer::getMaxConcurrent()
+//------------------------------------------------------------------------------
+{
+  return maxConcurrent_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t HttpServer::getReused()
+//------------------------------------------------------------------------------
+{
+  return reused_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t HttpServer::getStreams()
+//------------------------------------------------------------------------------
+{
+  return streams_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t HttpServer::getEvicted()
+//------------------------------------------------------------------------------
+{
+  return evicted_;
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::run()
+//------------------------------------------------------------------------------
+{
+  while (!stop_) {
+    fd_set readSet;
+    fd_set writeSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    int maxSocket = -1;
+    uint8_t active = 0;
+    bool reclaimable = false;
+    uint32_t now = millis();
+    for (Connection_t& connection : connections_) {
+      if (connection.state == CONNECTION_STREAMING) {
+        bool evict;
+        bool pending;
+        {
+          std::lock_guard<std::mutex> lock(streamMutex_);
+          evict = connection.evict;
+          pending = connection.pending > 0;
+        }
+        if (evict) {
+          closeConnection(connection);
+          continue;
+        }
+        // readable is the client closing the stream
+        FD_SET(connection.socket, &readSet);
+        if (pending) {
+          FD_SET(connection.socket, &writeSet);
+        }
+      } else if (connection.state != CONNECTION_FREE) {
+        FD_SET(connection.socket, connection.state == CONNECTION_READING ? &readSet : &writeSet);
+        reclaimable = reclaimable || isReclaimable(connection, now);
+      } else {
+        continue;
+      }
+      maxSocket = max(maxSocket, connection.socket);
+      ++active;
+    }
+    // with all slots busy, new clients wait in the backlog
+    if (active < HTTP_SERVER_MAX_CONNECTIONS || reclaimable) {
+      FD_SET(socket_, &readSet);
+      maxSocket = max(maxSocket, socket_);
+    }
+
+    // wake up regularly to see end() and the timeouts
+    struct timeval timeout = {0, 100000};
+    if (select(maxSocket + 1, &readSet, &writeSet, NULL, &timeout) > 0) {
+      for (Connection_t& connection : connections_) {
+        if (connection.state == CONNECTION_READING && FD_ISSET(connection.socket, &readSet)) {
+          receive(connection);
+        } else if (connection.state == CONNECTION_WRITING && FD_ISSET(connection.socket, &writeSet)) {
+          transmit(connection);
+          // the requests pipelined behind this one
+          serve(connection);
+        } else if (connection.state == CONNECTION_STREAMING && FD_ISSET(connection.socket, &readSet)) {
+          char discard[64];
+          ssize_t n = recv(connection.socket, discard, sizeof(discard), 0);
+          if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closeConnection(connection);
+          }
+        } else if (connection.state == CONNECTION_STREAMING && FD_ISSET(connection.socket, &writeSet)) {
+          std::lock_guard<std::mutex> lock(streamMutex_);
+          flush(connection);
+        }
+      }
+      if (FD_ISSET(socket_, &readSet)) {
+        acceptConnection();
+      }
+    }
+
+    now = millis();
+    for (Connection_t& connection : connections_) {
+      // a stream without events is fine, one that doesn't take them is evicted
+      if (connection.state == CONNECTION_FREE || connection.state == CONNECTION_STREAMING) {
+        continue;
+      }
+      if (isIdle(connection)) {
+        if (now - connection.lastActivity > HTTP_SERVER_KEEPALIVE_TIMEOUT_MS) {
+          closeConnection(connection);
+        }
+      } else if (now - connection.lastActivity > HTTP_SERVER_TIMEOUT_MS) {
+        ++timeouts_;
+        closeConnection(connection);
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::acceptConnection()
+//------------------------------------------------------------------------------
+{
+  Connection_t* slot = NULL;
+  Connection_t* idle = NULL;
+  uint8_t active = 1;
+  uint32_t now = millis();
+  for (Connection_t& connection : connections_) {
+    if (connection.state == CONNECTION_FREE) {
+      slot = slot ? slot : &connection;
+    } else {
+      ++active;
+      if (isReclaimable(connection, now) && (!idle || now - connection.lastActivity > now - idle->lastActivity)) {
+        idle = &connection;
+      }
+    }
+  }
+  if (!slot && idle) {
+    // the longest idle one, unless its next request is already there
+    char next;
+    if (recv(idle->socket, &next, 1, MSG_PEEK | MSG_DONTWAIT) > 0) {
+      return;
+    }
+    closeConnection(*idle);
+    slot = idle;
+    --active;
+  }
+  if (!slot) {
+    return;
+  }
+  int socket = ::accept(socket_, NULL, NULL);
+  if (socket < 0) {
+    return;
+  }
+  fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+  // head and a static body are two writes, the body must not wait for the ACK of the head
+  int one = 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  struct sockaddr_in local;
+  socklen_t localLength = sizeof(local);
+  slot->localAddress = getsockname(socket, (struct sockaddr*)&local, &localLength) == 0 ? local.sin_addr.s_addr : 0;
+
+  slot->state = CONNECTION_READING;
+  slot->socket = socket;
+  slot->lastActivity = millis();
+  slot->inputLength = 0;
+  slot->headerLength = 0;
+  slot->contentLength = 0;
+  slot->requests = 0;
+  slot->keepAlive = false;
+  slot->peerClosed = false;
+  slot->response.reset();
+  ++accepted_;
+  if (active > maxConcurrent_) {
+    maxConcurrent_ = active;
+  }
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::receive(Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  // one byte is kept for the NUL behind the data
+  ssize_t n = recv(connection.socket, connection.input + connection.inputLength, sizeof(connection.input) - 1 - connection.inputLength, 0);
+  if (n == 0 && connection.inputLength > 0) {
+    connection.peerClosed = true;
+    serve(connection);
+    return;
+  }
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    closeConnection(connection);
+    return;
+  }
+  if (n < 0) {
+    return;
+  }
+  connection.inputLength += n;
+  connection.input[connection.inputLength] = 0;
+  connection.lastActivity = millis();
+  serve(connection);
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::serve(Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  // the complete requests in the buffer, one after the other while the socket takes the responses
+  while (connection.state == CONNECTION_READING && connection.inputLength > 0) {
+    if (connection.headerLength == 0) {
+      char* end = strstr(connection.input, "\r\n\r\n");
+      if (!end) {
+        if (connection.inputLength >= sizeof(connection.input) - 1) {
+          fail(connection, 431);
+        }
+        break;
+      }
+      connection.headerLength = end + 4 - connection.input;
+      if (!connection.request.parse(connection.input, connection.headerLength)) {
+        fail(connection, 400);
+        return;
+      }
+      connection.contentLength = 0;
+      const char* contentLength = connection.request.getHeader("Content-Length");
+      if (contentLength) {
+        // digits only; strtoul alone would take a sign, skip garbage and saturate on overflow
+        char* end;
+        errno = 0;
+        unsigned long value = strtoul(contentLength, &end, 10);
+        while (*end == ' ' || *end == '\t') {
+          ++end;
+        }
+        if (!isdigit((unsigned char)*contentLength) || *end || errno == ERANGE) {
+          fail(connection, 400);
+          return;
+        }
+        // headerLength < sizeof(input) here, so the right side cannot wrap
+        if (value > sizeof(connection.input) - 1 - connection.headerLength) {
+          fail(connection, 413);
+          return;
+        }
+        connection.contentLength = value;
+      }
+    }
+    if (connection.inputLength < connection.headerLength + connection.contentLength) {
+      break;
+    }
+
+    dispatch(connection);
+    // usually the socket takes the whole response right away
+    transmit(connection);
+  }
+  // nothing more will come
+  if (connection.peerClosed && connection.state == CONNECTION_READING) {
+    closeConnection(connection);
+  }
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::dispatch(Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  HttpRequest& request = connection.request;
+  HttpResponse& response = connection.response;
+  request.bodyLength_ = connection.contentLength;
+  request.localAddress_ = connection.localAddress;
+  response.reset();
+
+  HttpHandler handler = NULL;
+  bool pathFound = false;
+  for (uint8_t i = 0; i < routeCount_ && !handler; ++i) {
+    const Route_t& route = routes_[i];
+    if (strcmp(route.path, request.getPath()) == 0) {
+      pathFound = true;
+      // HEAD is answered like GET, without the body
+      HttpMethod_t method = request.getMethod() == HTTP_METHOD_HEAD ? HTTP_METHOD_GET : request.getMethod();
+      if (route.method == HTTP_METHOD_ANY || route.method == method) {
+        handler = route.handler;
+      }
+    }
+  }
+
+  if (handler) {
+    handler(request, response);
+  } else if (pathFound) {
+    response.send(405, "text/plain", statusText(405));
+  } else if (notFound_) {
+    notFound_(request, response);
+  } else {
+    response.send(404, "text/plain", statusText(404));
+  }
+
+  if (response.stream_ && streams_ >= HTTP_SERVER_MAX_STREAMS) {
+    response.reset();
+    response.send(503, "text/plain", statusText(503));
+  }
+
+  // HTTP/1.1 keeps the connection unless told otherwise, 1.0 only when asked. A chunked body isn't
+  // understood, so where the next request begins isn't known.
+  const char* connectionHeader = request.getHeader("Connection");
+  if (request.http10_) {
+    response.keepAlive_ = connectionHeader && strncasecmp(connectionHeader, "keep-alive", 10) == 0;
+  } else {
+    response.keepAlive_ = !connectionHeader || strncasecmp(connectionHeader, "close", 5) != 0;
+  }
+  if (response.stream_ || request.getHeader("Transfer-Encoding") || connection.requests + 1 >= HTTP_SERVER_KEEPALIVE_MAX_REQUESTS) {
+    response.keepAlive_ = false;
+  }
+
+  bool headOnly = request.getMethod() == HTTP_METHOD_HEAD;
+  if (response.overflow_ || !response.finish(headOnly)) {
+    LOG.e("Response to %s too large", request.getPath());
+    response.reset();
+    response.send(500, "text/plain", statusText(500));
+    response.finish(false);
+  }
+  if (response.stream_) {
+    if (headOnly) {
+      response.stream_ = false;
+    } else {
+      ++streams_;
+    }
+  }
+  connection.state = CONNECTION_WRITING;
+  connection.sent = 0;
+  connection.keepAlive = response.keepAlive_;
+  if (connection.requests++ > 0) {
+    ++reused_;
+  }
+  ++requests_;
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::fail(Connection_t& connection, uint16_t status)
+//------------------------------------------------------------------------------
+{
+  HttpResponse& response = connection.response;
+  response.reset();
+  response.send(status, "text/plain", statusText(status));
+  response.finish(false);
+  connection.state = CONNECTION_WRITING;
+  connection.sent = 0;
+  // the rest of the input is not understood
+  connection.keepAlive = false;
+  transmit(connection);
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::transmit(Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  HttpResponse& response = connection.response;
+  // the head with a generated body, then a static body if any
+  size_t first = response.headLength_ + (response.staticBody_ ? 0 : response.bodyLength_);
+  size_t total = response.headLength_ + response.bodyLength_;
+  while (connection.sent < total) {
+    const uint8_t* data;
+    size_t length;
+    if (connection.sent < first) {
+      data = (const uint8_t*)response.data_ + response.start_ + connection.sent;
+      length = first - connection.sent;
+    } else {
+      data = response.staticBody_ + (connection.sent - first);
+      length = total - connection.sent;
+    }
+    ssize_t n = send(connection.socket, data, length, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        closeConnection(connection);
+      }
+      return;
+    }
+    connection.sent += n;
+    connection.lastActivity = millis();
+  }
+  if (response.stream_) {
+    // from now on publish() writes into the buffer
+    std::lock_guard<std::mutex> lock(streamMutex_);
+    connection.pending = 0;
+    connection.evict = false;
+    connection.state = CONNECTION_STREAMING;
+    return;
+  }
+  if (!connection.keepAlive) {
+    closeConnection(connection);
+    return;
+  }
+  // ready for the next request, a pipelined one may already be in the buffer
+  size_t used = connection.headerLength + connection.contentLength;
+  connection.inputLength -= used;
+  memmove(connection.input, connection.input + used, connection.inputLength);
+  connection.input[connection.inputLength] = 0;
+  connection.headerLength = 0;
+  connection.contentLength = 0;
+  connection.state = CONNECTION_READING;
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::flush(Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  // with streamMutex_ held
+  char* buffer = connection.response.data_;
+  while (connection.pending > 0) {
+    ssize_t n = send(connection.socket, buffer, connection.pending, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        connection.evict = true;
+      }
+      return;
+    }
+    memmove(buffer, buffer + n, connection.pending - n);
+    connection.pending -= n;
+    connection.lastActivity = millis();
+  }
+}
+
+//------------------------------------------------------------------------------
+void HttpServer::closeConnection(Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  if (connection.state == CONNECTION_FREE) {
+    return;
+  }
+  if (connection.response.stream_) {
+    --streams_;
+  }
+  std::lock_guard<std::mutex> lock(streamMutex_);
+  ::close(connection.socket);
+  connection.socket = -1;
+  connection.state = CONNECTION_FREE;
+}
+
+//------------------------------------------------------------------------------
+bool HttpServer::isIdle(const Connection_t& connection)
+//------------------------------------------------------------------------------
+{
+  return connection.state == CONNECTION_READING && connection.requests > 0 && connection.inputLength == 0;
+}
+
+//------------------------------------------------------------------------------
+bool HttpServer::isReclaimable(const Connection_t& connection, uint32_t now)
+//------------------------------------------------------------------------------
+{
+  return isIdle(connection) && now - connection.lastActivity >= HTTP_SERVER_KEEPALIVE_RECLAIM_MS;
+}
@@ -0,0 +1,276 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "util/logger.h"
+
+#ifndef HTTP_SERVER_PORT
+#define HTTP_SERVER_PORT 80
+#endif
+
+// connections served at the same time, each one holds a request and a response buffer
+#ifndef HTTP_SERVER_MAX_CONNECTIONS
+#define HTTP_SERVER_MAX_CONNECTIONS 4
+#endif
+
+#ifndef HTTP_SERVER_MAX_ROUTES
+#define HTTP_SERVER_MAX_ROUTES 16
+#endif
+
+// request line, headers and body
+#ifndef HTTP_REQUEST_BUFFER_SIZE
+#define HTTP_REQUEST_BUFFER_SIZE 1024
+#endif
+
+// longest URL of a redirect, with scheme and host
+#ifndef HTTP_LOCATION_SIZE
+#define HTTP_LOCATION_SIZE 160
+#endif
+
+// the headers added with addHeader(), a Location plus a few short ones
+#ifndef HTTP_RESPONSE_HEADERS_SIZE
+#define HTTP_RESPONSE_HEADERS_SIZE (HTTP_LOCATION_SIZE + 64)
+#endif
+
+// status line, the fixed headers (up to 128 bytes) and the added ones
+#ifndef HTTP_RESPONSE_HEAD_SIZE
+#define HTTP_RESPONSE_HEAD_SIZE (HTTP_RESPONSE_HEADERS_SIZE + 128)
+#endif
+
+// body of a generated response, static bodies are sent from where they are
+#ifndef HTTP_RESPONSE_BODY_SIZE
+#define HTTP_RESPONSE_BODY_SIZE 1536
+#endif
+
+// a connection without progress is closed, so a slow client can't hold a slot
+#ifndef HTTP_SERVER_TIMEOUT_MS
+#define HTTP_SERVER_TIMEOUT_MS 5000
+#endif
+
+// an idle persistent connection is closed after this, or earlier when its slot is needed for a new client
+#ifndef HTTP_SERVER_KEEPALIVE_TIMEOUT_MS
+#define HTTP_SERVER_KEEPALIVE_TIMEOUT_MS 5000
+#endif
+
+// idle at least this long before the slot goes to a new client, so a client between two requests keeps it
+#ifndef HTTP_SERVER_KEEPALIVE_RECLAIM_MS
+#define HTTP_SERVER_KEEPALIVE_RECLAIM_MS 100
+#endif
+
+// requests on one connection, the last one is answered with Connection: close
+#ifndef HTTP_SERVER_KEEPALIVE_MAX_REQUESTS
+#define HTTP_SERVER_KEEPALIVE_MAX_REQUESTS 100
+#endif
+
+// event streams at the same time, the other connections stay for requests
+#ifndef HTTP_SERVER_MAX_STREAMS
+#define HTTP_SERVER_MAX_STREAMS 2
+#endif
+
+// events not yet taken by a stream client, it is dropped when the next one doesn't fit.
+// Uses the response buffer of the connection.
+#ifndef HTTP_STREAM_BUFFER_SIZE
+#define HTTP_STREAM_BUFFER_SIZE 1024
+#endif
+
+#ifndef HTTP_SERVER_TASK_STACK_SIZE
+#define HTTP_SERVER_TASK_STACK_SIZE 4096
+#endif
+
+// same as the loop, they share the core by time slices
+#ifndef HTTP_SERVER_TASK_PRIORITY
+#define HTTP_SERVER_TASK_PRIORITY 1
+#endif
+
+// not HTTP_GET..., WebServer (http_parser.h) has these
+enum HttpMethod_t { HTTP_METHOD_ANY = 0, HTTP_METHOD_GET, HTTP_METHOD_HEAD, HTTP_METHOD_POST, HTTP_METHOD_PUT, HTTP_METHOD_OTHER };
+
+// A parsed request, pointing into the receive buffer of its connection. Only valid in the handler.
+class HttpRequest {
+ public:
+  HttpMethod_t getMethod();
+  // without the query
+  const char* getPath();
+  // after the '?', empty if none
+  const char* getQuery();
+  // NULL if missing, the name is case insensitive
+  const char* getHeader(const char* name);
+  const char* getBody();
+  size_t getBodyLength();
+  // of the interface the request came in on, network order
+  uint32_t getLocalAddress();
+
+ private:
+  friend class HttpServer;
+  bool parse(char* buffer, size_t headerLength);
+
+  HttpMethod_t method_;
+  const char* path_;
+  const char* query_;
+  const char* headers_;
+  const char* headersEnd_;
+  const char* body_;
+  size_t bodyLength_;
+  uint32_t localAddress_;
+  bool http10_;
+};
+
+// The response to a request. The body is either printed into the buffer of the connection or, for
+// constant data like assets in flash, only referenced. Content-Length is always set, except on 204, 304 and streams.
+class HttpResponse : public Print {
+ public:
+  void setStatus(uint16_t status);
+  // a literal, it is not copied
+  void setContentType(const char* contentType);
+  void addHeader(const char* name, const char* value);
+
+  // the whole response in one call
+  void send(uint16_t status, const char* contentType, const char* body);
+  void sendStatic(uint16_t status, const char* contentType, const uint8_t* body, size_t length);
+  void redirect(const char* location);
+  // keeps the connection open as server-sent event stream (text/event-stream), see HttpServer::publish().
+  // What the handler prints is sent right after the head.
+  void stream();
+
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+ private:
+  friend class HttpServer;
+  void reset();
+  // puts the head in front of the body, false if it doesn't fit
+  bool finish(bool headOnly);
+
+  uint16_t status_;
+  const char* contentType_;
+  bool overflow_;
+  bool stream_;
+  bool keepAlive_;
+  char headers_[HTTP_RESPONSE_HEADERS_SIZE];
+  size_t headersLength_;
+
+  // head and generated body are one block, the head ends where the body begins
+  char data_[HTTP_RESPONSE_HEAD_SIZE + HTTP_RESPONSE_BODY_SIZE];
+  size_t start_;
+  size_t headLength_;
+  const uint8_t* staticBody_;
+  size_t bodyLength_;
+};
+
+typedef void (*HttpHandler)(HttpRequest& request, HttpResponse& response);
+
+// Event driven HTTP/1.1 server. One task waits in select() for all connections at once and reads and
+// writes only what the sockets take without blocking, so a slow client delays nobody, neither the other
+// clients nor the loop. Requests are answered by handlers that run in this task, they must not block and
+// must only touch thread safe state. No heap, the buffers of all connections are part of the object.
+// Routes are registered before begin().
+// Connections are persistent (HTTP/1.1 keep-alive) and pipelined requests are answered in order. The pool
+// stays bounded: a connection idle for a while gives its slot to a new client when all slots are taken.
+// Event streams (server-sent events) are fed by publish() from any task. Each stream has a fixed buffer,
+// a client that doesn't take its events fast enough is dropped instead of holding up the publisher.
+class HttpServer {
+ public:
+  HttpServer();
+  ~HttpServer();
+
+  bool on(const char* path, HttpHandler handler);
+  bool on(const char* path, HttpMethod_t method, HttpHandler handler);
+  void onNotFound(HttpHandler handler);
+
+  bool begin(uint16_t port = HTTP_SERVER_PORT);
+  void end();
+  bool isRunning();
+
+  // to all streams, data is one line (JSON). Doesn't block, sends what the sockets take right away.
+  void publish(const char* event, const char* data);
+
+  uint32_t getRequests();
+  uint32_t getConnections();
+  // closed for running into HTTP_SERVER_TIMEOUT_MS
+  uint32_t getTimeouts();
+  uint8_t getMaxConcurrent();
+  // requests on a connection that served one before, saved a TCP handshake
+  uint32_t getReused();
+  uint8_t getStreams();
+  // streams dropped for not keeping up
+  uint32_t getEvicted();
+
+ private:
+  enum ConnectionState_t { CONNECTION_FREE, CONNECTION_READING, CONNECTION_WRITING, CONNECTION_STREAMING };
+  struct Route_t {
+    const char* path;
+    HttpMethod_t method;
+    HttpHandler handler;
+  };
+  struct Connection_t {
+    ConnectionState_t state;
+    int socket;
+    uint32_t lastActivity;
+    uint32_t localAddress;
+    char input[HTTP_REQUEST_BUFFER_SIZE];
+    size_t inputLength;
+    size_t headerLength;  // 0 until the head is complete
+    size_t contentLength;
+    HttpRequest request;
+    HttpResponse response;
+    size_t sent;
+    uint16_t requests;  // answered on this connection
+    bool keepAlive;     // for the response being sent
+    bool peerClosed;    // the client sent all it will, the pipelined requests are still answered
+    // streaming: the events not sent yet are at the beginning of response.data_
+    size_t pending;
+    bool evict;
+  };
+
+  void run();
+  void acceptConnection();
+  void receive(Connection_t& connection);
+  void serve(Connection_t& connection);
+  void transmit(Connection_t& connection);
+  void dispatch(Connection_t& connection);
+  void fail(Connection_t& connection, uint16_t status);
+  void flush(Connection_t& connection);
+  void closeConnection(Connection_t& connection);
+  // persistent, waiting for the next request
+  static bool isIdle(const Connection_t& connection);
+  static bool isReclaimable(const Connection_t& connection, uint32_t now);
+
+  Logger LOG;
+  Route_t routes_[HTTP_SERVER_MAX_ROUTES];
+  uint8_t routeCount_;
+  HttpHandler notFound_;
+  Connection_t connections_[HTTP_SERVER_MAX_CONNECTIONS];
+  int socket_;
+  std::thread task_;
+  std::atomic<bool> stop_;
+  std::atomic<uint32_t> requests_;
+  std::atomic<uint32_t> accepted_;
+  std::atomic<uint32_t> timeouts_;
+  std::atomic<uint8_t> maxConcurrent_;
+  std::atomic<uint32_t> reused_;
+  // the state of streaming connections and their buffers, publish() runs in other tasks
+  std::mutex streamMutex_;
+  std::atomic<uint8_t> streams_;
+  std::atomic<uint32_t> evicted_;
+};
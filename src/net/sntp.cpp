@@ -0,0 +1,634 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/sntp.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+// seconds from 1900 (NTP) to 1970 (unix)
+#define NTP_UNIX_OFFSET 2208988800LL
+
+#define NTP_PACKET_SIZE 48
+#define NTP_MODE_CLIENT 3
+#define NTP_MODE_SERVER 4
+#define NTP_VERSION 4
+#define NTP_LI_ALARM 3
+
+// how fast the error bound of a sample grows with its age, in µs per s (15 ppm as in NTP)
+#define SNTP_AGING_PPM 15
+
+//------------------------------------------------------------------------------
+static uint32_t readU32(const uint8_t* p)
+//------------------------------------------------------------------------------
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//------------------------------------------------------------------------------
+static void writeU32(uint8_t* p, uint32_t value)
+//------------------------------------------------------------------------------
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+//------------------------------------------------------------------------------
+SntpClient::SntpClient(Clock& clock, ClockDiscipline& discipline)
+    : LOG("SNTP"),
+      clock_(clock),
+      discipline_(discipline),
+      serverCount_(0),
+      socket_(-1),
+      nextPoll_(0),
+      sentAt_(0),
+      fresh_(false),
+      synced_(false),
+      stratum_(0),
+      referenceId_(0),
+      rootDelay_(0),
+      rounds_(0),
+      syncCallback_(NULL),
+      resolving_(false)
+//------------------------------------------------------------------------------
+{
+  for (uint8_t i = 0; i < SNTP_MAX_SERVERS; ++i) {
+    resolved_[i] = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+SntpClient::~SntpClient()
+//------------------------------------------------------------------------------
+{
+  end();
+}
+
+//------------------------------------------------------------------------------
+bool SntpClient::addServer(const char* host, uint16_t port)
+//------------------------------------------------------------------------------
+{
+  if (serverCount_ >= SNTP_MAX_SERVERS) {
+    LOG.e("Too many servers, %s ignored", host);
+    return false;
+  }
+
+  Server_t& server = servers_[serverCount_++];
+  server.host = host;
+  server.port = port;
+  server.address = 0;
+  server.pending = false;
+  server.t1 = 0;
+  server.origin.seconds = 0;
+  server.origin.fraction = 0;
+  server.samples = 0;
+  server.distance = 0;
+  memset(&server.stats, 0, sizeof(server.stats));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool SntpClient::begin()
+//------------------------------------------------------------------------------
+{
+  end();
+
+  socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_ < 0) {
+    LOG.e("No socket");
+    return false;
+  }
+  fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL, 0) | O_NONBLOCK);
+
+  // first poll right away
+  nextPoll_ = clock_.monotonic();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::end()
+//------------------------------------------------------------------------------
+{
+  if (socket_ >= 0) {
+    close(socket_);
+    socket_ = -1;
+  }
+  sentAt_ = 0;
+  // a lookup in progress is waited for
+  if (resolver_.joinable()) {
+    resolver_.join();
+  }
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::loop()
+//------------------------------------------------------------------------------
+{
+  if (socket_ < 0) {
+    return;
+  }
+
+  if (sentAt_) {
+    receive();
+
+    bool pending = false;
+    for (uint8_t i = 0; i < serverCount_; ++i) {
+      pending |= servers_[i].pending;
+    }
+    if (!pending || clock_.monotonic() - sentAt_ > SNTP_TIMEOUT_MS * 1000LL) {
+      finishRound();
+    }
+  } else if (clock_.monotonic() - nextPoll_ >= 0) {
+    send();
+  }
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::onSync(SyncCallback cb)
+//------------------------------------------------------------------------------
+{
+  syncCallback_ = cb;
+}
+
+//------------------------------------------------------------------------------
+bool SntpClient::isSynced()
+//------------------------------------------------------------------------------
+{
+  return synced_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t SntpClient::getStratum()
+//------------------------------------------------------------------------------
+{
+  return stratum_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t SntpClient::getReferenceId()
+//------------------------------------------------------------------------------
+{
+  return referenceId_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t SntpClient::getRootDelay()
+//------------------------------------------------------------------------------
+{
+  return rootDelay_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t SntpClient::getServerCount()
+//------------------------------------------------------------------------------
+{
+  return serverCount_;
+}
+
+//------------------------------------------------------------------------------
+const char* SntpClient::getServerName(uint8_t index)
+//------------------------------------------------------------------------------
+{
+  return index < serverCount_ ? servers_[index].host.c_str() : NULL;
+}
+
+//------------------------------------------------------------------------------
+SntpServerStats_t SntpClient::getServerStats(uint8_t index)
+//------------------------------------------------------------------------------
+{
+  return servers_[index].stats;
+}
+
+//------------------------------------------------------------------------------
+uint32_t SntpClient::getRounds()
+//------------------------------------------------------------------------------
+{
+  return rounds_;
+}
+
+//------------------------------------------------------------------------------
+int64_t SntpClient::toMicros(const NtpTimestamp_t& timestamp)
+//------------------------------------------------------------------------------
+{
+  // era 0 ends 2036-02-07, small values are in era 1
+  int64_t seconds = timestamp.seconds;
+  if (seconds < 0x80000000LL) {
+    seconds += 0x100000000LL;
+  }
+  return (seconds - NTP_UNIX_OFFSET) * 1000000LL + (((uint64_t)timestamp.fraction * 1000000ULL) >> 32);
+}
+
+//------------------------------------------------------------------------------
+NtpTimestamp_t SntpClient::fromMicros(int64_t utc)
+//------------------------------------------------------------------------------
+{
+  NtpTimestamp_t timestamp;
+  timestamp.seconds = (uint32_t)(utc / 1000000 + NTP_UNIX_OFFSET);
+  timestamp.fraction = (uint32_t)((((uint64_t)(utc % 1000000)) << 32) / 1000000);
+  return timestamp;
+}
+
+//------------------------------------------------------------------------------
+uint8_t SntpClient::takeResolved()
+//------------------------------------------------------------------------------
+{
+  // the servers still without address, as bit mask
+  uint8_t unresolved = 0;
+  for (uint8_t i = 0; i < serverCount_; ++i) {
+    Server_t& server = servers_[i];
+    if (!server.address) {
+      server.address = resolved_[i].exchange(0);
+    }
+    if (!server.address) {
+      unresolved |= 1 << i;
+    }
+  }
+  return unresolved;
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::startResolve(uint8_t servers)
+//------------------------------------------------------------------------------
+{
+  if (resolving_) {
+    return;
+  }
+  if (resolver_.joinable()) {
+    resolver_.join();
+  }
+
+#ifdef ESP_PLATFORM
+  esp_pthread_cfg_t cfg = {};
+  cfg.stack_size = SNTP_RESOLVE_TASK_STACK_SIZE;
+  cfg.prio = SNTP_RESOLVE_TASK_PRIORITY;
+  esp_pthread_set_cfg(&cfg);
+#endif
+
+  resolving_ = true;
+  resolver_ = std::thread(&SntpClient::resolve, this, servers);
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::resolve(uint8_t servers)
+//------------------------------------------------------------------------------
+{
+  // resolver task, the host names are not changed after addServer()
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  for (uint8_t i = 0; i < serverCount_; ++i) {
+    if (!(servers & (1 << i))) {
+      continue;
+    }
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(servers_[i].host.c_str(), NULL, &hints, &result) != 0 || !result) {
+      LOG.w("Could not resolve %s", servers_[i].host.c_str());
+      continue;
+    }
+    resolved_[i] = ((struct sockaddr_in*)result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+  }
+  resolving_ = false;
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::send()
+//------------------------------------------------------------------------------
+{
+  // the loop never waits for DNS: a round goes to the servers with an address, the others are looked up
+  // in the meantime and join a later round
+  uint8_t unresolved = takeResolved();
+  if (serverCount_ && unresolved == (1 << serverCount_) - 1) {
+    if (resolving_) {
+      return;
+    }
+    if (resolver_.joinable()) {
+      // looked up and nothing found, no DNS or no internet
+      resolver_.join();
+      LOG.w("No server resolved");
+      nextPoll_ = clock_.monotonic() + SNTP_RETRY_S * 1000000LL;
+      return;
+    }
+    startResolve(unresolved);
+    return;
+  }
+  if (unresolved) {
+    startResolve(unresolved);
+  }
+
+  // drop late answers of the previous round
+  uint8_t packet[NTP_PACKET_SIZE];
+  while (recv(socket_, packet, sizeof(packet), 0) > 0) {
+  }
+
+  fresh_ = false;
+  sentAt_ = clock_.monotonic();
+  for (uint8_t i = 0; i < serverCount_; ++i) {
+    Server_t& server = servers_[i];
+    server.stats.reach <<= 1;
+    server.pending = false;
+    if (!server.address) {
+      continue;
+    }
+
+    memset(packet, 0, sizeof(packet));
+    packet[0] = (NTP_VERSION << 3) | NTP_MODE_CLIENT;
+
+    // the transmit timestamp comes back as origin, it identifies the answer. Before the first sync
+    // it is taken from the monotonic clock instead of the unset one, so it still differs per request.
+    server.t1 = clock_.now();
+    server.origin = fromMicros(clock_.isSet() ? server.t1 : clock_.monotonic() + i);
+    writeU32(packet + 40, server.origin.seconds);
+    writeU32(packet + 44, server.origin.fraction);
+
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons(server.port);
+    to.sin_addr.s_addr = server.address;
+
+    ++server.stats.requests;
+    if (sendto(socket_, packet, sizeof(packet), 0, (struct sockaddr*)&to, sizeof(to)) == sizeof(packet)) {
+      server.pending = true;
+    } else {
+      LOG.w("Send to %s failed", server.host.c_str());
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::receive()
+//------------------------------------------------------------------------------
+{
+  uint8_t packet[NTP_PACKET_SIZE];
+  struct sockaddr_in from;
+
+  while (true) {
+    socklen_t fromLength = sizeof(from);
+    int n = recvfrom(socket_, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLength);
+    // as early as possible, everything before is part of the measured delay
+    int64_t t4 = clock_.now();
+    int64_t monotonic = clock_.monotonic();
+    if (n < 0) {
+      return;
+    }
+    if (n < NTP_PACKET_SIZE) {
+      continue;
+    }
+
+    Server_t* server = NULL;
+    for (uint8_t i = 0; i < serverCount_; ++i) {
+      Server_t& candidate = servers_[i];
+      if (candidate.pending && candidate.address == from.sin_addr.s_addr && readU32(packet + 24) == candidate.origin.seconds &&
+          readU32(packet + 28) == candidate.origin.fraction) {
+        server = &candidate;
+        break;
+      }
+    }
+    if (!server || (packet[0] & 0x07) != NTP_MODE_SERVER) {
+      // not the answer to one of our requests
+      continue;
+    }
+    server->pending = false;
+
+    uint8_t leap = packet[0] >> 6;
+    uint8_t stratum = packet[1];
+    server->stats.stratum = stratum;
+    if (leap == NTP_LI_ALARM || stratum == 0 || stratum > 15) {
+      // unsynchronized server or kiss-o'-death
+      LOG.w("Server %s not usable, stratum %u", server->host.c_str(), stratum);
+      continue;
+    }
+
+    NtpTimestamp_t received = {readU32(packet + 32), readU32(packet + 36)};
+    NtpTimestamp_t transmitted = {readU32(packet + 40), readU32(packet + 44)};
+    int64_t t2 = toMicros(received);
+    int64_t t3 = toMicros(transmitted);
+    int64_t t1 = server->t1;
+    if (!clock_.isSet()) {
+      // t1 and t4 from the monotonic clock, the unset clock counts as reading it (see Clock::adjust). The
+      // offset is then the same whenever it is applied, and samples of earlier rounds still fit.
+      t1 = sentAt_;
+      t4 = monotonic;
+    }
+
+    // shift register, newest first
+    memmove(server->filter + 1, server->filter, sizeof(Sample_t) * (SNTP_FILTER_SIZE - 1));
+    server->filter[0].offset = ((t2 - t1) + (t3 - t4)) / 2;
+    server->filter[0].delay = (t4 - t1) - (t3 - t2);
+    server->filter[0].time = monotonic;
+    server->samples = min(server->samples + 1, SNTP_FILTER_SIZE);
+    server->stats.reach |= 1;
+    ++server->stats.answers;
+    fresh_ = true;
+  }
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::finishRound()
+//------------------------------------------------------------------------------
+{
+  sentAt_ = 0;
+  ++rounds_;
+
+  Server_t* candidates[SNTP_MAX_SERVERS];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < serverCount_; ++i) {
+    Server_t& server = servers_[i];
+    server.stats.selected = false;
+    if (!server.stats.reach) {
+      // nothing heard for 8 polls, the pool may have moved on
+      server.address = 0;
+    }
+    if (server.stats.reach && clockFilter(server)) {
+      candidates[count++] = &server;
+    }
+  }
+
+  if (!fresh_ || !count) {
+    nextPoll_ = clock_.monotonic() + SNTP_RETRY_S * 1000000LL;
+    return;
+  }
+
+  count = select(candidates, count);
+  if (!count) {
+    LOG.w("No majority among the servers");
+    nextPoll_ = clock_.monotonic() + SNTP_RETRY_S * 1000000LL;
+    return;
+  }
+
+  // combine the survivors, weighted by their error bound
+  double weights = 0;
+  double offset = 0;
+  Server_t* best = candidates[0];
+  for (uint8_t i = 0; i < count; ++i) {
+    Server_t* server = candidates[i];
+    server->stats.selected = true;
+    double weight = 1.0 / max(server->distance, (int64_t)1);
+    weights += weight;
+    offset += weight * server->stats.offset;
+    if (server->distance < best->distance) {
+      best = server;
+    }
+  }
+
+  bool wasSet = clock_.isSet();
+  int64_t correction = (int64_t)(offset / weights);
+  if (discipline_.sample(correction, best->stats.delay)) {
+    if (!wasSet || correction > CLOCK_STEP_THRESHOLD_US || correction < -CLOCK_STEP_THRESHOLD_US) {
+      // stepped, the old samples don't fit anymore
+      for (uint8_t i = 0; i < serverCount_; ++i) {
+        servers_[i].samples = 0;
+      }
+    } else {
+      shiftFilters(correction);
+    }
+  }
+  stratum_ = best->stats.stratum;
+  referenceId_ = best->address;
+  rootDelay_ = best->stats.delay;
+  synced_ = true;
+
+  nextPoll_ = clock_.monotonic() + (int64_t)discipline_.getPollInterval() * 1000000LL;
+  if (syncCallback_) {
+    syncCallback_();
+  }
+}
+
+//------------------------------------------------------------------------------
+bool SntpClient::clockFilter(Server_t& server)
+//------------------------------------------------------------------------------
+{
+  if (!server.samples) {
+    return false;
+  }
+
+  // the sample with the least error bound: half the round trip, growing with age
+  int64_t monotonic = clock_.monotonic();
+  uint8_t samples = 1;
+  while (samples < server.samples && monotonic - server.filter[samples].time < SNTP_FILTER_MAX_AGE_S * 1000000LL) {
+    ++samples;
+  }
+
+  int8_t picked = -1;
+  for (uint8_t i = 0; i < samples; ++i) {
+    const Sample_t& sample = server.filter[i];
+    int64_t distance = sample.delay / 2 + (monotonic - sample.time) * SNTP_AGING_PPM / 1000000;
+    if (picked < 0 || distance < server.distance) {
+      picked = i;
+      server.distance = distance;
+    }
+  }
+
+  const Sample_t& sample = server.filter[picked];
+  double squares = 0;
+  for (uint8_t i = 0; i < samples; ++i) {
+    double difference = (double)(server.filter[i].offset - sample.offset);
+    squares += difference * difference;
+  }
+  server.stats.offset = sample.offset;
+  server.stats.delay = sample.delay;
+  server.stats.jitter = samples > 1 ? (int64_t)sqrt(squares / (samples - 1)) : 0;
+  server.distance += server.stats.jitter;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+uint8_t SntpClient::select(Server_t** candidates, uint8_t count)
+//------------------------------------------------------------------------------
+{
+  // Marzullo: find the point covered by most of the intervals [offset - distance, offset + distance]
+  struct Edge_t {
+    int64_t value;
+    int8_t type;  // -1 lower, +1 upper end, so lower ends sort first on a tie
+  };
+  Edge_t edges[2 * SNTP_MAX_SERVERS];
+  uint8_t edgeCount = 0;
+  for (uint8_t i = 0; i < count; ++i) {
+    edges[edgeCount++] = {candidates[i]->stats.offset - candidates[i]->distance, -1};
+    edges[edgeCount++] = {candidates[i]->stats.offset + candidates[i]->distance, +1};
+  }
+  for (uint8_t i = 1; i < edgeCount; ++i) {
+    Edge_t edge = edges[i];
+    uint8_t j = i;
+    for (; j > 0 && (edges[j - 1].value > edge.value || (edges[j - 1].value == edge.value && edges[j - 1].type > edge.type)); --j) {
+      edges[j] = edges[j - 1];
+    }
+    edges[j] = edge;
+  }
+
+  uint8_t covered = 0;
+  uint8_t most = 0;
+  int64_t point = 0;
+  for (uint8_t i = 0; i < edgeCount; ++i) {
+    if (edges[i].type < 0) {
+      if (++covered > most) {
+        most = covered;
+        point = edges[i].value;
+      }
+    } else {
+      --covered;
+    }
+  }
+
+  if (most * 2 <= count) {
+    if (count >= 3) {
+      return 0;
+    }
+    // two servers that disagree, nothing to vote with: trust the more precise one
+    Server_t* best = candidates[0]->distance <= candidates[count - 1]->distance ? candidates[0] : candidates[count - 1];
+    candidates[0] = best;
+    return 1;
+  }
+
+  // the survivors are the intervals containing the point, the others are falsetickers
+  static LogLimit falsetickerLimit(3, 60000);
+  uint8_t survivors = 0;
+  for (uint8_t i = 0; i < count; ++i) {
+    Server_t* server = candidates[i];
+    if (server->stats.offset - server->distance <= point && point <= server->stats.offset + server->distance) {
+      candidates[survivors++] = server;
+    } else {
+      LOG.w(falsetickerLimit, "Falseticker %s, offset %" PRId64 "µs", server->host.c_str(), server->stats.offset);
+    }
+  }
+  return survivors;
+}
+
+//------------------------------------------------------------------------------
+void SntpClient::shiftFilters(int64_t correction)
+//------------------------------------------------------------------------------
+{
+  // the clock moves by the correction, the stored offsets were measured against the old one
+  for (uint8_t i = 0; i < serverCount_; ++i) {
+    for (uint8_t j = 0; j < servers_[i].samples; ++j) {
+      servers_[i].filter[j].offset -= correction;
+    }
+  }
+}
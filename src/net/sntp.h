@@ -0,0 +1,165 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <thread>
+
+#include "time/clock.h"
+#include "time/discipline.h"
+#include "util/logger.h"
+
+#ifndef SNTP_PORT
+#define SNTP_PORT 123
+#endif
+
+#ifndef SNTP_MAX_SERVERS
+#define SNTP_MAX_SERVERS 4
+#endif
+
+// Samples per server the clock filter picks from
+#ifndef SNTP_FILTER_SIZE
+#define SNTP_FILTER_SIZE 8
+#endif
+
+// Older samples are stale, the rate error since then is unknown. The newest sample is always used.
+#ifndef SNTP_FILTER_MAX_AGE_S
+#define SNTP_FILTER_MAX_AGE_S 3600
+#endif
+
+// Give up on missing answers after this
+#ifndef SNTP_TIMEOUT_MS
+#define SNTP_TIMEOUT_MS 2000
+#endif
+
+// Retry interval after a round without answers
+#ifndef SNTP_RETRY_S
+#define SNTP_RETRY_S 16
+#endif
+
+// The names are looked up in a short lived task, without internet a lookup blocks for seconds
+#ifndef SNTP_RESOLVE_TASK_STACK_SIZE
+#define SNTP_RESOLVE_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef SNTP_RESOLVE_TASK_PRIORITY
+#define SNTP_RESOLVE_TASK_PRIORITY 1
+#endif
+
+// NTP timestamp: seconds since 1900 and 2^-32 fractions
+struct NtpTimestamp_t {
+  uint32_t seconds;
+  uint32_t fraction;
+};
+
+struct SntpServerStats_t {
+  int64_t offset;  // µs, of the sample picked by the clock filter
+  int64_t delay;   // µs
+  int64_t jitter;  // µs, rms of the other samples against the picked one
+  uint8_t stratum;
+  uint8_t reach;  // one bit per poll, newest in bit 0
+  bool selected;  // survived the selection of the last round
+  uint32_t requests;
+  uint32_t answers;
+};
+
+// Non-blocking SNTP client (RFC 4330) on a plain UDP socket, so it runs on the device and on the host.
+// All servers are queried in parallel. Per server a clock filter picks the sample with the least
+// delay (plus aging) out of the last SNTP_FILTER_SIZE. The selection keeps the servers whose
+// error intervals intersect with the majority, so falsetickers are dropped, and the survivors are
+// combined weighted by their error. The combined offset goes to the ClockDiscipline, which also
+// decides on the next poll.
+class SntpClient {
+ public:
+  typedef void (*SyncCallback)();
+
+  SntpClient(Clock& clock, ClockDiscipline& discipline);
+  ~SntpClient();
+
+  bool addServer(const char* host, uint16_t port = SNTP_PORT);
+  bool begin();
+  void end();
+  void loop();
+
+  void onSync(SyncCallback cb);
+  bool isSynced();
+  // of the best selected server (the system peer), for serving time on. Thread safe.
+  uint8_t getStratum();
+  uint32_t getReferenceId();  // IPv4 address, network order
+  uint32_t getRootDelay();    // µs
+  uint8_t getServerCount();
+  const char* getServerName(uint8_t index);
+  SntpServerStats_t getServerStats(uint8_t index);
+  uint32_t getRounds();
+
+  static int64_t toMicros(const NtpTimestamp_t& timestamp);
+  static NtpTimestamp_t fromMicros(int64_t utc);
+
+ private:
+  struct Sample_t {
+    int64_t offset;
+    int64_t delay;
+    int64_t time;  // monotonic
+  };
+
+  struct Server_t {
+    String host;
+    uint16_t port;
+    uint32_t address;  // network order, 0 if not resolved
+    bool pending;
+    int64_t t1;  // utc of the request
+    NtpTimestamp_t origin;
+    Sample_t filter[SNTP_FILTER_SIZE];
+    uint8_t samples;
+    int64_t distance;  // error bound of the picked sample, for the selection
+    SntpServerStats_t stats;
+  };
+
+  uint8_t takeResolved();
+  void startResolve(uint8_t servers);
+  void resolve(uint8_t servers);
+  void send();
+  void receive();
+  void finishRound();
+  bool clockFilter(Server_t& server);
+  uint8_t select(Server_t** candidates, uint8_t count);
+  void shiftFilters(int64_t correction);
+
+  Logger LOG;
+  Clock& clock_;
+  ClockDiscipline& discipline_;
+  Server_t servers_[SNTP_MAX_SERVERS];
+  uint8_t serverCount_;
+  int socket_;
+  int64_t nextPoll_;  // monotonic
+  int64_t sentAt_;    // monotonic, 0 if no round pending
+  bool fresh_;        // a new sample arrived in this round
+  std::atomic<bool> synced_;
+  std::atomic<uint8_t> stratum_;
+  std::atomic<uint32_t> referenceId_;
+  std::atomic<uint32_t> rootDelay_;
+  uint32_t rounds_;
+  SyncCallback syncCallback_;
+
+  // the lookups of resolve(), taken over by send()
+  std::thread resolver_;
+  std::atomic<bool> resolving_;
+  std::atomic<uint32_t> resolved_[SNTP_MAX_SERVERS];
+};
@@ -0,0 +1,205 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/sntpserver.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+#define NTP_PACKET_SIZE 48
+#define NTP_MODE_CLIENT 3
+#define NTP_MODE_SERVER 4
+#define NTP_PRECISION -20  // ~1µs, the resolution of the monotonic counter
+// how fast the error bound grows since the last sync, in µs per s (15 ppm as in NTP)
+#define NTP_AGING_PPM 15
+
+//------------------------------------------------------------------------------
+static void writeU32(uint8_t* p, uint32_t value)
+//------------------------------------------------------------------------------
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+//------------------------------------------------------------------------------
+static void writeTimestamp(uint8_t* p, int64_t utc)
+//------------------------------------------------------------------------------
+{
+  NtpTimestamp_t timestamp = SntpClient::fromMicros(utc);
+  writeU32(p, timestamp.seconds);
+  writeU32(p + 4, timestamp.fraction);
+}
+
+//------------------------------------------------------------------------------
+static uint32_t toShortFormat(uint32_t us)
+//------------------------------------------------------------------------------
+{
+  // NTP short format: 16.16 fixed point seconds
+  return ((uint64_t)us << 16) / 1000000;
+}
+
+//------------------------------------------------------------------------------
+SntpServer::SntpServer(Clock& clock, SntpClient& upstream, Statistic& statistic)
+    : LOG("SntpServer"),
+      clock_(clock),
+      upstream_(upstream),
+      statistic_(statistic),
+      socket_(-1),
+      stop_(false),
+      servedCounter_(-1),
+      unsyncedCounter_(-1),
+      invalidCounter_(-1)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+SntpServer::~SntpServer()
+//------------------------------------------------------------------------------
+{
+  end();
+}
+
+//------------------------------------------------------------------------------
+bool SntpServer::begin(uint16_t port)
+//------------------------------------------------------------------------------
+{
+  if (isRunning()) {
+    return true;
+  }
+  if (servedCounter_ < 0) {
+    servedCounter_ = statistic_.addCounter("NTP served");
+    unsyncedCounter_ = statistic_.addCounter("NTP not synced, dropped");
+    invalidCounter_ = statistic_.addCounter("NTP invalid, dropped");
+  }
+
+  socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (socket_ < 0 || bind(socket_, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    LOG.e("Could not bind UDP port %u", port);
+    if (socket_ >= 0) {
+      close(socket_);
+      socket_ = -1;
+    }
+    return false;
+  }
+  // wake up regularly to see end()
+  struct timeval timeout = {0, 500000};
+  setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+#ifdef ESP_PLATFORM
+  esp_pthread_cfg_t cfg = {};
+  cfg.stack_size = SNTP_SERVER_TASK_STACK_SIZE;
+  cfg.prio = SNTP_SERVER_TASK_PRIORITY;
+  esp_pthread_set_cfg(&cfg);
+#endif
+
+  stop_ = false;
+  task_ = std::thread(&SntpServer::run, this);
+  LOG.i("Serving time on UDP %u", port);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void SntpServer::end()
+//------------------------------------------------------------------------------
+{
+  if (!isRunning()) {
+    return;
+  }
+  stop_ = true;
+  task_.join();
+  close(socket_);
+  socket_ = -1;
+  LOG.i("Stopped");
+}
+
+//------------------------------------------------------------------------------
+bool SntpServer::isRunning()
+//------------------------------------------------------------------------------
+{
+  return task_.joinable();
+}
+
+//------------------------------------------------------------------------------
+void SntpServer::run()
+//------------------------------------------------------------------------------
+{
+  uint8_t packet[NTP_PACKET_SIZE];
+  struct sockaddr_in from;
+  while (!stop_) {
+    socklen_t fromLength = sizeof(from);
+    ssize_t n = recvfrom(socket_, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLength);
+    // as close to the arrival as we get without driver timestamps
+    int64_t arrival = clock_.monotonic();
+    if (n < 0) {
+      continue;
+    }
+    if (n < NTP_PACKET_SIZE || (packet[0] & 0x07) != NTP_MODE_CLIENT) {
+      statistic_.count(invalidCounter_);
+      continue;
+    }
+    if (!answer(packet, arrival)) {
+      statistic_.count(unsyncedCounter_);
+      continue;
+    }
+    // the transmit timestamp is the last thing written before the packet leaves
+    writeTimestamp(packet + 40, clock_.now());
+    sendto(socket_, packet, NTP_PACKET_SIZE, 0, (struct sockaddr*)&from, fromLength);
+    statistic_.count(servedCounter_);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool SntpServer::answer(uint8_t* packet, int64_t arrival)
+//------------------------------------------------------------------------------
+{
+  // a server that isn't synced is worse than none, the client asks another one
+  uint8_t stratum = upstream_.getStratum();
+  if (!upstream_.isSynced() || !clock_.isSet() || stratum == 0 || stratum >= 15) {
+    return false;
+  }
+  int64_t received = clock_.toUtc(arrival);
+  int64_t lastSync = clock_.getLastSync();
+  uint64_t sinceSync = max(received - lastSync, (int64_t)0) / 1000000;
+  // network order already
+  uint32_t referenceId = upstream_.getReferenceId();
+
+  // origin = the client's transmit timestamp
+  memcpy(packet + 24, packet + 40, 8);
+  uint8_t version = (packet[0] >> 3) & 0x07;
+  packet[0] = (0 << 6) | (version << 3) | NTP_MODE_SERVER;  // no leap second warning
+  packet[1] = stratum + 1;
+  // poll stays the client's
+  packet[3] = (uint8_t)NTP_PRECISION;
+  writeU32(packet + 4, toShortFormat(upstream_.getRootDelay()));
+  writeU32(packet + 8, toShortFormat(min(sinceSync * NTP_AGING_PPM, (uint64_t)16000000)));
+  memcpy(packet + 12, &referenceId, 4);
+  writeTimestamp(packet + 16, lastSync);
+  writeTimestamp(packet + 32, received);
+  return true;
+}
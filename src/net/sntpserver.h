@@ -0,0 +1,67 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <thread>
+
+#include "net/sntp.h"
+#include "statistic.h"
+#include "time/clock.h"
+#include "util/logger.h"
+
+#ifndef SNTP_SERVER_TASK_STACK_SIZE
+#define SNTP_SERVER_TASK_STACK_SIZE 3072
+#endif
+
+// above the loop, an answer is a few µs of work and its latency is part of the served time
+#ifndef SNTP_SERVER_TASK_PRIORITY
+#define SNTP_SERVER_TASK_PRIORITY 5
+#endif
+
+// Answers SNTP requests from the LAN with the time of our disciplined clock, one stratum below the
+// upstream servers of the SntpClient. Nothing is answered until the client is synced.
+// Runs in its own task, blocking in recvfrom(). The arrival is read from the monotonic counter right
+// after recvfrom() returns and converted to UTC afterwards, the transmit timestamp is taken right before
+// sendto(). No heap, the packet is answered in place.
+class SntpServer {
+ public:
+  SntpServer(Clock& clock, SntpClient& upstream, Statistic& statistic);
+  ~SntpServer();
+
+  bool begin(uint16_t port = SNTP_PORT);
+  void end();
+  bool isRunning();
+
+ private:
+  void run();
+  bool answer(uint8_t* packet, int64_t arrival);
+
+  Logger LOG;
+  Clock& clock_;
+  SntpClient& upstream_;
+  Statistic& statistic_;
+  int socket_;
+  std::thread task_;
+  std::atomic<bool> stop_;
+  int8_t servedCounter_;
+  int8_t unsyncedCounter_;
+  int8_t invalidCounter_;
+};
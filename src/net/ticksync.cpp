@@ -0,0 +1,420 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/ticksync.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+// magic, id, stratum, entry count, 2 reserved, transmit timestamp, render offset, then the entries
+#define TICK_MAGIC 0x54494b31  // "TIK1"
+#define TICK_HEADER_SIZE 24
+#define TICK_ENTRY_SIZE 20  // peer id, T1, T2
+#define TICK_PACKET_SIZE (TICK_HEADER_SIZE + TICK_SYNC_MAX_PEERS * TICK_ENTRY_SIZE)
+
+//------------------------------------------------------------------------------
+static void put32(uint8_t* p, uint32_t value)
+//------------------------------------------------------------------------------
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+//------------------------------------------------------------------------------
+static void put64(uint8_t* p, int64_t value)
+//------------------------------------------------------------------------------
+{
+  put32(p, (uint64_t)value >> 32);
+  put32(p + 4, (uint32_t)value);
+}
+
+//------------------------------------------------------------------------------
+static uint32_t get32(const uint8_t* p)
+//------------------------------------------------------------------------------
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//------------------------------------------------------------------------------
+static int64_t get64(const uint8_t* p)
+//------------------------------------------------------------------------------
+{
+  return (int64_t)(((uint64_t)get32(p) << 32) | get32(p + 4));
+}
+
+//------------------------------------------------------------------------------
+TickSync::TickSync(Clock& clock)
+    : LOG("TickSync"),
+      clock_(clock),
+      id_(0),
+      mode_(TICK_SYNC_OFF),
+      socket_(-1),
+      group_(0),
+      port_(0),
+      stop_(false),
+      peerCount_(0),
+      stratum_(0),
+      leader_(0),
+      renderOffset_(0),
+      nextSend_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+TickSync::~TickSync()
+//------------------------------------------------------------------------------
+{
+  end();
+}
+
+//------------------------------------------------------------------------------
+bool TickSync::begin(uint32_t id, TickSyncMode_t mode, const char* group, uint16_t port, uint32_t interface)
+//------------------------------------------------------------------------------
+{
+  end();
+  if (mode == TICK_SYNC_OFF) {
+    return true;
+  }
+  id_ = id;
+  mode_ = mode;
+  port_ = port;
+  group_ = inet_addr(group);
+  peerCount_ = 0;
+  leader_ = id;
+  renderOffset_ = 0;
+
+  socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_ < 0) {
+    LOG.e("No socket");
+    return false;
+  }
+  // several clocks on one host in the simulation
+  int reuse = 1;
+  setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  struct ip_mreq membership;
+  membership.imr_multiaddr.s_addr = group_;
+  membership.imr_interface.s_addr = interface;
+  struct in_addr outgoing;
+  outgoing.s_addr = interface;
+  if (bind(socket_, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      setsockopt(socket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0 ||
+      setsockopt(socket_, IPPROTO_IP, IP_MULTICAST_IF, &outgoing, sizeof(outgoing)) != 0) {
+    LOG.e("Could not join %s:%u", group, port);
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+  // wake up for sending and to see end()
+  struct timeval timeout = {0, 50000};
+  setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+#ifdef ESP_PLATFORM
+  esp_pthread_cfg_t cfg = {};
+  cfg.stack_size = TICK_SYNC_TASK_STACK_SIZE;
+  cfg.prio = TICK_SYNC_TASK_PRIORITY;
+  esp_pthread_set_cfg(&cfg);
+#endif
+
+  nextSend_ = clock_.monotonic();
+  stop_ = false;
+  task_ = std::thread(&TickSync::run, this);
+  LOG.i("Id %08x %s on %s:%u", id, mode == TICK_SYNC_ALIGN ? "aligning" : "measuring", group, port);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void TickSync::end()
+//------------------------------------------------------------------------------
+{
+  if (!isRunning()) {
+    return;
+  }
+  stop_ = true;
+  task_.join();
+  close(socket_);
+  socket_ = -1;
+  mode_ = TICK_SYNC_OFF;
+  renderOffset_ = 0;
+}
+
+//------------------------------------------------------------------------------
+bool TickSync::isRunning()
+//------------------------------------------------------------------------------
+{
+  return task_.joinable();
+}
+
+//------------------------------------------------------------------------------
+TickSyncMode_t TickSync::getMode()
+//------------------------------------------------------------------------------
+{
+  return mode_;
+}
+
+//------------------------------------------------------------------------------
+void TickSync::setStratum(uint8_t stratum)
+//------------------------------------------------------------------------------
+{
+  stratum_ = stratum;
+}
+
+//------------------------------------------------------------------------------
+int32_t TickSync::getRenderOffset()
+//------------------------------------------------------------------------------
+{
+  return renderOffset_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t TickSync::getId()
+//------------------------------------------------------------------------------
+{
+  return id_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t TickSync::getLeader()
+//------------------------------------------------------------------------------
+{
+  return leader_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t TickSync::getPeers(TickPeer_t* peers, uint8_t max)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint8_t count = 0;
+  int32_t ownOffset = renderOffset_;
+  for (uint8_t i = 0; i < peerCount_ && count < max; ++i) {
+    const Peer_t& peer = peers_[i];
+    TickPeer_t& out = peers[count++];
+    Sample_t sample = {0, 0};
+    out.id = peer.id;
+    out.stratum = peer.stratum;
+    out.leader = peer.id == leader_;
+    out.samples = peer.samples;
+    best(peer, sample);
+    out.offset = sample.offset;
+    out.delay = sample.delay;
+    out.renderOffset = peer.renderOffset;
+    // what is shown: clock + render offset on both sides
+    out.skew = sample.offset + peer.renderOffset - ownOffset;
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+void TickSync::run()
+//------------------------------------------------------------------------------
+{
+  uint8_t packet[TICK_PACKET_SIZE];
+  while (!stop_) {
+    ssize_t n = recv(socket_, packet, sizeof(packet), 0);
+    // T4, as close to the arrival as we get without driver timestamps
+    int64_t arrival = clock_.now();
+    if (n > 0) {
+      receive(packet, n, arrival);
+    }
+    if (clock_.monotonic() >= nextSend_) {
+      // spread a little, so the clocks don't send in bursts
+      nextSend_ = clock_.monotonic() + TICK_SYNC_INTERVAL_MS * 1000LL - TICK_SYNC_INTERVAL_MS * 50 + random() % (TICK_SYNC_INTERVAL_MS * 100);
+      expire();
+      send();
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void TickSync::send()
+//------------------------------------------------------------------------------
+{
+  if (!clock_.isSet()) {
+    return;
+  }
+  uint8_t packet[TICK_PACKET_SIZE];
+  uint8_t entries = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint8_t i = 0; i < peerCount_; ++i) {
+      uint8_t* entry = packet + TICK_HEADER_SIZE + entries++ * TICK_ENTRY_SIZE;
+      put32(entry, peers_[i].id);
+      put64(entry + 4, peers_[i].lastTx);
+      put64(entry + 12, peers_[i].lastRx);
+    }
+  }
+  put32(packet, TICK_MAGIC);
+  put32(packet + 4, id_);
+  packet[8] = stratum_;
+  packet[9] = entries;
+  packet[10] = 0;
+  packet[11] = 0;
+  put32(packet + 20, renderOffset_);
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port_);
+  address.sin_addr.s_addr = group_;
+  // T3 is the last thing written before the packet leaves
+  put64(packet + 12, clock_.now());
+  sendto(socket_, packet, TICK_HEADER_SIZE + entries * TICK_ENTRY_SIZE, 0, (struct sockaddr*)&address, sizeof(address));
+}
+
+//------------------------------------------------------------------------------
+void TickSync::receive(const uint8_t* packet, size_t length, int64_t arrival)
+//------------------------------------------------------------------------------
+{
+  if (length < TICK_HEADER_SIZE || get32(packet) != TICK_MAGIC || !clock_.isSet()) {
+    return;
+  }
+  uint32_t id = get32(packet + 4);
+  uint8_t entries = packet[9];
+  if (id == id_ || length < TICK_HEADER_SIZE + (size_t)entries * TICK_ENTRY_SIZE) {
+    // our own, looped back
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Peer_t* peer = NULL;
+  for (uint8_t i = 0; i < peerCount_; ++i) {
+    if (peers_[i].id == id) {
+      peer = &peers_[i];
+    }
+  }
+  if (!peer) {
+    if (peerCount_ >= TICK_SYNC_MAX_PEERS) {
+      return;
+    }
+    peer = &peers_[peerCount_++];
+    memset(peer, 0, sizeof(*peer));
+    peer->id = id;
+    LOG.i("Peer %08x joined", id);
+  }
+
+  int64_t t3 = get64(packet + 12);
+  peer->stratum = packet[8];
+  peer->renderOffset = (int32_t)get32(packet + 20);
+  peer->lastSeen = clock_.monotonic();
+
+  // our last packet as the peer saw it
+  for (uint8_t i = 0; i < entries; ++i) {
+    const uint8_t* entry = packet + TICK_HEADER_SIZE + i * TICK_ENTRY_SIZE;
+    if (get32(entry) != id_) {
+      continue;
+    }
+    int64_t t1 = get64(entry + 4);
+    int64_t t2 = get64(entry + 12);
+    int64_t delay = (arrival - t1) - (t3 - t2);
+    // an old exchange or one across a clock step
+    if (t1 && delay >= 0 && arrival - t1 < 3 * TICK_SYNC_INTERVAL_MS * 1000LL) {
+      Sample_t& sample = peer->filter[peer->next];
+      sample.offset = ((t2 - t1) + (t3 - arrival)) / 2;
+      sample.delay = delay;
+      peer->next = (peer->next + 1) % TICK_SYNC_FILTER_SIZE;
+      peer->samples = min(peer->samples + 1, TICK_SYNC_FILTER_SIZE);
+    }
+  }
+  peer->lastTx = t3;
+  peer->lastRx = arrival;
+  elect();
+}
+
+//------------------------------------------------------------------------------
+void TickSync::expire()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t now = clock_.monotonic();
+  for (uint8_t i = 0; i < peerCount_;) {
+    if (now - peers_[i].lastSeen > TICK_SYNC_PEER_TIMEOUT_S * 1000000LL) {
+      LOG.i("Peer %08x gone", peers_[i].id);
+      peers_[i] = peers_[--peerCount_];
+    } else {
+      ++i;
+    }
+  }
+  elect();
+}
+
+//------------------------------------------------------------------------------
+void TickSync::elect()
+//------------------------------------------------------------------------------
+{
+  // synced clocks only, lowest stratum first, then lowest id. Peers we have no offset for can't lead.
+  uint8_t stratum = stratum_;
+  uint32_t leader = id_;
+  const Peer_t* leaderPeer = NULL;
+  for (uint8_t i = 0; i < peerCount_; ++i) {
+    const Peer_t& peer = peers_[i];
+    if (!peer.stratum || !peer.samples) {
+      continue;
+    }
+    if (!stratum || peer.stratum < stratum || (peer.stratum == stratum && peer.id < leader)) {
+      stratum = peer.stratum;
+      leader = peer.id;
+      leaderPeer = &peer;
+    }
+  }
+  if (leader != leader_) {
+    LOG.i("Leader is %08x%s", leader, leader == id_ ? " (we)" : "");
+    leader_ = leader;
+  }
+
+  int32_t renderOffset = 0;
+  Sample_t sample;
+  if (mode_ == TICK_SYNC_ALIGN && leaderPeer && best(*leaderPeer, sample)) {
+    if (sample.offset > TICK_SYNC_MAX_OFFSET_US || sample.offset < -TICK_SYNC_MAX_OFFSET_US) {
+      static LogLimit limit(1, 60000);
+      LOG.w(limit, "Offset to the leader %" PRId64 "µs is too large, not following", sample.offset);
+    } else {
+      // the leader's clock + its own render offset
+      renderOffset = sample.offset + leaderPeer->renderOffset;
+    }
+  }
+  renderOffset_ = renderOffset;
+}
+
+//------------------------------------------------------------------------------
+bool TickSync::best(const Peer_t& peer, Sample_t& sample)
+//------------------------------------------------------------------------------
+{
+  // the least delay has the least asymmetry
+  if (!peer.samples) {
+    return false;
+  }
+  sample = peer.filter[0];
+  for (uint8_t i = 1; i < peer.samples; ++i) {
+    if (peer.filter[i].delay < sample.delay) {
+      sample = peer.filter[i];
+    }
+  }
+  return true;
+}
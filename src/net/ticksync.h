@@ -0,0 +1,155 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "time/clock.h"
+#include "util/logger.h"
+
+#ifndef TICK_SYNC_GROUP
+#define TICK_SYNC_GROUP "239.255.12.3"
+#endif
+
+#ifndef TICK_SYNC_PORT
+#define TICK_SYNC_PORT 12123
+#endif
+
+#ifndef TICK_SYNC_INTERVAL_MS
+#define TICK_SYNC_INTERVAL_MS 1000
+#endif
+
+#ifndef TICK_SYNC_MAX_PEERS
+#define TICK_SYNC_MAX_PEERS 8
+#endif
+
+// the sample with the least delay out of the last ones is used
+#ifndef TICK_SYNC_FILTER_SIZE
+#define TICK_SYNC_FILTER_SIZE 4
+#endif
+
+// peers are forgotten after this
+#ifndef TICK_SYNC_PEER_TIMEOUT_S
+#define TICK_SYNC_PEER_TIMEOUT_S 10
+#endif
+
+// larger offsets to the leader mean one of us is not synced properly, we don't follow then
+#ifndef TICK_SYNC_MAX_OFFSET_US
+#define TICK_SYNC_MAX_OFFSET_US 100000
+#endif
+
+#ifndef TICK_SYNC_TASK_STACK_SIZE
+#define TICK_SYNC_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef TICK_SYNC_TASK_PRIORITY
+#define TICK_SYNC_TASK_PRIORITY 5
+#endif
+
+enum TickSyncMode_t {
+  TICK_SYNC_OFF = 0,
+  TICK_SYNC_ALIGN,    // render in phase with the leader
+  TICK_SYNC_MEASURE,  // only measure and report the skew
+};
+
+struct TickPeer_t {
+  uint32_t id;
+  uint8_t stratum;       // 0 if not synced
+  bool leader;
+  uint8_t samples;
+  int64_t offset;        // µs, peer clock - our clock
+  int64_t delay;         // µs, round trip
+  int32_t renderOffset;  // µs, the peer shifts its frames by
+  int64_t skew;          // µs, the peer flips its seconds this much before us
+};
+
+// Aligns the seconds of clocks side by side. Every clock multicasts a packet per second, carrying its
+// transmit timestamp and, for each peer it heard, the peer's last transmit timestamp and when it arrived.
+// That is the NTP on-wire exchange (T1..T4) with every peer, so each clock knows its offset to every
+// other one without extra round trips.
+// The synced clock with the lowest stratum, then the lowest id, leads. The others do not touch their
+// clock, they only shift their frames by the offset to the leader, see FrameScheduler::setOffset().
+// Receiving runs in its own task, the arrival is timestamped right after recvfrom() returns.
+class TickSync {
+ public:
+  TickSync(Clock& clock);
+  ~TickSync();
+
+  // interface: IPv4 address (network order) to join the group on, 0 for the default one
+  bool begin(uint32_t id, TickSyncMode_t mode, const char* group = TICK_SYNC_GROUP, uint16_t port = TICK_SYNC_PORT,
+             uint32_t interface = 0);
+  void end();
+  bool isRunning();
+  TickSyncMode_t getMode();
+
+  // stratum of our NTP sync, 0 if not synced. Thread safe.
+  void setStratum(uint8_t stratum);
+
+  // µs to shift the frames by, 0 if we lead or only measure. Thread safe.
+  int32_t getRenderOffset();
+  uint32_t getId();
+  uint32_t getLeader();
+  // copies up to max peers, returns the count
+  uint8_t getPeers(TickPeer_t* peers, uint8_t max);
+
+ private:
+  struct Sample_t {
+    int64_t offset;
+    int64_t delay;
+  };
+
+  struct Peer_t {
+    uint32_t id;
+    uint8_t stratum;
+    int32_t renderOffset;
+    int64_t lastTx;    // T1 of the next exchange: the peer's transmit timestamp
+    int64_t lastRx;    // T2: when it arrived here
+    int64_t lastSeen;  // monotonic
+    Sample_t filter[TICK_SYNC_FILTER_SIZE];
+    uint8_t samples;
+    uint8_t next;
+  };
+
+  void run();
+  void send();
+  void receive(const uint8_t* packet, size_t length, int64_t arrival);
+  void expire();
+  void elect();
+  bool best(const Peer_t& peer, Sample_t& sample);
+
+  Logger LOG;
+  Clock& clock_;
+  uint32_t id_;
+  TickSyncMode_t mode_;
+  int socket_;
+  uint32_t group_;  // network order
+  uint16_t port_;
+  std::thread task_;
+  std::atomic<bool> stop_;
+  std::mutex mutex_;
+  Peer_t peers_[TICK_SYNC_MAX_PEERS];
+  uint8_t peerCount_;
+  std::atomic<uint8_t> stratum_;
+  std::atomic<uint32_t> leader_;
+  std::atomic<int32_t> renderOffset_;
+  int64_t nextSend_;  // monotonic
+};
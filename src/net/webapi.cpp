@@ -0,0 +1,404 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/webapi.h"
+
+#include <Esp.h>
+
+#include "time/tzdb.h"
+
+// by TickSyncMode_t
+static const char* tickSyncNames[] = {"off", "align", "measure"};
+
+WebApi* WebApi::api_ = NULL;
+
+//------------------------------------------------------------------------------
+WebApi::WebApi(Config& config, Clock& clock, SntpClient& sntp, ClockDiscipline& discipline, TickSync& tickSync, FrameScheduler& frames,
+               Statistic& statistics)
+    : LOG("WebApi"),
+      config_(config),
+      clock_(clock),
+      sntp_(sntp),
+      discipline_(discipline),
+      tickSync_(tickSync),
+      frames_(frames),
+      statistics_(statistics),
+      server_(NULL),
+      statusCallback_(NULL),
+      changed_(false),
+      lastSecond_(0),
+      lastStats_(0),
+      lastSnapshot_(0)
+//------------------------------------------------------------------------------
+{
+  memset(&change_, 0, sizeof(change_));
+  memset(&snapshot_, 0, sizeof(snapshot_));
+}
+
+//------------------------------------------------------------------------------
+void WebApi::addRoutes(HttpServer& server)
+//------------------------------------------------------------------------------
+{
+  api_ = this;
+  server_ = &server;
+  server.on(WEB_API_CONFIG, HTTP_METHOD_GET, getConfig);
+  server.on(WEB_API_CONFIG, HTTP_METHOD_PUT, putConfig);
+  server.on(WEB_API_STATUS, HTTP_METHOD_GET, getStatus);
+  server.on(WEB_API_EVENTS, HTTP_METHOD_GET, events);
+}
+
+//------------------------------------------------------------------------------
+void WebApi::onStatus(StatusCallback callback)
+//------------------------------------------------------------------------------
+{
+  statusCallback_ = callback;
+}
+
+//------------------------------------------------------------------------------
+bool WebApi::takeChange(ConfigChange_t& change)
+//------------------------------------------------------------------------------
+{
+  // the API validates in the HTTP task, the settings are changed in the loop
+  if (!changed_.exchange(false)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(changeMutex_);
+  change = change_;
+  memset(&change_, 0, sizeof(change_));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void WebApi::writeConfig(JsonWriter& json)
+//------------------------------------------------------------------------------
+{
+  // with what is not applied yet
+  ConfigChange_t pending;
+  {
+    std::lock_guard<std::mutex> lock(changeMutex_);
+    pending = change_;
+  }
+  uint8_t tickSyncMode = pending.hasTickSync ? pending.tickSync : config_.getTickSync();
+
+  json.beginObject();
+  json.string("deviceName", pending.hasDeviceName ? pending.deviceName : config_.getDeviceName().c_str());
+  json.string("timezone", pending.hasTimezone ? pending.timezone : config_.getTimezone().c_str());
+  json.boolean("ntpServer", pending.hasNtpServer ? pending.ntpServer : config_.isNtpServer());
+  json.string("tickSync", tickSyncNames[min(tickSyncMode, (uint8_t)TICK_SYNC_MEASURE)]);
+  json.endObject();
+}
+
+//------------------------------------------------------------------------------
+void WebApi::getConfig(HttpRequest&, HttpResponse& response)
+//------------------------------------------------------------------------------
+{
+  response.setContentType("application/json");
+  JsonWriter json(response);
+  api_->writeConfig(json);
+}
+
+//------------------------------------------------------------------------------
+void WebApi::putConfig(HttpRequest& request, HttpResponse& response)
+//------------------------------------------------------------------------------
+{
+  response.setContentType("application/json");
+  JsonWriter json(response);
+
+  // all or nothing, the whole body is checked before anything is taken over
+  ConfigChange_t change;
+  memset(&change, 0, sizeof(change));
+  char error[80];
+  if (!api_->parseChange(request, change, error, sizeof(error))) {
+    response.setStatus(400);
+    json.beginObject();
+    json.string("error", error);
+    json.endObject();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(api_->changeMutex_);
+    ConfigChange_t& pending = api_->change_;
+    if (change.hasDeviceName) {
+      pending.hasDeviceName = true;
+      strcpy(pending.deviceName, change.deviceName);
+    }
+    if (change.hasTimezone) {
+      pending.hasTimezone = true;
+      strcpy(pending.timezone, change.timezone);
+    }
+    if (change.hasNtpServer) {
+      pending.hasNtpServer = true;
+      pending.ntpServer = change.ntpServer;
+    }
+    if (change.hasTickSync) {
+      pending.hasTickSync = true;
+      pending.tickSync = change.tickSync;
+    }
+  }
+  api_->changed_ = true;
+
+  // the settings as they are once the loop has applied them
+  api_->writeConfig(json);
+}
+
+//------------------------------------------------------------------------------
+bool WebApi::parseChange(HttpRequest& request, ConfigChange_t& change, char* error, size_t size)
+//------------------------------------------------------------------------------
+{
+  JsonReader reader(request.getBody(), request.getBodyLength());
+  if (reader.next() != JSON_OBJECT) {
+    snprintf(error, size, "%s", *reader.getError() ? reader.getError() : "object expected");
+    return false;
+  }
+
+  for (JsonToken_t token = reader.next(); token != JSON_OBJECT_END; token = reader.next()) {
+    const char* key = reader.getKey();
+    const char* value = reader.getString();
+    if (token == JSON_ERROR) {
+      snprintf(error, size, "%s", reader.getError());
+      return false;
+
+    } else if (strcmp(key, "deviceName") == 0 && token == JSON_STRING) {
+      // it is the mDNS name too
+      size_t length = strlen(value);
+      bool valid = length > 0 && length < CONFIG_DEVICENAME_SIZE;
+      for (size_t i = 0; i < length; ++i) {
+        valid &= isalnum(value[i]) || value[i] == '-';
+      }
+      if (!valid) {
+        snprintf(error, size, "deviceName: 1 to %u letters, digits or '-'", CONFIG_DEVICENAME_SIZE - 1);
+        return false;
+      }
+      change.hasDeviceName = true;
+      strcpy(change.deviceName, value);
+
+    } else if (strcmp(key, "timezone") == 0 && token == JSON_STRING) {
+      if (strlen(value) >= CONFIG_TIMEZONE_SIZE || !TzDb::lookup(value)) {
+        snprintf(error, size, "timezone: unknown '%s'", value);
+        return false;
+      }
+      change.hasTimezone = true;
+      strcpy(change.timezone, value);
+
+    } else if (strcmp(key, "ntpServer") == 0 && token == JSON_BOOL) {
+      change.hasNtpServer = true;
+      change.ntpServer = reader.getBool();
+
+    } else if (strcmp(key, "tickSync") == 0 && token == JSON_STRING) {
+      change.hasTickSync = false;
+      for (uint8_t i = 0; i < sizeof(tickSyncNames) / sizeof(tickSyncNames[0]); ++i) {
+        if (strcmp(value, tickSyncNames[i]) == 0) {
+          change.hasTickSync = true;
+          change.tickSync = i;
+        }
+      }
+      if (!change.hasTickSync) {
+        snprintf(error, size, "tickSync: off, align or measure");
+        return false;
+      }
+
+    } else {
+      snprintf(error, size, "%s: unknown setting or wrong type", key);
+      return false;
+    }
+  }
+
+  if (reader.next() != JSON_END) {
+    snprintf(error, size, "%s", reader.getError());
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void WebApi::getStatus(HttpRequest& request, HttpResponse& response)
+//------------------------------------------------------------------------------
+{
+  // in the HTTP task: thread safe getters, and the snapshot of what only the loop may read
+  WebApi& api = *api_;
+  response.setContentType("application/json");
+  JsonWriter json(response);
+  json.beginObject();
+  json.string("deviceName", api.config_.getDeviceName().c_str());
+  // the address the request came in on
+  uint32_t address = request.getLocalAddress();
+  char ip[16];
+  snprintf(ip, sizeof(ip), "%u.%u.%u.%u", address & 0xff, (address >> 8) & 0xff, (address >> 16) & 0xff, address >> 24);
+  json.string("ip", ip);
+  json.integer("uptime", esp_timer_get_time() / 1000000);
+  json.integer("utc", api.clock_.now() / 1000000);
+  json.string("timezone", api.config_.getTimezone().c_str());
+  json.integer("freeHeap", ESP.getFreeHeap());
+  json.integer("minFreeHeap", ESP.getMinFreeHeap());
+  if (api.statusCallback_) {
+    api.statusCallback_(json);
+  }
+
+  // the rest is the loop's, as of its last snapshot
+  StatusSnapshot_t snapshot;
+  {
+    std::lock_guard<std::mutex> lock(api.snapshotMutex_);
+    snapshot = api.snapshot_;
+  }
+
+  json.beginObject("sntp");
+  json.boolean("synced", api.sntp_.isSynced());
+  json.integer("stratum", api.sntp_.getStratum());
+  json.integer("offset", snapshot.offset);
+  json.integer("drift", api.clock_.getDriftPpb());
+  json.integer("poll", snapshot.poll);
+  json.beginArray("servers");
+  for (uint8_t i = 0; i < api.sntp_.getServerCount(); ++i) {
+    const SntpServerStats_t& stats = snapshot.servers[i];
+    json.beginObject();
+    json.string("name", api.sntp_.getServerName(i));
+    json.integer("offset", stats.offset);
+    json.integer("delay", stats.delay);
+    json.integer("jitter", stats.jitter);
+    json.integer("reach", stats.reach);
+    json.boolean("selected", stats.selected);
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+
+  json.beginObject("tickSync");
+  json.boolean("running", snapshot.tickSyncRunning);
+  json.integer("leader", api.tickSync_.getLeader());
+  json.integer("renderOffset", api.tickSync_.getRenderOffset());
+  json.endObject();
+
+  json.beginObject("frames");
+  json.integer("fps", snapshot.fps);
+  json.integer("frames", snapshot.frames);
+  json.integer("skipped", snapshot.skipped);
+  json.integer("maxLatency", snapshot.maxLatency);
+  json.endObject();
+
+  json.endObject();
+}
+
+//------------------------------------------------------------------------------
+void WebApi::events(HttpRequest&, HttpResponse& response)
+//------------------------------------------------------------------------------
+{
+  // the events come from publishEvents(), a browser that lost the stream reconnects after 5s
+  response.stream();
+  response.print("retry: 5000\n\n");
+}
+
+//------------------------------------------------------------------------------
+void WebApi::takeSnapshot()
+//------------------------------------------------------------------------------
+{
+  // in the loop, the getters are not thread safe
+  StatusSnapshot_t snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.offset = discipline_.getLastOffset();
+  snapshot.poll = discipline_.getPollInterval();
+  for (uint8_t i = 0; i < sntp_.getServerCount(); ++i) {
+    snapshot.servers[i] = sntp_.getServerStats(i);
+  }
+  snapshot.tickSyncRunning = tickSync_.isRunning();
+  snapshot.fps = frames_.getFps();
+  snapshot.frames = frames_.getFrames();
+  snapshot.skipped = frames_.getSkipped();
+  snapshot.maxLatency = frames_.getMaxLatency();
+
+  std::lock_guard<std::mutex> lock(snapshotMutex_);
+  snapshot_ = snapshot;
+}
+
+//------------------------------------------------------------------------------
+void WebApi::publishEvents(PosixTz* timezone)
+//------------------------------------------------------------------------------
+{
+  int64_t now = esp_timer_get_time();
+  if (!lastSnapshot_ || now - lastSnapshot_ >= WEB_API_SNAPSHOT_PERIOD_MS * 1000LL) {
+    lastSnapshot_ = now;
+    takeSnapshot();
+  }
+
+  // in the loop, so the values are read where they are written. Nothing to do without listeners.
+  if (!server_ || server_->getStreams() == 0 || !clock_.isSet()) {
+    return;
+  }
+  int64_t second = clock_.now() / 1000000;
+  if (second == lastSecond_) {
+    return;
+  }
+  lastSecond_ = second;
+
+  FixedPrint<256> time;
+  JsonWriter json(time);
+  json.beginObject();
+  json.integer("utc", second);
+  if (timezone) {
+    LocalTime_t local;
+    timezone->toLocal(second, local);
+    char text[32];
+    snprintf(text, sizeof(text), "%04u-%02u-%02u %02u:%02u:%02u", local.year, local.month, local.day, local.hour, local.minute,
+             local.second);
+    json.string("local", text);
+    json.boolean("dst", local.dst);
+  }
+  json.boolean("synced", sntp_.isSynced());
+  json.integer("stratum", sntp_.getStratum());
+  json.integer("offset", discipline_.getLastOffset());
+  json.integer("drift", clock_.getDriftPpb());
+  json.integer("renderOffset", tickSync_.getRenderOffset());
+  json.endObject();
+  server_->publish("time", time.c_str());
+
+  if (second - lastStats_ < WEB_API_STATS_PERIOD) {
+    return;
+  }
+  lastStats_ = second;
+
+  FixedPrint<640> stats;
+  JsonWriter statsJson(stats);
+  statsJson.beginObject();
+  statsJson.integer("loops", statistics_.getLoopsPerSecond());
+  statsJson.integer("freeHeap", ESP.getFreeHeap());
+  statsJson.integer("minFreeHeap", ESP.getMinFreeHeap());
+  if (statusCallback_) {
+    statusCallback_(statsJson);
+  }
+  statsJson.beginObject("http");
+  statsJson.integer("requests", server_->getRequests());
+  statsJson.integer("connections", server_->getConnections());
+  statsJson.integer("reused", server_->getReused());
+  statsJson.integer("streams", server_->getStreams());
+  statsJson.integer("evicted", server_->getEvicted());
+  statsJson.endObject();
+  statsJson.beginObject("frames");
+  statsJson.integer("skipped", frames_.getSkipped());
+  statsJson.integer("maxLatency", frames_.getMaxLatency());
+  statsJson.endObject();
+  statsJson.beginObject("counters");
+  for (uint8_t i = 0; i < statistics_.getCounterCount(); ++i) {
+    statsJson.integer(statistics_.getCounterName(i), statistics_.getCount(i));
+  }
+  statsJson.endObject();
+  statsJson.endObject();
+  if (stats.isOverflow()) {
+    LOG.w("stats event too large");
+    return;
+  }
+  server_->publish("stats", stats.c_str());
+}
@@ -0,0 +1,129 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "config.h"
+#include "display/framescheduler.h"
+#include "net/httpserver.h"
+#include "net/sntp.h"
+#include "net/ticksync.h"
+#include "statistic.h"
+#include "time/clock.h"
+#include "time/discipline.h"
+#include "time/posixtz.h"
+#include "util/fixedstring.h"
+#include "util/json.h"
+#include "util/logger.h"
+
+#define WEB_API_CONFIG "/api/config"
+#define WEB_API_STATUS "/api/status"
+#define WEB_API_EVENTS "/api/events"
+
+// s between two stats events, the time event is sent every second
+#ifndef WEB_API_STATS_PERIOD
+#define WEB_API_STATS_PERIOD 10
+#endif
+
+// ms between two copies of the loop state for /api/status
+#ifndef WEB_API_SNAPSHOT_PERIOD_MS
+#define WEB_API_SNAPSHOT_PERIOD_MS 250
+#endif
+
+// settings changed through the API, applied by the loop
+struct ConfigChange_t {
+  bool hasDeviceName;
+  char deviceName[CONFIG_DEVICENAME_SIZE];
+  bool hasTimezone;
+  char timezone[CONFIG_TIMEZONE_SIZE];
+  bool hasNtpServer;
+  bool ntpServer;
+  bool hasTickSync;
+  uint8_t tickSync;
+};
+
+// what /api/status shows of the state the loop owns, copied by the loop
+struct StatusSnapshot_t {
+  int64_t offset;  // µs
+  uint32_t poll;   // s
+  SntpServerStats_t servers[SNTP_MAX_SERVERS];
+  bool tickSyncRunning;  // the loop starts and stops the task
+  uint16_t fps;
+  uint32_t frames;
+  uint32_t skipped;
+  int64_t maxLatency;  // µs
+};
+
+// The REST API (settings and status) and the event stream of the status page, on the HttpServer.
+// The handlers run in the HTTP task: they read thread safe state and the snapshot the loop takes of the
+// rest, and hand setting changes to the loop, which takes them with takeChange(). Independent of the WiFi and the board, so the host build
+// serves the same API (web-bench).
+// One instance, the handlers of HttpServer are plain functions.
+class WebApi {
+ public:
+  // adds what only the firmware knows to the status and the stats event, e.g. the portal state
+  typedef void (*StatusCallback)(JsonWriter& json);
+
+  WebApi(Config& config, Clock& clock, SntpClient& sntp, ClockDiscipline& discipline, TickSync& tickSync, FrameScheduler& frames,
+         Statistic& statistics);
+
+  void addRoutes(HttpServer& server);
+  void onStatus(StatusCallback callback);
+
+  // loop: the settings changed through the API since the last call, false if none
+  bool takeChange(ConfigChange_t& change);
+  // loop: the status snapshot every WEB_API_SNAPSHOT_PERIOD_MS, the time event every second and the stats
+  // event every WEB_API_STATS_PERIOD, the events only while somebody listens. timezone is NULL while the
+  // local time is not known.
+  void publishEvents(PosixTz* timezone);
+
+ private:
+  static void getConfig(HttpRequest& request, HttpResponse& response);
+  static void putConfig(HttpRequest& request, HttpResponse& response);
+  static void getStatus(HttpRequest& request, HttpResponse& response);
+  static void events(HttpRequest& request, HttpResponse& response);
+  bool parseChange(HttpRequest& request, ConfigChange_t& change, char* error, size_t size);
+  void writeConfig(JsonWriter& json);
+  void takeSnapshot();
+
+  static WebApi* api_;
+  Logger LOG;
+  Config& config_;
+  Clock& clock_;
+  SntpClient& sntp_;
+  ClockDiscipline& discipline_;
+  TickSync& tickSync_;
+  FrameScheduler& frames_;
+  Statistic& statistics_;
+  HttpServer* server_;
+  StatusCallback statusCallback_;
+
+  std::mutex changeMutex_;
+  ConfigChange_t change_;
+  std::atomic<bool> changed_;
+  int64_t lastSecond_;
+  int64_t lastStats_;
+
+  std::mutex snapshotMutex_;
+  StatusSnapshot_t snapshot_;
+  int64_t lastSnapshot_;
+};
@@ -0,0 +1,101 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/webassets.h"
+
+#include "net/webassets_data.h"
+
+#define WEB_ASSETS_INDEX "/index.html"
+
+std::atomic<uint32_t> WebAssets::sent_(0);
+std::atomic<uint32_t> WebAssets::notModified_(0);
+std::atomic<uint32_t> WebAssets::bytes_(0);
+
+//------------------------------------------------------------------------------
+void WebAssets::addRoutes(HttpServer& server)
+//------------------------------------------------------------------------------
+{
+  for (const WebAsset_t& asset : webAssets) {
+    server.on(asset.path, HTTP_METHOD_GET, handle);
+  }
+  if (find(WEB_ASSETS_INDEX)) {
+    server.on("/", HTTP_METHOD_GET, handle);
+  }
+}
+
+//------------------------------------------------------------------------------
+const WebAsset_t* WebAssets::find(const char* path)
+//------------------------------------------------------------------------------
+{
+  if (strcmp(path, "/") == 0) {
+    path = WEB_ASSETS_INDEX;
+  }
+  for (const WebAsset_t& asset : webAssets) {
+    if (strcmp(asset.path, path) == 0) {
+      return &asset;
+    }
+  }
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+void WebAssets::handle(HttpRequest& request, HttpResponse& response)
+//------------------------------------------------------------------------------
+{
+  const WebAsset_t* asset = find(request.getPath());
+  if (!asset) {
+    response.send(404, "text/plain", "Not Found");
+    return;
+  }
+  response.addHeader("ETag", asset->etag);
+  response.addHeader("Cache-Control", asset->cacheControl);
+
+  // the browser's copy is still the current one
+  const char* ifNoneMatch = request.getHeader("If-None-Match");
+  if (ifNoneMatch && (strstr(ifNoneMatch, asset->etag) || strcmp(ifNoneMatch, "*") == 0)) {
+    response.setStatus(304);
+    response.setContentType(NULL);
+    ++notModified_;
+    return;
+  }
+
+  response.addHeader("Content-Encoding", "gzip");
+  response.sendStatic(200, asset->contentType, asset->data, asset->length);
+  ++sent_;
+  bytes_ += asset->length;
+}
+
+//------------------------------------------------------------------------------
+uint32_t WebAssets::getSent()
+//------------------------------------------------------------------------------
+{
+  return sent_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t WebAssets::getNotModified()
+//------------------------------------------------------------------------------
+{
+  return notModified_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t WebAssets::getBytes()
+//------------------------------------------------------------------------------
+{
+  return bytes_;
+}
@@ -0,0 +1,52 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "net/httpserver.h"
+
+struct WebAsset_t {
+  const char* path;
+  const char* contentType;
+  const char* etag;
+  const char* cacheControl;
+  const uint8_t* data;
+  uint32_t length;
+};
+
+// The files of web/, gzip compressed into flash by tools/webassets.py and sent from there as they are,
+// with Content-Encoding: gzip. A request carrying the current ETag in If-None-Match gets a 304.
+class WebAssets {
+ public:
+  // every asset under its name, the index page also as '/'
+  static void addRoutes(HttpServer& server);
+  static const WebAsset_t* find(const char* path);
+  static void handle(HttpRequest& request, HttpResponse& response);
+
+  static uint32_t getSent();
+  static uint32_t getNotModified();
+  static uint32_t getBytes();
+
+ private:
+  static std::atomic<uint32_t> sent_;
+  static std::atomic<uint32_t> notModified_;
+  static std::atomic<uint32_t> bytes_;
+};
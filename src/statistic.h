@@ -1,34 +1,70 @@
-/* 
- * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
- * Copyright (c) 2019 Lars Brandt.
- * 
- * This program is free software: you can redistribute it and/or modify  
- * it under the terms of the GNU General Public License as published by  
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but 
- * WITHOUT ANY WARRANTY; without even the implied warranty of 
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
- * General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License 
- * along with this program. If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include <Arduino.h>
-
-#include "util/logger.h"
-
-class Statistic {
- public:
-  Statistic();
-  bool begin(uint64_t periodMs = 10000);
-  void loop();
-
- private:
-  Logger LOG;
-  void printStatistic();
-  uint64_t lastMeasurementTime_;
-  uint64_t loopCount_;
-  uint64_t period_;
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "util/logger.h"
+
+#ifndef STATISTIC_MAX_REPORTS
+#define STATISTIC_MAX_REPORTS 4
+#endif
+
+#ifndef STATISTIC_MAX_COUNTERS
+#define STATISTIC_MAX_COUNTERS 8
+#endif
+
+class Statistic {
+ public:
+  // called every period after the loop statistic, to log the values of a module
+  typedef void (*ReportCallback)(Logger& log);
+
+  Statistic();
+  bool begin(uint64_t periodMs = 10000);
+  void loop();
+  bool addReport(ReportCallback cb);
+
+  // Event counters, logged every period with the count of the period and the total.
+  // count() is lock free and may be called from any task.
+  int8_t addCounter(const char* name);
+  void count(int8_t counter, uint32_t n = 1);
+  uint32_t getCount(int8_t counter);
+  uint8_t getCounterCount();
+  const char* getCounterName(int8_t counter);
+  // of the last period
+  uint32_t getLoopsPerSecond();
+
+ private:
+  Logger LOG;
+  void printStatistic();
+  uint64_t lastMeasurementTime_;
+  uint64_t loopCount_;
+  uint64_t period_;
+  uint32_t loopsPerSecond_;
+  ReportCallback reports_[STATISTIC_MAX_REPORTS];
+  uint8_t reportCount_;
+  struct Counter_t {
+    const char* name;
+    std::atomic<uint32_t> total;
+    uint32_t printed;  // total at the last print
+  };
+  Counter_t counters_[STATISTIC_MAX_COUNTERS];
+  uint8_t counterCount_;
 };
\ No newline at end of file
@@ -0,0 +1,160 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time/clock.h"
+
+//------------------------------------------------------------------------------
+Clock::Clock(MonotonicSource source)
+    : source_(source),
+      set_(false),
+      baseMonotonic_(0),
+      baseUtc_(0),
+      driftPpb_(0),
+      slew_(0),
+      lastSync_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool Clock::isSet()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return set_;
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::now()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return set_ ? at(source_()) : 0;
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::monotonic()
+//------------------------------------------------------------------------------
+{
+  return source_();
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::toUtc(int64_t monotonic)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return set_ ? at(monotonic) : 0;
+}
+
+//------------------------------------------------------------------------------
+void Clock::set(int64_t utc)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  step(utc, source_());
+}
+
+//------------------------------------------------------------------------------
+void Clock::adjust(int64_t offset)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t monotonic = source_();
+  if (!set_ || offset > CLOCK_STEP_THRESHOLD_US || offset < -CLOCK_STEP_THRESHOLD_US) {
+    step((set_ ? at(monotonic) : monotonic) + offset, monotonic);
+  } else {
+    // the new offset was measured against the partly slewed clock, it replaces what is left
+    rebase(monotonic);
+    slew_ = offset;
+  }
+  lastSync_ = at(monotonic);
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::getSlewRemaining()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slew_ - slewed(source_());
+}
+
+//------------------------------------------------------------------------------
+int32_t Clock::getDriftPpb()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return driftPpb_;
+}
+
+//------------------------------------------------------------------------------
+void Clock::setDriftPpb(int32_t driftPpb)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  // rebase, so the new rate only applies from now on
+  rebase(source_());
+  driftPpb_ = driftPpb;
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::getLastSync()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lastSync_;
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::at(int64_t monotonic)
+//------------------------------------------------------------------------------
+{
+  int64_t elapsed = monotonic - baseMonotonic_;
+  return baseUtc_ + elapsed + elapsed * driftPpb_ / 1000000000LL + slewed(monotonic);
+}
+
+//------------------------------------------------------------------------------
+int64_t Clock::slewed(int64_t monotonic)
+//------------------------------------------------------------------------------
+{
+  int64_t max = (monotonic - baseMonotonic_) * CLOCK_SLEW_PPM / 1000000;
+  if (slew_ >= 0) {
+    return slew_ < max ? slew_ : max;
+  }
+  return -slew_ < max ? slew_ : -max;
+}
+
+//------------------------------------------------------------------------------
+void Clock::rebase(int64_t monotonic)
+//------------------------------------------------------------------------------
+{
+  if (set_) {
+    int64_t applied = slewed(monotonic);
+    baseUtc_ = at(monotonic);
+    slew_ -= applied;
+  }
+  baseMonotonic_ = monotonic;
+}
+
+//------------------------------------------------------------------------------
+void Clock::step(int64_t utc, int64_t monotonic)
+//------------------------------------------------------------------------------
+{
+  baseMonotonic_ = monotonic;
+  baseUtc_ = utc;
+  slew_ = 0;
+  set_ = true;
+}
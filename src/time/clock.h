@@ -0,0 +1,79 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <mutex>
+
+// Monotonic µs counter the clock is derived from, esp_timer_get_time() on the device.
+// Injectable, so the host simulation can run the clock faster or jump.
+typedef int64_t (*MonotonicSource)();
+
+// Offsets up to this are slewed, larger ones are stepped
+#ifndef CLOCK_STEP_THRESHOLD_US
+#define CLOCK_STEP_THRESHOLD_US 128000
+#endif
+
+// Rate at which offsets are slewed out, in µs per s
+#ifndef CLOCK_SLEW_PPM
+#define CLOCK_SLEW_PPM 500
+#endif
+
+// UTC in µs since the epoch, interpolated from the monotonic counter.
+// The counter runs off the crystal, its rate error is corrected by driftPpb (parts per billion).
+// Small corrections are slewed: the clock runs up to CLOCK_SLEW_PPM faster or slower until the offset
+// is gone, so it never jumps and never runs backwards.
+// Thread safe, e.g. the SNTP server task reads it while the loop disciplines it.
+class Clock {
+ public:
+  Clock(MonotonicSource source = esp_timer_get_time);
+
+  bool isSet();
+  int64_t now();
+  int64_t monotonic();
+  // UTC of an earlier monotonic() reading, e.g. the arrival of a packet. 0 if not set.
+  int64_t toUtc(int64_t monotonic);
+
+  // step to utc, e.g. restored from the RTC
+  void set(int64_t utc);
+  // correct by offset µs (reference - clock), slewed or stepped. Counts as sync. While not set, the
+  // clock counts as reading monotonic(), so the offset of a measurement stays valid until it is applied.
+  void adjust(int64_t offset);
+  // the part of the last adjust() that is not applied yet
+  int64_t getSlewRemaining();
+
+  int32_t getDriftPpb();
+  void setDriftPpb(int32_t driftPpb);
+  int64_t getLastSync();
+
+ private:
+  int64_t at(int64_t monotonic);
+  int64_t slewed(int64_t monotonic);
+  void rebase(int64_t monotonic);
+  void step(int64_t utc, int64_t monotonic);
+
+  std::mutex mutex_;
+  MonotonicSource source_;
+  bool set_;
+  int64_t baseMonotonic_;
+  int64_t baseUtc_;
+  int32_t driftPpb_;
+  int64_t slew_;  // to apply from baseMonotonic_ on
+  int64_t lastSync_;
+};
@@ -0,0 +1,145 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time/discipline.h"
+
+// spans shorter than this say little about the rate
+#define DISCIPLINE_MIN_SPAN_US 30000000LL
+// crystals are specified at ±20 ppm plus aging and temperature, everything beyond 100 ppm is a bad sample
+#define DISCIPLINE_MAX_DRIFT_PPB 100000
+// samples with a round trip this many times over the best recent one are queueing artifacts
+#define DISCIPLINE_SPIKE_FACTOR 3
+// number of good samples in a row before the poll interval is doubled
+#define DISCIPLINE_STABLE_SAMPLES 3
+
+//------------------------------------------------------------------------------
+ClockDiscipline::ClockDiscipline(Clock& clock)
+    : LOG("Discipline"),
+      clock_(clock),
+      pollExp_(DISCIPLINE_MIN_POLL_EXP),
+      stable_(0),
+      lastSample_(0),
+      minDelay_(0),
+      lastOffset_(0),
+      lastDelay_(0),
+      samples_(0),
+      spikes_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool ClockDiscipline::sample(int64_t offset, int64_t delay)
+//------------------------------------------------------------------------------
+{
+  ++samples_;
+  lastOffset_ = offset;
+  lastDelay_ = delay;
+
+  // the best round trip slowly ages, so a changed path is accepted after a while
+  if (minDelay_ == 0 || delay < minDelay_) {
+    minDelay_ = delay;
+  } else {
+    minDelay_ += (delay - minDelay_) / 16;
+  }
+
+  bool step = !clock_.isSet() || offset > CLOCK_STEP_THRESHOLD_US || offset < -CLOCK_STEP_THRESHOLD_US;
+  if (!step && delay > DISCIPLINE_SPIKE_FACTOR * minDelay_) {
+    ++spikes_;
+    LOG.d("Spike ignored, offset %" PRId64 "µs, delay %" PRId64 "µs", offset, delay);
+    return false;
+  }
+
+  int64_t monotonic = clock_.monotonic();
+  if (step) {
+    LOG.i("Step by %" PRId64 "ms", offset / 1000);
+    clock_.adjust(offset);
+    lastSample_ = 0;
+    stable_ = 0;
+    pollExp_ = DISCIPLINE_MIN_POLL_EXP;
+    return true;
+  }
+
+  int64_t span = lastSample_ ? monotonic - lastSample_ : 0;
+  if (span >= DISCIPLINE_MIN_SPAN_US) {
+    // what is left of the previous correction is not part of the new error
+    int64_t accrued = offset - clock_.getSlewRemaining();
+    int64_t driftPpb = clock_.getDriftPpb() + accrued * 1000000000LL / span / 2;
+    driftPpb = max(-(int64_t)DISCIPLINE_MAX_DRIFT_PPB, min((int64_t)DISCIPLINE_MAX_DRIFT_PPB, driftPpb));
+    clock_.setDriftPpb((int32_t)driftPpb);
+  }
+  clock_.adjust(offset);
+  lastSample_ = monotonic;
+
+  int64_t magnitude = offset < 0 ? -offset : offset;
+  if (magnitude < DISCIPLINE_TARGET_OFFSET_US) {
+    if (++stable_ >= DISCIPLINE_STABLE_SAMPLES && pollExp_ < DISCIPLINE_MAX_POLL_EXP) {
+      ++pollExp_;
+      stable_ = 0;
+    }
+  } else if (magnitude > 2 * DISCIPLINE_TARGET_OFFSET_US) {
+    stable_ = 0;
+    if (pollExp_ > DISCIPLINE_MIN_POLL_EXP) {
+      --pollExp_;
+    }
+  }
+
+  LOG.d("Offset %" PRId64 "µs, delay %" PRId64 "µs, drift %dppb, poll %us", offset, delay, (int)clock_.getDriftPpb(),
+        getPollInterval());
+  return true;
+}
+
+//------------------------------------------------------------------------------
+uint32_t ClockDiscipline::getPollInterval()
+//------------------------------------------------------------------------------
+{
+  return 1UL << pollExp_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t ClockDiscipline::getPollExp()
+//------------------------------------------------------------------------------
+{
+  return pollExp_;
+}
+
+//------------------------------------------------------------------------------
+int64_t ClockDiscipline::getLastOffset()
+//------------------------------------------------------------------------------
+{
+  return lastOffset_;
+}
+
+//------------------------------------------------------------------------------
+int64_t ClockDiscipline::getLastDelay()
+//------------------------------------------------------------------------------
+{
+  return lastDelay_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t ClockDiscipline::getSamples()
+//------------------------------------------------------------------------------
+{
+  return samples_;
+}
+
+//------------------------------------------------------------------------------
+uint32_t ClockDiscipline::getSpikes()
+//------------------------------------------------------------------------------
+{
+  return spikes_;
+}
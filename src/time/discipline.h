@@ -0,0 +1,67 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "time/clock.h"
+#include "util/logger.h"
+
+// Poll interval range as power of two seconds: 64s ... ~4.5h
+#ifndef DISCIPLINE_MIN_POLL_EXP
+#define DISCIPLINE_MIN_POLL_EXP 6
+#endif
+#ifndef DISCIPLINE_MAX_POLL_EXP
+#define DISCIPLINE_MAX_POLL_EXP 14
+#endif
+
+// The poll interval is doubled while the offsets stay below this, and halved when they exceed twice of it
+#ifndef DISCIPLINE_TARGET_OFFSET_US
+#define DISCIPLINE_TARGET_OFFSET_US 5000
+#endif
+
+// Disciplines a Clock from offset measurements (SNTP).
+// Every offset is slewed out. The part of it that built up since the previous sample is a rate
+// error of the crystal, so the rate correction is moved towards it. The better the rate, the
+// longer the clock stays within the target offset, and the poll interval adapts to that.
+class ClockDiscipline {
+ public:
+  ClockDiscipline(Clock& clock);
+
+  // offset: reference - clock, delay: round trip, both µs. False if ignored as spike.
+  bool sample(int64_t offset, int64_t delay);
+
+  uint32_t getPollInterval();  // s
+  uint8_t getPollExp();
+  int64_t getLastOffset();
+  int64_t getLastDelay();
+  uint32_t getSamples();
+  uint32_t getSpikes();
+
+ private:
+  Logger LOG;
+  Clock& clock_;
+  uint8_t pollExp_;
+  uint8_t stable_;
+  int64_t lastSample_;  // monotonic, 0 after a step
+  int64_t minDelay_;
+  int64_t lastOffset_;
+  int64_t lastDelay_;
+  uint32_t samples_;
+  uint32_t spikes_;
+};
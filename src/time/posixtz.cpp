@@ -0,0 +1,335 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time/posixtz.h"
+
+#define SECONDS_PER_DAY 86400
+
+//------------------------------------------------------------------------------
+static int64_t floorDiv(int64_t a, int64_t b)
+//------------------------------------------------------------------------------
+{
+  int64_t q = a / b;
+  return (a % b < 0) ? q - 1 : q;
+}
+
+//------------------------------------------------------------------------------
+static uint8_t weekdayOf(int64_t days)
+//------------------------------------------------------------------------------
+{
+  // 1970-01-01 was a thursday
+  int64_t weekday = (days + 4) % 7;
+  return weekday < 0 ? weekday + 7 : weekday;
+}
+
+//------------------------------------------------------------------------------
+static bool isLeapYear(int32_t year)
+//------------------------------------------------------------------------------
+{
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+//------------------------------------------------------------------------------
+static uint8_t daysInMonth(int32_t year, uint8_t month)
+//------------------------------------------------------------------------------
+{
+  static const uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return (month == 2 && isLeapYear(year)) ? 29 : days[month - 1];
+}
+
+//------------------------------------------------------------------------------
+static bool parseNumber(const char*& p, uint16_t min, uint16_t max, uint16_t& value)
+//------------------------------------------------------------------------------
+{
+  if (!isdigit((unsigned char)*p)) {
+    return false;
+  }
+  uint32_t n = 0;
+  while (isdigit((unsigned char)*p) && n <= max) {
+    n = n * 10 + (*p++ - '0');
+  }
+  value = n;
+  return n >= min && n <= max;
+}
+
+//------------------------------------------------------------------------------
+static bool parseName(const char*& p)
+//------------------------------------------------------------------------------
+{
+  // "CET" or quoted "<+0330>"
+  const char* begin = p;
+  if (*p == '<') {
+    while (*p && *p != '>') {
+      ++p;
+    }
+    return *p++ == '>' && p - begin > 2;
+  }
+  while (isalpha((unsigned char)*p)) {
+    ++p;
+  }
+  return p - begin >= 3;
+}
+
+//------------------------------------------------------------------------------
+static bool parseTime(const char*& p, int32_t& seconds)
+//------------------------------------------------------------------------------
+{
+  // [+-]hh[:mm[:ss]], hours up to 167 for transition times
+  int32_t sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = *p++ == '-' ? -1 : 1;
+  }
+  uint16_t hours;
+  uint16_t minutes = 0;
+  uint16_t secs = 0;
+  if (!parseNumber(p, 0, 167, hours)) {
+    return false;
+  }
+  if (*p == ':') {
+    ++p;
+    if (!parseNumber(p, 0, 59, minutes)) {
+      return false;
+    }
+    if (*p == ':') {
+      ++p;
+      if (!parseNumber(p, 0, 59, secs)) {
+        return false;
+      }
+    }
+  }
+  seconds = sign * ((int32_t)hours * 3600 + minutes * 60 + secs);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+PosixTz::PosixTz()
+//------------------------------------------------------------------------------
+{
+  set("UTC0");
+}
+
+//------------------------------------------------------------------------------
+bool PosixTz::set(const char* text)
+//------------------------------------------------------------------------------
+{
+  Rule_t rule;
+  if (strlen(text) >= sizeof(text_) || !parse(text, rule)) {
+    return false;
+  }
+  strcpy(text_, text);
+  rule_ = rule;
+  // invalidate the cached year
+  yearBegin_ = 0;
+  yearEnd_ = 0;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+const char* PosixTz::get()
+//------------------------------------------------------------------------------
+{
+  return text_;
+}
+
+//------------------------------------------------------------------------------
+bool PosixTz::parse(const char* text, Rule_t& rule)
+//------------------------------------------------------------------------------
+{
+  // std offset [dst [offset] [,start[/time],end[/time]]], offsets are west of UTC
+  const char* p = text;
+  int32_t offset;
+  if (!parseName(p) || !parseTime(p, offset)) {
+    return false;
+  }
+  rule.stdOffset = -offset;
+  rule.hasDst = false;
+  if (*p == 0) {
+    return true;
+  }
+
+  if (!parseName(p)) {
+    return false;
+  }
+  rule.hasDst = true;
+  rule.dstOffset = rule.stdOffset + 3600;
+  if (*p && *p != ',') {
+    if (!parseTime(p, offset)) {
+      return false;
+    }
+    rule.dstOffset = -offset;
+  }
+
+  // without rules: US rules, like glibc
+  const char* transitions = *p ? p : ",M3.2.0,M11.1.0";
+  if (*transitions++ != ',' || !parseTransition(transitions, rule.start)) {
+    return false;
+  }
+  if (*transitions++ != ',' || !parseTransition(transitions, rule.end)) {
+    return false;
+  }
+  return *transitions == 0;
+}
+
+//------------------------------------------------------------------------------
+bool PosixTz::parseTransition(const char*& p, Transition_t& transition)
+//------------------------------------------------------------------------------
+{
+  uint16_t value;
+  if (*p == 'M') {
+    ++p;
+    transition.type = Transition_t::MONTH_WEEK_DAY;
+    if (!parseNumber(p, 1, 12, value) || *p++ != '.') {
+      return false;
+    }
+    transition.month = value;
+    if (!parseNumber(p, 1, 5, value) || *p++ != '.') {
+      return false;
+    }
+    transition.week = value;
+    if (!parseNumber(p, 0, 6, value)) {
+      return false;
+    }
+    transition.weekday = value;
+  } else if (*p == 'J') {
+    ++p;
+    transition.type = Transition_t::JULIAN_NO_LEAP;
+    if (!parseNumber(p, 1, 365, transition.day)) {
+      return false;
+    }
+  } else {
+    transition.type = Transition_t::JULIAN;
+    if (!parseNumber(p, 0, 365, transition.day)) {
+      return false;
+    }
+  }
+
+  transition.time = 2 * 3600;
+  if (*p == '/') {
+    ++p;
+    return parseTime(p, transition.time);
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int64_t PosixTz::transitionAt(int32_t year, const Transition_t& transition, int32_t offset)
+//------------------------------------------------------------------------------
+{
+  int64_t days;
+  switch (transition.type) {
+    case Transition_t::MONTH_WEEK_DAY: {
+      // week 5 is the last one of the month
+      int64_t first = daysFromCivil(year, transition.month, 1);
+      days = first + (transition.weekday - weekdayOf(first) + 7) % 7 + (transition.week - 1) * 7;
+      while (days >= first + daysInMonth(year, transition.month)) {
+        days -= 7;
+      }
+      break;
+    }
+    case Transition_t::JULIAN_NO_LEAP:
+      days = daysFromCivil(year, 1, 1) + transition.day - 1;
+      if (transition.day >= 60 && isLeapYear(year)) {
+        ++days;
+      }
+      break;
+    default:
+      days = daysFromCivil(year, 1, 1) + transition.day;
+      break;
+  }
+  return days * SECONDS_PER_DAY + transition.time - offset;
+}
+
+//------------------------------------------------------------------------------
+void PosixTz::cacheYear(int32_t year)
+//------------------------------------------------------------------------------
+{
+  yearBegin_ = daysFromCivil(year, 1, 1) * SECONDS_PER_DAY - rule_.stdOffset;
+  yearEnd_ = daysFromCivil(year + 1, 1, 1) * SECONDS_PER_DAY - rule_.stdOffset;
+  dstStart_ = transitionAt(year, rule_.start, rule_.stdOffset);
+  dstEnd_ = transitionAt(year, rule_.end, rule_.dstOffset);
+}
+
+//------------------------------------------------------------------------------
+void PosixTz::toLocal(int64_t utc, LocalTime_t& local)
+//------------------------------------------------------------------------------
+{
+  bool dst = false;
+  if (rule_.hasDst) {
+    if (utc < yearBegin_ || utc >= yearEnd_) {
+      int32_t year;
+      uint8_t month, day;
+      civilFromDays(floorDiv(utc + rule_.stdOffset, SECONDS_PER_DAY), year, month, day);
+      cacheYear(year);
+    }
+    // on the southern hemisphere DST spans the turn of the year
+    if (dstStart_ < dstEnd_) {
+      dst = utc >= dstStart_ && utc < dstEnd_;
+    } else {
+      dst = utc < dstEnd_ || utc >= dstStart_;
+    }
+  }
+
+  int32_t offset = dst ? rule_.dstOffset : rule_.stdOffset;
+  int64_t seconds = utc + offset;
+  int64_t days = floorDiv(seconds, SECONDS_PER_DAY);
+  int32_t secondOfDay = seconds - days * SECONDS_PER_DAY;
+
+  int32_t year;
+  civilFromDays(days, year, local.month, local.day);
+  local.year = year;
+  local.hour = secondOfDay / 3600;
+  local.minute = (secondOfDay / 60) % 60;
+  local.second = secondOfDay % 60;
+  local.weekday = weekdayOf(days);
+  local.dst = dst;
+  local.offset = offset;
+}
+
+//------------------------------------------------------------------------------
+int64_t PosixTz::daysFromCivil(int32_t year, uint8_t month, uint8_t day)
+//------------------------------------------------------------------------------
+{
+  // http://howardhinnant.github.io/date_algorithms.html, eras of 400 years
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yearOfEra = year - era * 400;
+  uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return (int64_t)era * 146097 + dayOfEra - 719468;
+}
+
+//------------------------------------------------------------------------------
+void PosixTz::civilFromDays(int64_t days, int32_t& year, uint8_t& month, uint8_t& day)
+//------------------------------------------------------------------------------
+{
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  uint32_t dayOfEra = days - era * 146097;
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t mp = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yearOfEra + era * 400 + (month <= 2);
+}
+
+//------------------------------------------------------------------------------
+int64_t PosixTz::toUtc(int32_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second)
+//------------------------------------------------------------------------------
+{
+  return daysFromCivil(year, month, day) * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+}
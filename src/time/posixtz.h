@@ -0,0 +1,87 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "time/tzdb.h"
+
+struct LocalTime_t {
+  uint16_t year;
+  uint8_t month;    // 1..12
+  uint8_t day;      // 1..31
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint8_t weekday;  // 0 = sunday
+  bool dst;
+  int32_t offset;   // s east of UTC
+};
+
+// Evaluates a POSIX TZ rule like "CET-1CEST,M3.5.0,M10.5.0/3" (the rules of the TzDb table) without
+// libc or ezTime. Works on 64 bit seconds, so it is not limited by a 32 bit time_t (2038), and uses the
+// proleptic gregorian calendar, so 2100 is no leap year.
+// The DST transitions are cached per year, converting within the same year is a few divisions.
+class PosixTz {
+ public:
+  PosixTz();
+
+  // false if the rule can't be parsed, the previous rule stays active then
+  bool set(const char* rule);
+  const char* get();
+
+  void toLocal(int64_t utc, LocalTime_t& local);
+
+  // days since 1970-01-01 <-> calendar date
+  static int64_t daysFromCivil(int32_t year, uint8_t month, uint8_t day);
+  static void civilFromDays(int64_t days, int32_t& year, uint8_t& month, uint8_t& day);
+  static int64_t toUtc(int32_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+
+ private:
+  // Mm.w.d (month, week 1..5, weekday), Jn (1..365, no feb 29) or n (0..365)
+  struct Transition_t {
+    enum { MONTH_WEEK_DAY, JULIAN_NO_LEAP, JULIAN } type;
+    uint8_t month;
+    uint8_t week;
+    uint8_t weekday;
+    uint16_t day;
+    int32_t time;  // s after local midnight, may be negative or > 24h
+  };
+
+  struct Rule_t {
+    int32_t stdOffset;  // s east of UTC
+    int32_t dstOffset;
+    bool hasDst;
+    Transition_t start;  // in standard time
+    Transition_t end;    // in daylight saving time
+  };
+
+  static bool parse(const char* text, Rule_t& rule);
+  static bool parseTransition(const char*& p, Transition_t& transition);
+  static int64_t transitionAt(int32_t year, const Transition_t& transition, int32_t offset);
+  void cacheYear(int32_t year);
+
+  char text_[TZ_RULE_SIZE];
+  Rule_t rule_;
+
+  // the year the transitions are cached for, in UTC s of standard time
+  int64_t yearBegin_;
+  int64_t yearEnd_;
+  int64_t dstStart_;
+  int64_t dstEnd_;
+};
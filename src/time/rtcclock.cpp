@@ -0,0 +1,97 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time/rtcclock.h"
+
+#include <esp_attr.h>
+#include <sys/time.h>
+
+#include "util/crc32.h"
+
+#define RTC_MAGIC 0x434C4B31  // "CLK1"
+
+// anything earlier is an unset RTC
+#define RTC_MIN_UTC (1577836800LL * 1000000LL)  // 2020-01-01
+
+struct RtcClockState_t {
+  uint32_t magic;
+  int32_t driftPpb;
+  int64_t lastSync;
+  char tzRule[TZ_RULE_SIZE];
+  uint32_t crc;  // over the fields above
+};
+
+// Not initialized on boot, so it keeps its content across software resets and deep sleep.
+RTC_NOINIT_ATTR static RtcClockState_t rtcState;
+
+//------------------------------------------------------------------------------
+RtcClock::RtcClock(Clock& clock)
+    : LOG("RtcClock"),
+      clock_(clock)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool RtcClock::restore(char* tzRule, size_t size)
+//------------------------------------------------------------------------------
+{
+  if (rtcState.magic != RTC_MAGIC || Crc32::compute(&rtcState, offsetof(RtcClockState_t, crc)) != rtcState.crc) {
+    LOG.i("No clock in RTC memory");
+    return false;
+  }
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int64_t utc = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+  if (utc < RTC_MIN_UTC || utc < rtcState.lastSync) {
+    LOG.w("RTC time not plausible");
+    return false;
+  }
+
+  clock_.set(utc);
+  clock_.setDriftPpb(rtcState.driftPpb);
+  strncpy(tzRule, rtcState.tzRule, size);
+  tzRule[size - 1] = 0;
+  LOG.i("Clock restored, %" PRId64 "s since the last sync, drift %dppb, tz '%s'", (utc - rtcState.lastSync) / 1000000,
+        (int)rtcState.driftPpb, tzRule);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void RtcClock::save(const char* tzRule)
+//------------------------------------------------------------------------------
+{
+  int64_t utc = clock_.now();
+  if (utc < RTC_MIN_UTC) {
+    return;
+  }
+
+#ifdef ESP_PLATFORM
+  // the host keeps its own system time
+  struct timeval tv;
+  tv.tv_sec = utc / 1000000;
+  tv.tv_usec = utc % 1000000;
+  settimeofday(&tv, NULL);
+#endif
+
+  rtcState.magic = RTC_MAGIC;
+  rtcState.driftPpb = clock_.getDriftPpb();
+  rtcState.lastSync = clock_.getLastSync() ? clock_.getLastSync() : utc;
+  strncpy(rtcState.tzRule, tzRule, sizeof(rtcState.tzRule));
+  rtcState.tzRule[sizeof(rtcState.tzRule) - 1] = 0;
+  rtcState.crc = Crc32::compute(&rtcState, offsetof(RtcClockState_t, crc));
+}
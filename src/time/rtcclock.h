@@ -0,0 +1,42 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "time/clock.h"
+#include "time/tzdb.h"
+#include "util/logger.h"
+
+// Keeps the clock over software resets and deep sleep.
+// The system time (gettimeofday) of the IDF runs on the RTC timer, which is not reset by them.
+// The rate estimate and the timezone rule are kept next to it in RTC memory. After a power loss
+// both are gone and the clock waits for NTP as before.
+class RtcClock {
+ public:
+  RtcClock(Clock& clock);
+
+  // true if the clock was set from the RTC, tzRule gets the rule that was in use
+  bool restore(char* tzRule, size_t size);
+  // after each sync and timezone change
+  void save(const char* tzRule);
+
+ private:
+  Logger LOG;
+  Clock& clock_;
+};
@@ -0,0 +1,69 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time/tzdb.h"
+
+#include "time/tzdb_data.h"
+
+//------------------------------------------------------------------------------
+const char* TzDb::lookup(const char* name)
+//------------------------------------------------------------------------------
+{
+  size_t low = 0;
+  size_t high = TZDB_ZONES;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int cmp = strcmp(name, tzdbNames + tzdbEntries[mid].name);
+    if (cmp == 0) {
+      return tzdbRules + tzdbEntries[mid].rule;
+    }
+    if (cmp < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+size_t TzDb::size()
+//------------------------------------------------------------------------------
+{
+  return TZDB_ZONES;
+}
+
+//------------------------------------------------------------------------------
+const char* TzDb::getName(size_t index)
+//------------------------------------------------------------------------------
+{
+  return tzdbNames + tzdbEntries[index].name;
+}
+
+//------------------------------------------------------------------------------
+const char* TzDb::getRule(size_t index)
+//------------------------------------------------------------------------------
+{
+  return tzdbRules + tzdbEntries[index].rule;
+}
+
+//------------------------------------------------------------------------------
+const char* TzDb::getVersion()
+//------------------------------------------------------------------------------
+{
+  return TZDB_VERSION;
+}
@@ -0,0 +1,45 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// POSIX TZ rule, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+#ifndef TZ_RULE_SIZE
+#define TZ_RULE_SIZE 64
+#endif
+
+struct TzdbEntry_t {
+  uint16_t name;  // offset in the name pool
+  uint16_t rule;  // offset in the rule pool
+};
+
+// Compiled-in timezone table, Olson name -> POSIX TZ rule.
+// Generated at build time by tools/tzdb.py from tools/zones.csv, sorted by name and
+// searched binary, so resolving a timezone needs neither network nor heap.
+class TzDb {
+ public:
+  // NULL if unknown
+  static const char* lookup(const char* name);
+
+  static size_t size();
+  // by index in name order, index < size()
+  static const char* getName(size_t index);
+  static const char* getRule(size_t index);
+  static const char* getVersion();
+};
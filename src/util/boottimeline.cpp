@@ -0,0 +1,92 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/boottimeline.h"
+
+//------------------------------------------------------------------------------
+BootTimeline::BootTimeline()
+    : LOG("Boot"),
+      count_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+void BootTimeline::mark(const char* stage)
+//------------------------------------------------------------------------------
+{
+  int64_t now = esp_timer_get_time();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint8_t i = 0; i < count_; ++i) {
+    if (strcmp(stages_[i].name, stage) == 0) {
+      return;
+    }
+  }
+  if (count_ < BOOT_TIMELINE_MAX_STAGES) {
+    stages_[count_].name = stage;
+    stages_[count_].time = now;
+    ++count_;
+  }
+}
+
+//------------------------------------------------------------------------------
+bool BootTimeline::has(const char* stage)
+//------------------------------------------------------------------------------
+{
+  return get(stage) >= 0;
+}
+
+//------------------------------------------------------------------------------
+int64_t BootTimeline::get(const char* stage)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint8_t i = 0; i < count_; ++i) {
+    if (strcmp(stages_[i].name, stage) == 0) {
+      return stages_[i].time;
+    }
+  }
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+void BootTimeline::print()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t last = 0;
+  for (uint8_t i = 0; i < count_; ++i) {
+    LOG.i("%-16s %8" PRId64 "µs (+%" PRId64 "µs)", stages_[i].name, stages_[i].time, stages_[i].time - last);
+    last = stages_[i].time;
+  }
+}
+
+//------------------------------------------------------------------------------
+String BootTimeline::toJson()
+//------------------------------------------------------------------------------
+{
+  char line[64];
+  String result = "{\"stages\":[";
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint8_t i = 0; i < count_; ++i) {
+    snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"us\":%" PRId64 "}", i ? "," : "", stages_[i].name, stages_[i].time);
+    result += line;
+  }
+  result += "]}";
+  return result;
+}
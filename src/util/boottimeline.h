@@ -0,0 +1,55 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <mutex>
+
+#include "util/logger.h"
+
+#ifndef BOOT_TIMELINE_MAX_STAGES
+#define BOOT_TIMELINE_MAX_STAGES 24
+#endif
+
+// Records when each boot stage finished, in µs since the esp_timer started.
+// mark() may be called from any task (setup(), the WiFi event task, the NVS loader),
+// the first mark of a stage wins so repeated events like reconnects don't move it.
+// The stage names must be string literals, they are not copied.
+class BootTimeline {
+ public:
+  BootTimeline();
+
+  void mark(const char* stage);
+  bool has(const char* stage);
+  int64_t get(const char* stage);
+
+  void print();
+  String toJson();
+
+ private:
+  struct Stage_t {
+    const char* name;
+    int64_t time;
+  };
+
+  Logger LOG;
+  std::mutex mutex_;
+  Stage_t stages_[BOOT_TIMELINE_MAX_STAGES];
+  uint8_t count_;
+};
@@ -0,0 +1,80 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// String with inline storage for N - 1 characters, never touches the heap.
+// Longer values are truncated.
+template <size_t N>
+class FixedString {
+ public:
+  FixedString() { buffer_[0] = 0; }
+  FixedString(const char* value) { assign(value); }
+
+  void assign(const char* value) {
+    strncpy(buffer_, value, N - 1);
+    buffer_[N - 1] = 0;
+  }
+  FixedString& operator=(const char* value) {
+    assign(value);
+    return *this;
+  }
+
+  const char* c_str() const { return buffer_; }
+  char* data() { return buffer_; }
+  size_t length() const { return strlen(buffer_); }
+  static constexpr size_t capacity() { return N - 1; }
+
+  bool equals(const char* other) const { return strcmp(buffer_, other) == 0; }
+
+ private:
+  char buffer_[N];
+};
+
+// Print into inline storage for N - 1 characters, e.g. to format a message without a String.
+// What doesn't fit is dropped and flagged.
+template <size_t N>
+class FixedPrint : public Print {
+ public:
+  FixedPrint() { clear(); }
+
+  virtual size_t write(uint8_t c) {
+    if (length_ >= N - 1) {
+      overflow_ = true;
+      return 0;
+    }
+    buffer_[length_++] = c;
+    buffer_[length_] = 0;
+    return 1;
+  }
+
+  const char* c_str() const { return buffer_; }
+  size_t length() const { return length_; }
+  bool isOverflow() const { return overflow_; }
+  void clear() {
+    buffer_[0] = 0;
+    length_ = 0;
+    overflow_ = false;
+  }
+
+ private:
+  char buffer_[N];
+  size_t length_;
+  bool overflow_;
+};
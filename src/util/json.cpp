@@ -0,0 +1,466 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/json.h"
+
+#include <math.h>
+
+//------------------------------------------------------------------------------
+JsonWriter::JsonWriter(Print& out)
+    : out_(out),
+      depth_(0)
+//------------------------------------------------------------------------------
+{
+  first_[0] = true;
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::beginObject(const char* name)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  out_.print("{");
+  if (depth_ < JSON_MAX_DEPTH) {
+    first_[++depth_] = true;
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::endObject()
+//------------------------------------------------------------------------------
+{
+  out_.print("}");
+  if (depth_ > 0) {
+    --depth_;
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::beginArray(const char* name)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  out_.print("[");
+  if (depth_ < JSON_MAX_DEPTH) {
+    first_[++depth_] = true;
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::endArray()
+//------------------------------------------------------------------------------
+{
+  out_.print("]");
+  if (depth_ > 0) {
+    --depth_;
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::string(const char* name, const char* value)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  quoted(value);
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::integer(const char* name, int64_t value)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  out_.printf("%" PRId64, value);
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::real(const char* name, double value, uint8_t decimals)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  if (isfinite(value)) {
+    out_.printf("%.*f", decimals, value);
+  } else {
+    // JSON has no NaN
+    out_.print("null");
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::boolean(const char* name, bool value)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  out_.print(value ? "true" : "false");
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::null(const char* name)
+//------------------------------------------------------------------------------
+{
+  separate(name);
+  out_.print("null");
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::separate(const char* name)
+//------------------------------------------------------------------------------
+{
+  if (!first_[depth_]) {
+    out_.print(",");
+  }
+  first_[depth_] = false;
+  if (name) {
+    quoted(name);
+    out_.print(":");
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonWriter::quoted(const char* text)
+//------------------------------------------------------------------------------
+{
+  out_.print("\"");
+  // the runs without anything to escape in one write
+  const char* run = text;
+  for (const char* p = text; *p; ++p) {
+    uint8_t c = *p;
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    out_.write((const uint8_t*)run, p - run);
+    run = p + 1;
+    switch (c) {
+      case '"':
+        out_.print("\\\"");
+        break;
+      case '\\':
+        out_.print("\\\\");
+        break;
+      case '\n':
+        out_.print("\\n");
+        break;
+      case '\r':
+        out_.print("\\r");
+        break;
+      case '\t':
+        out_.print("\\t");
+        break;
+      default:
+        out_.printf("\\u%04x", c);
+        break;
+    }
+  }
+  out_.write((const uint8_t*)run, strlen(run));
+  out_.print("\"");
+}
+
+//------------------------------------------------------------------------------
+JsonReader::JsonReader(const char* data, size_t length)
+    : data_(data),
+      length_(length),
+      position_(0),
+      depth_(0),
+      tokenDepth_(0),
+      started_(false),
+      afterValue_(false),
+      opened_(false),
+      error_(NULL),
+      number_(0),
+      bool_(false)
+//------------------------------------------------------------------------------
+{
+  key_[0] = 0;
+  string_[0] = 0;
+}
+
+//------------------------------------------------------------------------------
+JsonToken_t JsonReader::next()
+//------------------------------------------------------------------------------
+{
+  if (error_) {
+    return JSON_ERROR;
+  }
+  skipWhitespace();
+  if (position_ >= length_) {
+    return started_ && depth_ == 0 ? JSON_END : fail("unexpected end");
+  }
+  char c = data_[position_];
+
+  // end of an object or array, after a value or right after its beginning
+  if (c == '}' || c == ']') {
+    if (depth_ == 0 || inObject_[depth_ - 1] != (c == '}') || !(afterValue_ || opened_)) {
+      return fail("unexpected end of object or array");
+    }
+    ++position_;
+    tokenDepth_ = --depth_;
+    afterValue_ = true;
+    opened_ = false;
+    key_[0] = 0;
+    return c == '}' ? JSON_OBJECT_END : JSON_ARRAY_END;
+  }
+
+  if (started_ && depth_ == 0) {
+    return fail("data after the end");
+  }
+  if (afterValue_) {
+    if (c != ',') {
+      return fail("',' expected");
+    }
+    ++position_;
+    skipWhitespace();
+  }
+  afterValue_ = false;
+  opened_ = false;
+
+  key_[0] = 0;
+  if (depth_ > 0 && inObject_[depth_ - 1]) {
+    if (position_ >= length_ || data_[position_] != '"' || !readString(key_, sizeof(key_))) {
+      return fail(error_ ? error_ : "member name expected");
+    }
+    skipWhitespace();
+    if (position_ >= length_ || data_[position_] != ':') {
+      return fail("':' expected");
+    }
+    ++position_;
+    skipWhitespace();
+  }
+  if (position_ >= length_) {
+    return fail("value expected");
+  }
+
+  started_ = true;
+  tokenDepth_ = depth_;
+  c = data_[position_];
+  if (c == '{' || c == '[') {
+    if (depth_ >= JSON_MAX_DEPTH) {
+      return fail("nested too deep");
+    }
+    ++position_;
+    inObject_[depth_++] = c == '{';
+    opened_ = true;
+    return c == '{' ? JSON_OBJECT : JSON_ARRAY;
+  }
+
+  afterValue_ = true;
+  if (c == '"') {
+    return readString(string_, sizeof(string_)) ? JSON_STRING : fail(error_);
+  }
+  if (c == '-' || (c >= '0' && c <= '9')) {
+    return readNumber() ? JSON_NUMBER : fail("invalid number");
+  }
+  if (readLiteral("true")) {
+    bool_ = true;
+    return JSON_BOOL;
+  }
+  if (readLiteral("false")) {
+    bool_ = false;
+    return JSON_BOOL;
+  }
+  if (readLiteral("null")) {
+    return JSON_NULL;
+  }
+  return fail("invalid value");
+}
+
+//------------------------------------------------------------------------------
+const char* JsonReader::getKey()
+//------------------------------------------------------------------------------
+{
+  return key_;
+}
+
+//------------------------------------------------------------------------------
+const char* JsonReader::getString()
+//------------------------------------------------------------------------------
+{
+  return string_;
+}
+
+//------------------------------------------------------------------------------
+double JsonReader::getNumber()
+//------------------------------------------------------------------------------
+{
+  return number_;
+}
+
+//------------------------------------------------------------------------------
+bool JsonReader::getBool()
+//------------------------------------------------------------------------------
+{
+  return bool_;
+}
+
+//------------------------------------------------------------------------------
+uint8_t JsonReader::getDepth()
+//------------------------------------------------------------------------------
+{
+  return tokenDepth_;
+}
+
+//------------------------------------------------------------------------------
+const char* JsonReader::getError()
+//------------------------------------------------------------------------------
+{
+  return error_ ? error_ : "";
+}
+
+//------------------------------------------------------------------------------
+JsonToken_t JsonReader::fail(const char* error)
+//------------------------------------------------------------------------------
+{
+  error_ = error;
+  return JSON_ERROR;
+}
+
+//------------------------------------------------------------------------------
+void JsonReader::skipWhitespace()
+//------------------------------------------------------------------------------
+{
+  while (position_ < length_) {
+    char c = data_[position_];
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      return;
+    }
+    ++position_;
+  }
+}
+
+//------------------------------------------------------------------------------
+bool JsonReader::readString(char* target, size_t size)
+//------------------------------------------------------------------------------
+{
+  // at the opening quote
+  size_t length = 0;
+  ++position_;
+  while (position_ < length_) {
+    uint8_t c = data_[position_++];
+    uint32_t code = c;
+    if (c == '"') {
+      target[length] = 0;
+      return true;
+    }
+    if (c < 0x20) {
+      error_ = "control character in string";
+      return false;
+    }
+    if (c == '\\') {
+      if (position_ >= length_) {
+        break;
+      }
+      switch (data_[position_++]) {
+        case '"':
+          code = '"';
+          break;
+        case '\\':
+          code = '\\';
+          break;
+        case '/':
+          code = '/';
+          break;
+        case 'b':
+          code = '\b';
+          break;
+        case 'f':
+          code = '\f';
+          break;
+        case 'n':
+          code = '\n';
+          break;
+        case 'r':
+          code = '\r';
+          break;
+        case 't':
+          code = '\t';
+          break;
+        case 'u': {
+          char hex[5] = {};
+          if (position_ + 4 > length_) {
+            error_ = "unterminated string";
+            return false;
+          }
+          memcpy(hex, data_ + position_, 4);
+          char* end;
+          code = strtoul(hex, &end, 16);
+          position_ += 4;
+          // surrogate pairs are not needed for names and settings
+          if (end != hex + 4 || (code >= 0xD800 && code <= 0xDFFF)) {
+            error_ = "unsupported escape in string";
+            return false;
+          }
+          break;
+        }
+        default:
+          error_ = "invalid escape in string";
+          return false;
+      }
+    }
+
+    // code points from escapes as UTF-8, everything else as it is
+    uint8_t bytes[3];
+    uint8_t count;
+    if (c == '\\' && code >= 0x800) {
+      bytes[0] = 0xE0 | (code >> 12);
+      bytes[1] = 0x80 | ((code >> 6) & 0x3F);
+      bytes[2] = 0x80 | (code & 0x3F);
+      count = 3;
+    } else if (c == '\\' && code >= 0x80) {
+      bytes[0] = 0xC0 | (code >> 6);
+      bytes[1] = 0x80 | (code & 0x3F);
+      count = 2;
+    } else {
+      bytes[0] = code;
+      count = 1;
+    }
+    if (length + count >= size) {
+      error_ = "string too long";
+      return false;
+    }
+    memcpy(target + length, bytes, count);
+    length += count;
+  }
+  error_ = "unterminated string";
+  return false;
+}
+
+//------------------------------------------------------------------------------
+bool JsonReader::readNumber()
+//------------------------------------------------------------------------------
+{
+  size_t length = 0;
+  while (position_ < length_ && strchr("+-.eE0123456789", data_[position_]) && data_[position_]) {
+    if (length + 1 >= sizeof(string_)) {
+      return false;
+    }
+    string_[length++] = data_[position_++];
+  }
+  string_[length] = 0;
+  char* end;
+  number_ = strtod(string_, &end);
+  return length > 0 && end == string_ + length;
+}
+
+//------------------------------------------------------------------------------
+bool JsonReader::readLiteral(const char* literal)
+//------------------------------------------------------------------------------
+{
+  size_t length = strlen(literal);
+  if (position_ + length > length_ || strncmp(data_ + position_, literal, length) != 0) {
+    return false;
+  }
+  position_ += length;
+  return true;
+}
@@ -0,0 +1,113 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// nesting of objects and arrays
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 8
+#endif
+
+// member names and string values, including the NUL
+#ifndef JSON_MAX_STRING
+#define JSON_MAX_STRING 64
+#endif
+
+enum JsonToken_t {
+  JSON_END = 0,
+  JSON_ERROR,
+  JSON_OBJECT,
+  JSON_OBJECT_END,
+  JSON_ARRAY,
+  JSON_ARRAY_END,
+  JSON_STRING,
+  JSON_NUMBER,
+  JSON_BOOL,
+  JSON_NULL
+};
+
+// Writes JSON straight into a Print (a HttpResponse, Serial, ...), nothing is kept but the comma state
+// of each nesting level. Inside objects every value needs a name, inside arrays and at the top it is NULL.
+class JsonWriter {
+ public:
+  JsonWriter(Print& out);
+
+  void beginObject(const char* name = NULL);
+  void endObject();
+  void beginArray(const char* name = NULL);
+  void endArray();
+
+  void string(const char* name, const char* value);
+  void integer(const char* name, int64_t value);
+  void real(const char* name, double value, uint8_t decimals = 3);
+  void boolean(const char* name, bool value);
+  void null(const char* name);
+
+ private:
+  void separate(const char* name);
+  void quoted(const char* text);
+
+  Print& out_;
+  uint8_t depth_;
+  bool first_[JSON_MAX_DEPTH + 1];
+};
+
+// Pull parser: next() returns one token after the other, values in objects together with their member
+// name. No tree and no heap, the strings are decoded into fixed buffers and longer ones are an error,
+// so the memory is bounded whatever the input is. The document is checked completely, the last token
+// of a valid one is JSON_END.
+class JsonReader {
+ public:
+  JsonReader(const char* data, size_t length);
+
+  JsonToken_t next();
+
+  // member name of the last token, empty outside of objects
+  const char* getKey();
+  // JSON_STRING decoded, JSON_NUMBER as written
+  const char* getString();
+  double getNumber();
+  bool getBool();
+  // of the last token, 0 for the top level value, 1 for its members
+  uint8_t getDepth();
+  // what was wrong, after JSON_ERROR
+  const char* getError();
+
+ private:
+  JsonToken_t fail(const char* error);
+  void skipWhitespace();
+  bool readString(char* target, size_t size);
+  bool readNumber();
+  bool readLiteral(const char* literal);
+
+  const char* data_;
+  size_t length_;
+  size_t position_;
+  uint8_t depth_;
+  uint8_t tokenDepth_;
+  bool inObject_[JSON_MAX_DEPTH];
+  bool started_;
+  bool afterValue_;
+  bool opened_;
+  const char* error_;
+  char key_[JSON_MAX_STRING];
+  char string_[JSON_MAX_STRING];
+  double number_;
+  bool bool_;
+};
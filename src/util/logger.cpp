@@ -1,159 +1,352 @@
-/* 
- * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
- * Copyright (c) 2019 Lars Brandt.
- * 
- * This program is free software: you can redistribute it and/or modify  
- * it under the terms of the GNU General Public License as published by  
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but 
- * WITHOUT ANY WARRANTY; without even the implied warranty of 
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
- * General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License 
- * along with this program. If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "logger.h"
-
-const char* Logger::level_str_[6] = {"F", "E", "W", "I", "D", "V"};
-
-//------------------------------------------------------------------------------
-Logger::Logger(const String& module)
-    : Print(),
-      module_(module)
-//------------------------------------------------------------------------------
-{}
-
-//------------------------------------------------------------------------------
-const void Logger::f(const char* msg, ...)
-//------------------------------------------------------------------------------
-{
-  print("\u001b[41m");  // background red
-  printPrefix(FATAL);
-
-  char buffer[1024];
-  va_list args;
-  va_start(args, msg);
-  vsprintf(buffer, msg, args);
-  va_end(args);
-  print(&buffer[0]);
-
-  print("\u001b[0m");  // reset
-  write('\n');
-}
-
-//------------------------------------------------------------------------------
-const void Logger::e(const char* msg, ...)
-//------------------------------------------------------------------------------
-{
-  print("\u001b[31;1m");  // bright red
-  printPrefix(ERROR);
-
-  char buffer[1024];
-  va_list args;
-  va_start(args, msg);
-  vsprintf(buffer, msg, args);
-  va_end(args);
-  print(&buffer[0]);
-
-  print("\u001b[0m");  // reset
-  write('\n');
-}
-
-//------------------------------------------------------------------------------
-const void Logger::w(const char* msg, ...)
-//------------------------------------------------------------------------------
-{
-  print("\u001b[33;1m");  // bright yellow
-  printPrefix(WARN);
-
-  char buffer[1024];
-  va_list args;
-  va_start(args, msg);
-  vsprintf(buffer, msg, args);
-  va_end(args);
-  print(&buffer[0]);
-
-  print("\u001b[0m");  // reset
-  write('\n');
-}
-
-//------------------------------------------------------------------------------
-const void Logger::i(const char* msg, ...)
-//------------------------------------------------------------------------------
-{
-  printPrefix(INFO);
-
-  char buffer[1024];
-  va_list args;
-  va_start(args, msg);
-  vsprintf(buffer, msg, args);
-  va_end(args);
-  print(&buffer[0]);
-
-  write('\n');
-}
-
-//------------------------------------------------------------------------------
-const void Logger::d(const char* msg, ...)
-//------------------------------------------------------------------------------
-{
-  printPrefix(DEBUG);
-
-  char buffer[1024];
-  va_list args;
-  va_start(args, msg);
-  vsprintf(buffer, msg, args);
-  va_end(args);
-  print(&buffer[0]);
-
-  write('\n');
-}
-
-//------------------------------------------------------------------------------
-const void Logger::v(const char* msg, ...)
-//------------------------------------------------------------------------------
-{
-  printPrefix(VERBOSE);
-
-  char buffer[1024];
-  va_list args;
-  va_start(args, msg);
-  vsprintf(buffer, msg, args);
-  va_end(args);
-  print(&buffer[0]);
-
-  write('\n');
-}
-
-//------------------------------------------------------------------------------
-size_t Logger::write(uint8_t c)
-//------------------------------------------------------------------------------
-{
-  return Serial.write(c);
-};
-
-//------------------------------------------------------------------------------
-const void Logger::printPrefix(Loglevel_t loglevel)
-//------------------------------------------------------------------------------
-{
-  using namespace std::chrono;
-  auto ms = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch());
-
-  auto secs = duration_cast<seconds>(ms);
-  ms -= duration_cast<milliseconds>(secs);
-  auto mins = duration_cast<minutes>(secs);
-  secs -= duration_cast<seconds>(mins);
-  auto hour = duration_cast<hours>(mins);
-  mins -= duration_cast<minutes>(hour);
-
-  Serial.print("* [");
-  Serial.print(level_str_[loglevel]);
-  Serial.print("] [");
-  Serial.printf("%d:%02d:%02d.%03d", (int16_t)hour.count(), (int16_t)mins.count(), (int16_t)secs.count(), (int16_t)ms.count());
-  Serial.print("] [");
-  Serial.print(module_);
-  Serial.print("] - ");
-}
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "logger.h"
+
+const char* Logger::level_str_[6] = {"F", "E", "W", "I", "D", "V"};
+const char* Logger::level_color_[6] = {
+    "\u001b[41m",     // background red
+    "\u001b[31;1m",   // bright red
+    "\u001b[33;1m",   // bright yellow
+    NULL, NULL, NULL  // no color
+};
+Logger* Logger::first_ = NULL;
+std::mutex Logger::listMutex_;
+
+//------------------------------------------------------------------------------
+LogLimit::LogLimit(uint16_t burst, uint32_t refillMs)
+    : burst_(burst),
+      refillMs_(refillMs),
+      tokens_(burst),
+      lastRefill_(millis()),
+      dropped_(0)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool LogLimit::take()
+//------------------------------------------------------------------------------
+{
+  uint32_t now = millis();
+  uint32_t refill = (now - lastRefill_) / refillMs_;
+  if (refill) {
+    tokens_ = (tokens_ + refill > burst_) ? burst_ : tokens_ + refill;
+    lastRefill_ += refill * refillMs_;
+  }
+
+  if (tokens_) {
+    --tokens_;
+    return true;
+  }
+  ++dropped_;
+  return false;
+}
+
+//------------------------------------------------------------------------------
+uint32_t LogLimit::takeDropped()
+//------------------------------------------------------------------------------
+{
+  uint32_t dropped = dropped_;
+  dropped_ = 0;
+  return dropped;
+}
+
+//------------------------------------------------------------------------------
+Logger::Logger(const String& module)
+    : Print(),
+      module_(module),
+      lastHash_(0),
+      lastLength_(0),
+      lastLevel_(INFO),
+      repeated_(0),
+      repeatStart_(0)
+//------------------------------------------------------------------------------
+{
+  buffer[0] = 0;
+  std::lock_guard<std::mutex> lock(listMutex_);
+  next_ = first_;
+  first_ = this;
+}
+
+//------------------------------------------------------------------------------
+Logger::~Logger()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(listMutex_);
+  for (Logger** p = &first_; *p; p = &(*p)->next_) {
+    if (*p == this) {
+      *p = next_;
+      break;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void Logger::loop()
+//------------------------------------------------------------------------------
+{
+  // a storm that stopped gets its summary too, not only when the next line comes through
+  std::lock_guard<std::mutex> lock(listMutex_);
+  for (Logger* logger = first_; logger; logger = logger->next_) {
+    std::lock_guard<std::mutex> loggerLock(logger->mutex_);
+    if (logger->repeated_ && millis() - logger->repeatStart_ >= LOGGER_REPEAT_FLUSH_MS) {
+      logger->flushRepeated();
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+const void Logger::f(const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(FATAL, NULL, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::e(const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(ERROR, NULL, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::w(const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(WARN, NULL, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::i(const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(INFO, NULL, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::d(const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(DEBUG, NULL, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::v(const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(VERBOSE, NULL, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::f(LogLimit& limit, const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(FATAL, &limit, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::e(LogLimit& limit, const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(ERROR, &limit, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::w(LogLimit& limit, const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(WARN, &limit, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::i(LogLimit& limit, const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(INFO, &limit, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::d(LogLimit& limit, const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(DEBUG, &limit, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+const void Logger::v(LogLimit& limit, const char* msg, ...)
+//------------------------------------------------------------------------------
+{
+  va_list args;
+  va_start(args, msg);
+  log(VERBOSE, &limit, msg, args);
+  va_end(args);
+}
+
+//------------------------------------------------------------------------------
+size_t Logger::write(uint8_t c)
+//------------------------------------------------------------------------------
+{
+  return Serial.write(c);
+};
+
+//------------------------------------------------------------------------------
+const void Logger::log(Loglevel_t loglevel, LogLimit* limit, const char* msg, va_list args)
+//------------------------------------------------------------------------------
+{
+  // Event callbacks run in their own task, so the shared buffer must be guarded.
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (limit && !limit->take()) {
+    return;
+  }
+
+  // the last line stays at the start of the buffer, the new one is formatted behind it to be compared
+  size_t room = sizeof(buffer) - lastLength_ - 1;
+  char* text = buffer + lastLength_ + 1;
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(text, room, msg, copy);
+  va_end(copy);
+  bool fits = length >= 0 && (size_t)length < room;
+
+  // FNV-1a, cheap enough to run on every line; equal hashes are confirmed on the text
+  uint32_t hash = 2166136261u;
+  for (const char* c = text; fits && *c; ++c) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+
+  if (fits && hash == lastHash_ && loglevel == lastLevel_ && (size_t)length == lastLength_ &&
+      memcmp(text, buffer, length) == 0) {
+    if (repeated_ == 0) {
+      repeatStart_ = millis();
+    }
+    ++repeated_;
+    if (millis() - repeatStart_ >= LOGGER_REPEAT_FLUSH_MS) {
+      flushRepeated();
+    }
+    return;
+  }
+
+  // behind a long last line there was no room, formatted again at the start. Lines longer than half the
+  // buffer are therefore not collapsed.
+  if (fits) {
+    memmove(buffer, text, length + 1);
+  } else {
+    length = max(vsnprintf(buffer, sizeof(buffer), msg, args), 0);
+    hash = 0;
+  }
+  lastLength_ = min((size_t)length, sizeof(buffer) - 1);
+
+  flushRepeated();
+  if (limit) {
+    uint32_t dropped = limit->takeDropped();
+    if (dropped) {
+      char note[48];
+      snprintf(note, sizeof(note), "%u messages suppressed", (unsigned)dropped);
+      printLine(loglevel, note);
+    }
+  }
+  printLine(loglevel, buffer);
+
+  lastHash_ = hash;
+  lastLevel_ = loglevel;
+}
+
+//------------------------------------------------------------------------------
+const void Logger::printLine(Loglevel_t loglevel, const char* text)
+//------------------------------------------------------------------------------
+{
+  const char* color = level_color_[loglevel];
+  if (color) {
+    print(color);
+  }
+  printPrefix(loglevel);
+  print(text);
+  if (color) {
+    print("\u001b[0m");  // reset
+  }
+  write('\n');
+}
+
+//------------------------------------------------------------------------------
+const void Logger::flushRepeated()
+//------------------------------------------------------------------------------
+{
+  if (repeated_) {
+    char note[48];
+    snprintf(note, sizeof(note), "last message repeated %u times", (unsigned)repeated_);
+    printLine(lastLevel_, note);
+    repeated_ = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+const void Logger::printPrefix(Loglevel_t loglevel)
+//------------------------------------------------------------------------------
+{
+  // uptime, the system clock may be set to wall clock time
+  using namespace std::chrono;
+  auto ms = milliseconds(esp_timer_get_time() / 1000);
+
+  auto secs = duration_cast<seconds>(ms);
+  ms -= duration_cast<milliseconds>(secs);
+  auto mins = duration_cast<minutes>(secs);
+  secs -= duration_cast<seconds>(mins);
+  auto hour = duration_cast<hours>(mins);
+  mins -= duration_cast<minutes>(hour);
+
+  Serial.print("* [");
+  Serial.print(level_str_[loglevel]);
+  Serial.print("] [");
+  Serial.printf("%d:%02d:%02d.%03d", (int16_t)hour.count(), (int16_t)mins.count(), (int16_t)secs.count(), (int16_t)ms.count());
+  Serial.print("] [");
+  Serial.print(module_);
+  Serial.print("] - ");
+}
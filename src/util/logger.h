@@ -1,50 +1,103 @@
-/* 
- * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
- * Copyright (c) 2019 Lars Brandt.
- * 
- * This program is free software: you can redistribute it and/or modify  
- * it under the terms of the GNU General Public License as published by  
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but 
- * WITHOUT ANY WARRANTY; without even the implied warranty of 
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
- * General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License 
- * along with this program. If not, see <http://www.gnu.org/licenses/>.
- */
-
-
-#pragma once
-
-#include <Arduino.h>
-#include <Print.h>
-#include <chrono>
-
-#ifndef LOGGER_BUFFER_SIZE
-#define LOGGER_BUFFER_SIZE 1024
-#endif
-
-class Logger : public Print {
- public:
-  enum Loglevel_t { FATAL, ERROR, WARN, INFO, DEBUG, VERBOSE };
-
-  Logger(const String& module);
-
-  const void f(const char* msg, ...);
-  const void e(const char* msg, ...);
-  const void w(const char* msg, ...);
-  const void i(const char* msg, ...);
-  const void d(const char* msg, ...);
-  const void v(const char* msg, ...);
-
-  virtual size_t write(uint8_t c);
-
- private:
-  const void printPrefix(Loglevel_t loglevel);
-
-  const String module_;
-  static const char* level_str_[6];
-  char buffer[LOGGER_BUFFER_SIZE];
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <Arduino.h>
+#include <Print.h>
+#include <chrono>
+#include <mutex>
+
+#ifndef LOGGER_BUFFER_SIZE
+#define LOGGER_BUFFER_SIZE 1024
+#endif
+
+// Identical consecutive messages are collapsed into a "repeated N times" line.
+// The summary is flushed at the latest after this many ms of repetition, by the next line or by loop().
+#ifndef LOGGER_REPEAT_FLUSH_MS
+#define LOGGER_REPEAT_FLUSH_MS 10000
+#endif
+
+// Token bucket for a single log call site. Declare it static next to the call:
+//   static LogLimit limit(5, 1000);  // burst of 5, then one message per second
+//   LOG.i(limit, "WiFi event: %u", event);
+class LogLimit {
+ public:
+  LogLimit(uint16_t burst = 5, uint32_t refillMs = 1000);
+
+  bool take();
+  uint32_t takeDropped();
+
+ private:
+  const uint16_t burst_;
+  const uint32_t refillMs_;
+  uint16_t tokens_;
+  uint32_t lastRefill_;
+  uint32_t dropped_;
+};
+
+class Logger : public Print {
+ public:
+  enum Loglevel_t { FATAL, ERROR, WARN, INFO, DEBUG, VERBOSE };
+
+  Logger(const String& module);
+  ~Logger();
+
+  // prints the pending repeat summaries that are due, call from the main loop
+  static void loop();
+
+  const void f(const char* msg, ...);
+  const void e(const char* msg, ...);
+  const void w(const char* msg, ...);
+  const void i(const char* msg, ...);
+  const void d(const char* msg, ...);
+  const void v(const char* msg, ...);
+
+  // rate limited variants, see LogLimit
+  const void f(LogLimit& limit, const char* msg, ...);
+  const void e(LogLimit& limit, const char* msg, ...);
+  const void w(LogLimit& limit, const char* msg, ...);
+  const void i(LogLimit& limit, const char* msg, ...);
+  const void d(LogLimit& limit, const char* msg, ...);
+  const void v(LogLimit& limit, const char* msg, ...);
+
+  virtual size_t write(uint8_t c);
+
+ private:
+  const void log(Loglevel_t loglevel, LogLimit* limit, const char* msg, va_list args);
+  const void printLine(Loglevel_t loglevel, const char* text);
+  const void flushRepeated();
+  const void printPrefix(Loglevel_t loglevel);
+
+  const String module_;
+  static const char* level_str_[6];
+  static const char* level_color_[6];
+  char buffer[LOGGER_BUFFER_SIZE];
+
+  std::mutex mutex_;
+  uint32_t lastHash_;
+  size_t lastLength_;  // of the last line, at the start of buffer
+  Loglevel_t lastLevel_;
+  uint32_t repeated_;
+  uint32_t repeatStart_;
+
+  // all instances, for loop()
+  static Logger* first_;
+  static std::mutex listMutex_;
+  Logger* next_;
 };
\ No newline at end of file
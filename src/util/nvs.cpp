@@ -1,153 +1,622 @@
-/* 
- * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
- * Copyright (c) 2019 Lars Brandt.
- * 
- * This program is free software: you can redistribute it and/or modify  
- * it under the terms of the GNU General Public License as published by  
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but 
- * WITHOUT ANY WARRANTY; without even the implied warranty of 
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
- * General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License 
- * along with this program. If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "util/nvs.h"
-
-//------------------------------------------------------------------------------
-NVS::NVS(const String& name)
-    : LOG("NVS[" + name + "]"),
-      name_(name),
-      handle_(0)
-//------------------------------------------------------------------------------
-{}
-
-//------------------------------------------------------------------------------
-bool NVS::begin()
-//------------------------------------------------------------------------------
-{
-  if (handle_) {
-    LOG.e("Already opened");
-    return 0;
-  }
-
-  esp_err_t err;
-
-  // initialize;
-  err = nvs_flash_init();
-  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    // NVS partition was truncated and needs to be erased
-    // Retry nvs_flash_init
-    LOG.i("Storage needs to be erased");
-    err = nvs_flash_erase();
-    if (err == ESP_OK) {
-      LOG.i("Storage erased");
-    } else {
-      LOG.e("Storage not erased. Reason: %s", esp_err_to_name(err));
-    }
-    err = nvs_flash_init();
-  }
-
-  if (err == ESP_OK) {
-    LOG.i("Storage initialized");
-
-    // open
-    err = nvs_open(name_.c_str(), NVS_READWRITE, &handle_);
-    if (err == ESP_OK) {
-      LOG.i("Storage opened");
-      return true;
-    } else {
-      LOG.e("Storage not opened. Reason: %s", esp_err_to_name(err));
-    }
-  } else {
-    LOG.e("Storage not initializued. Reason: %s", esp_err_to_name(err));
-  }
-  return false;
-}
-
-//------------------------------------------------------------------------------
-void NVS::end()
-//------------------------------------------------------------------------------
-{
-  if (handle_) {
-    nvs_close(handle_);
-  }
-  handle_ = 0;
-}
-
-//------------------------------------------------------------------------------
-esp_err_t NVS::existsString(const String& key)
-//------------------------------------------------------------------------------
-{
-  if (!handle_) {
-    return -1;
-  }
-
-  size_t l;
-  return nvs_get_str(handle_, key.c_str(), NULL, &l);
-}
-
-//------------------------------------------------------------------------------
-bool NVS::readString(const String& key, String& value)
-//------------------------------------------------------------------------------
-{
-  if (!handle_) {
-    return false;
-  }
-
-  esp_err_t err;
-  size_t l;
-
-  // read size
-  err = nvs_get_str(handle_, key.c_str(), NULL, &l);
-  if (err == ESP_OK) {
-    // read value
-    l++;  // last zero byte
-    char buffer[l];
-    err = nvs_get_str(handle_, key.c_str(), buffer, &l);
-    value = (char*)&buffer;
-    if (err == ESP_OK) {
-      return true;
-    } else {
-      LOG.e("Value not read. Reason: %s", esp_err_to_name(err));
-    }
-  } else {
-    LOG.e("Value size not read. Reason: %s", esp_err_to_name(err));
-  }
-  return false;
-}
-
-//------------------------------------------------------------------------------
-bool NVS::writeString(const String& key, const String& value, bool commitAfterWrite)
-//------------------------------------------------------------------------------
-{
-  esp_err_t err;
-  err = nvs_set_str(handle_, key.c_str(), value.c_str());
-  if (err == ESP_OK) {
-    if (commitAfterWrite) {
-      return commit();
-    } else {
-      return true;
-    }
-  } else {
-    LOG.e("Value not written. Reason: %s", esp_err_to_name(err));
-  }
-  return false;
-}
-
-//------------------------------------------------------------------------------
-bool NVS::commit()
-//------------------------------------------------------------------------------
-{
-  esp_err_t err;
-  err = nvs_commit(handle_);
-  if (err == ESP_OK) {
-    return true;
-  } else {
-    LOG.e("Not commited. Reason: %s", esp_err_to_name(err));
-  }
-  return false;
-}
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/nvs.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+//------------------------------------------------------------------------------
+NVS::NVS(const String& name, uint32_t commitDebounceMs)
+    : LOG("NVS[" + name + "]"),
+      name_(name),
+      handle_(0),
+      commitDebounceMs_(commitDebounceMs),
+      commitPending_(false),
+      commitDue_(0),
+      async_(false),
+      stop_(false)
+//------------------------------------------------------------------------------
+{}
+
+//------------------------------------------------------------------------------
+bool NVS::begin()
+//------------------------------------------------------------------------------
+{
+  if (handle_) {
+    LOG.e("Already opened");
+    return 0;
+  }
+
+  esp_err_t err;
+
+  // initialize;
+  err = nvs_flash_init();
+  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    // NVS partition was truncated and needs to be erased
+    // Retry nvs_flash_init
+    LOG.i("Storage needs to be erased");
+    err = nvs_flash_erase();
+    if (err == ESP_OK) {
+      LOG.i("Storage erased");
+    } else {
+      LOG.e("Storage not erased. Reason: %s", esp_err_to_name(err));
+    }
+    err = nvs_flash_init();
+  }
+
+  if (err == ESP_OK) {
+    LOG.i("Storage initialized");
+
+    // open
+    err = nvs_open(name_.c_str(), NVS_READWRITE, &handle_);
+    if (err == ESP_OK) {
+      LOG.i("Storage opened");
+      return true;
+    } else {
+      LOG.e("Storage not opened. Reason: %s", esp_err_to_name(err));
+    }
+  } else {
+    LOG.e("Storage not initializued. Reason: %s", esp_err_to_name(err));
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+void NVS::end()
+//------------------------------------------------------------------------------
+{
+  if (task_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wakeup_.notify_one();
+    task_.join();
+    async_ = false;
+    stop_ = false;
+  }
+
+  if (handle_) {
+    flush();
+    nvs_close(handle_);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  handle_ = 0;
+  cache_.clear();
+}
+
+//------------------------------------------------------------------------------
+bool NVS::beginAsync()
+//------------------------------------------------------------------------------
+{
+  if (!handle_) {
+    LOG.e("Not opened");
+    return false;
+  }
+  if (async_) {
+    return true;
+  }
+
+#ifdef ESP_PLATFORM
+  // a flash write needs little stack, and must never compete with the display or the web server
+  esp_pthread_cfg_t cfg = {};
+  cfg.stack_size = NVS_TASK_STACK_SIZE;
+  cfg.prio = NVS_TASK_PRIORITY;
+  esp_pthread_set_cfg(&cfg);
+#endif
+
+  task_ = std::thread(&NVS::run, this);
+  async_ = true;
+  LOG.i("Commit task started");
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void NVS::run()
+//------------------------------------------------------------------------------
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    if (!commitPending_) {
+      wakeup_.wait(lock);
+      continue;
+    }
+
+    int32_t remaining = (int32_t)(commitDue_ - millis());
+    if (remaining > 0) {
+      wakeup_.wait_for(lock, std::chrono::milliseconds(remaining));
+      continue;
+    }
+
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+//------------------------------------------------------------------------------
+void NVS::loop()
+//------------------------------------------------------------------------------
+{
+  if (async_) {
+    // the task commits
+    return;
+  }
+
+  bool due;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    due = commitPending_ && (int32_t)(millis() - commitDue_) >= 0;
+  }
+  if (due) {
+    flush();
+  }
+}
+
+//------------------------------------------------------------------------------
+esp_err_t NVS::existsString(const String& key)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!handle_) {
+    return -1;
+  }
+
+  Entry* entry;
+  esp_err_t err = load(key.c_str(), TYPE_STR, &entry);
+  if (err == ESP_OK && !entry->present) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  }
+  return err;
+}
+
+//------------------------------------------------------------------------------
+bool NVS::readString(const String& key, String& value)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!handle_) {
+    return false;
+  }
+
+  Entry* entry;
+  esp_err_t err = load(key.c_str(), TYPE_STR, &entry);
+  if (err == ESP_OK) {
+    if (entry->present) {
+      value = (const char*)entry->value.data();
+      return true;
+    } else {
+      LOG.e("Value not read. Reason: %s", esp_err_to_name(ESP_ERR_NVS_NOT_FOUND));
+    }
+  } else {
+    LOG.e("Value not read. Reason: %s", esp_err_to_name(err));
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+bool NVS::writeString(const String& key, const String& value, bool commitAfterWrite)
+//------------------------------------------------------------------------------
+{
+  // incl. zero byte
+  return update(key.c_str(), TYPE_STR, value.c_str(), value.length() + 1, commitAfterWrite);
+}
+
+//------------------------------------------------------------------------------
+bool NVS::readString(const char* key, char* value, size_t capacity, size_t* length)
+//------------------------------------------------------------------------------
+{
+  size_t l;
+  if (read(key, TYPE_STR, value, capacity, &l)) {
+    if (length) {
+      *length = l - 1;  // without zero byte
+    }
+    return true;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t NVS::existsBlob(const char* key, size_t* length)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!handle_) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+
+  Entry* entry;
+  esp_err_t err = load(key, TYPE_BLOB, &entry);
+  if (err == ESP_OK && !entry->present) {
+    err = ESP_ERR_NVS_NOT_FOUND;
+  }
+  if (err == ESP_OK && length) {
+    *length = entry->value.size();
+  }
+  return err;
+}
+
+//------------------------------------------------------------------------------
+bool NVS::readBlob(const char* key, void* value, size_t capacity, size_t* length)
+//------------------------------------------------------------------------------
+{
+  return read(key, TYPE_BLOB, value, capacity, length);
+}
+
+//------------------------------------------------------------------------------
+bool NVS::writeBlob(const char* key, const void* value, size_t length, bool commitAfterWrite)
+//------------------------------------------------------------------------------
+{
+  return update(key, TYPE_BLOB, value, length, commitAfterWrite);
+}
+
+//------------------------------------------------------------------------------
+bool NVS::erase(const String& key, bool commitAfterWrite)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!handle_) {
+    return false;
+  }
+
+  Entry* entry = find(key.c_str());
+  if (!entry) {
+    // we don't know the type of the stored value, but flush() erases by key only
+    esp_err_t err = load(key.c_str(), TYPE_STR, &entry);
+    if (err != ESP_OK) {
+      LOG.e("Value not erased. Reason: %s", esp_err_to_name(err));
+      return false;
+    }
+    entry->present = true;
+  }
+
+  if (entry->present) {
+    entry->present = false;
+    entry->dirty = true;
+    entry->value.clear();
+    if (commitAfterWrite) {
+      scheduleCommit();
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool NVS::commit()
+//------------------------------------------------------------------------------
+{
+  return flush();
+}
+
+//------------------------------------------------------------------------------
+void NVS::commitAsync(CommitCallback callback)
+//------------------------------------------------------------------------------
+{
+  // called from the task after the next flush, or from loop() without a task
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (callback) {
+    callbacks_.push_back(callback);
+  }
+  scheduleCommit();
+}
+
+//------------------------------------------------------------------------------
+bool NVS::isDirty()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Entry& entry : cache_) {
+    if (entry.dirty) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+NVS::Entry* NVS::find(const char* key)
+//------------------------------------------------------------------------------
+{
+  for (Entry& entry : cache_) {
+    if (strcmp(entry.key, key) == 0) {
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t NVS::load(const char* key, Type_t type, Entry** result)
+//------------------------------------------------------------------------------
+{
+  *result = find(key);
+  if (*result) {
+    if ((*result)->type == type) {
+      return ESP_OK;
+    }
+    if ((*result)->present) {
+      return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if ((*result)->dirty) {
+      // erase pending, so it is missing for every type
+      (*result)->type = type;
+      return ESP_OK;
+    }
+    // only known to be missing as another type, ask the flash again
+    cache_.erase(cache_.begin() + (*result - cache_.data()));
+  }
+
+  if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+    return ESP_ERR_NVS_INVALID_NAME;
+  }
+
+  Entry entry;
+  strcpy(entry.key, key);
+  entry.type = type;
+  entry.present = false;
+  entry.dirty = false;
+
+  // read size
+  size_t l;
+  esp_err_t err = get(key, type, NULL, &l);
+  if (err == ESP_OK) {
+    // read value, for strings l includes the zero byte
+    entry.value.resize(l);
+    err = get(key, type, entry.value.data(), &l);
+    if (err != ESP_OK) {
+      return err;
+    }
+    entry.present = true;
+  } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+    return err;
+  }
+
+  // missing keys are cached as well, so repeated lookups stay off the flash
+  cache_.push_back(entry);
+  *result = &cache_.back();
+  return ESP_OK;
+}
+
+//------------------------------------------------------------------------------
+bool NVS::read(const char* key, Type_t type, void* value, size_t capacity, size_t* length)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!handle_) {
+    return false;
+  }
+
+  esp_err_t err;
+  size_t l = capacity;
+  Entry* entry = find(key);
+  if (entry && entry->type != type && !entry->present && !entry->dirty) {
+    // only known to be missing as another type, keys are typed, so ask the flash (as load() does)
+    entry = NULL;
+  }
+  if (entry && (entry->type == type || !entry->present)) {
+    // cached, maybe as missing. A pending erase is missing for every type.
+    if (!entry->present) {
+      err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (entry->value.size() > capacity) {
+      err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+      l = entry->value.size();
+      memcpy(value, entry->value.data(), l);
+      err = ESP_OK;
+    }
+  } else if (entry) {
+    err = ESP_ERR_NVS_TYPE_MISMATCH;
+  } else {
+    // not cached, straight from flash into the callers buffer
+    err = get(key, type, value, &l);
+  }
+
+  if (err == ESP_OK) {
+    if (length) {
+      *length = l;
+    }
+    return true;
+  } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+    LOG.e("Value '%s' not read. Reason: %s", key, esp_err_to_name(err));
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t NVS::get(const char* key, Type_t type, void* value, size_t* length)
+//------------------------------------------------------------------------------
+{
+  // value == NULL only asks for the size
+  uint64_t scratch;
+  void* target = value ? value : &scratch;
+
+  switch (type) {
+    case TYPE_STR:
+      return nvs_get_str(handle_, key, (char*)value, length);
+    case TYPE_BLOB:
+      return nvs_get_blob(handle_, key, value, length);
+    case TYPE_U8:
+      *length = sizeof(uint8_t);
+      return nvs_get_u8(handle_, key, (uint8_t*)target);
+    case TYPE_I8:
+      *length = sizeof(int8_t);
+      return nvs_get_i8(handle_, key, (int8_t*)target);
+    case TYPE_U16:
+      *length = sizeof(uint16_t);
+      return nvs_get_u16(handle_, key, (uint16_t*)target);
+    case TYPE_I16:
+      *length = sizeof(int16_t);
+      return nvs_get_i16(handle_, key, (int16_t*)target);
+    case TYPE_U32:
+      *length = sizeof(uint32_t);
+      return nvs_get_u32(handle_, key, (uint32_t*)target);
+    case TYPE_I32:
+      *length = sizeof(int32_t);
+      return nvs_get_i32(handle_, key, (int32_t*)target);
+    case TYPE_U64:
+      *length = sizeof(uint64_t);
+      return nvs_get_u64(handle_, key, (uint64_t*)target);
+    case TYPE_I64:
+      *length = sizeof(int64_t);
+      return nvs_get_i64(handle_, key, (int64_t*)target);
+  }
+  return ESP_ERR_NVS_TYPE_MISMATCH;
+}
+
+//------------------------------------------------------------------------------
+esp_err_t NVS::set(const Entry& entry)
+//------------------------------------------------------------------------------
+{
+  const void* value = entry.value.data();
+
+  switch (entry.type) {
+    case TYPE_STR:
+      return nvs_set_str(handle_, entry.key, (const char*)value);
+    case TYPE_BLOB:
+      return nvs_set_blob(handle_, entry.key, value, entry.value.size());
+    case TYPE_U8:
+      return nvs_set_u8(handle_, entry.key, *(const uint8_t*)value);
+    case TYPE_I8:
+      return nvs_set_i8(handle_, entry.key, *(const int8_t*)value);
+    case TYPE_U16:
+      return nvs_set_u16(handle_, entry.key, *(const uint16_t*)value);
+    case TYPE_I16:
+      return nvs_set_i16(handle_, entry.key, *(const int16_t*)value);
+    case TYPE_U32:
+      return nvs_set_u32(handle_, entry.key, *(const uint32_t*)value);
+    case TYPE_I32:
+      return nvs_set_i32(handle_, entry.key, *(const int32_t*)value);
+    case TYPE_U64:
+      return nvs_set_u64(handle_, entry.key, *(const uint64_t*)value);
+    case TYPE_I64:
+      return nvs_set_i64(handle_, entry.key, *(const int64_t*)value);
+  }
+  return ESP_ERR_NVS_TYPE_MISMATCH;
+}
+
+//------------------------------------------------------------------------------
+bool NVS::update(const char* key, Type_t type, const void* value, size_t length, bool commitAfterWrite)
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!handle_) {
+    return false;
+  }
+
+  Entry* entry;
+  esp_err_t err = load(key, type, &entry);
+  if (err != ESP_OK) {
+    LOG.e("Value not written. Reason: %s", esp_err_to_name(err));
+    return false;
+  }
+
+  // unchanged values never touch the flash
+  const uint8_t* data = (const uint8_t*)value;
+  if (!entry->present || entry->value.size() != length || memcmp(entry->value.data(), data, length) != 0) {
+    entry->value.assign(data, data + length);
+    entry->present = true;
+    entry->dirty = true;
+  }
+
+  if (commitAfterWrite && entry->dirty) {
+    scheduleCommit();
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void NVS::scheduleCommit()
+//------------------------------------------------------------------------------
+{
+  if (!commitPending_) {
+    commitPending_ = true;
+    commitDue_ = millis() + commitDebounceMs_;
+    wakeup_.notify_one();
+  }
+}
+
+//------------------------------------------------------------------------------
+bool NVS::flush()
+//------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> flushLock(flushMutex_);
+
+  // take a snapshot, so writers are only blocked while copying and not while the flash is busy
+  std::vector<Entry> batch;
+  std::vector<CommitCallback> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    commitPending_ = false;
+    callbacks.swap(callbacks_);
+    for (Entry& entry : cache_) {
+      if (entry.dirty) {
+        batch.push_back(entry);
+        entry.dirty = false;
+      }
+    }
+  }
+
+  esp_err_t err;
+  bool ok = handle_ != 0;
+  bool written = false;
+  for (size_t i = 0; ok && i < batch.size(); ++i) {
+    const Entry& entry = batch[i];
+    if (!entry.present) {
+      err = nvs_erase_key(handle_, entry.key);
+      if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+      }
+    } else {
+      err = set(entry);
+    }
+
+    if (err == ESP_OK) {
+      written = true;
+    } else {
+      LOG.e("Value '%s' not written. Reason: %s", entry.key, esp_err_to_name(err));
+      ok = false;
+    }
+  }
+
+  if (ok && written) {
+    err = nvs_commit(handle_);
+    if (err != ESP_OK) {
+      LOG.e("Not commited. Reason: %s", esp_err_to_name(err));
+      ok = false;
+    }
+  }
+
+  if (!ok && handle_) {
+    // nothing of the batch is known to be durable, retry it with the next window
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Entry& attempted : batch) {
+      Entry* entry = find(attempted.key);
+      if (entry && !entry->dirty) {
+        // not changed again in the meantime
+        entry->dirty = true;
+      }
+    }
+    scheduleCommit();
+  }
+
+  for (CommitCallback callback : callbacks) {
+    callback(ok);
+  }
+  return ok;
+}
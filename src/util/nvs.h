@@ -1,43 +1,144 @@
-/* 
- * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
- * Copyright (c) 2019 Lars Brandt.
- * 
- * This program is free software: you can redistribute it and/or modify  
- * it under the terms of the GNU General Public License as published by  
- * the Free Software Foundation, version 3.
- *
- * This program is distributed in the hope that it will be useful, but 
- * WITHOUT ANY WARRANTY; without even the implied warranty of 
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
- * General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License 
- * along with this program. If not, see <http://www.gnu.org/licenses/>.
- */
-
-#pragma once
-
-#include <Arduino.h>
-#include <nvs.h>
-#include <nvs_flash.h>
-
-#include "util/logger.h"
-
-class NVS {
- public:
-  NVS(const String& name);
-  
-  bool begin();
-  void end();
-
-  esp_err_t existsString(const String& key);
-  bool readString(const String& key, String& value);
-  bool writeString(const String& key, const String& value, bool commitAfterWrite = false);
-  
-  bool commit();
-
- private:
-  Logger LOG;
-  String name_;
-  nvs_handle handle_;
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/fixedstring.h"
+#include "util/logger.h"
+
+#ifndef NVS_KEY_NAME_MAX_SIZE
+#define NVS_KEY_NAME_MAX_SIZE 16
+#endif
+
+// Dirty values are committed at the latest this many ms after a write that asked for a commit.
+#ifndef NVS_COMMIT_DEBOUNCE_MS
+#define NVS_COMMIT_DEBOUNCE_MS 2000
+#endif
+
+#ifndef NVS_TASK_STACK_SIZE
+#define NVS_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef NVS_TASK_PRIORITY
+#define NVS_TASK_PRIORITY 1
+#endif
+
+// Write-back cache in front of a NVS namespace.
+// Reads are served from RAM after the first access, writes only mark the cached value dirty.
+// Dirty values are written and committed together by loop() after the debounce window,
+// by commit() or by end(). After beginAsync() a background task takes over the debounced
+// commits, so callers never wait for the flash; commitAsync() reports when values are durable.
+// The const char* accessors copy into caller memory and never allocate: they are served
+// from the cache or, for keys not cached yet, read directly from flash into the buffer.
+class NVS {
+ public:
+  typedef void (*CommitCallback)(bool success);
+
+  NVS(const String& name, uint32_t commitDebounceMs = NVS_COMMIT_DEBOUNCE_MS);
+  
+  bool begin();
+  bool beginAsync();
+  void end();
+  void loop();
+
+  esp_err_t existsString(const String& key);
+  bool readString(const String& key, String& value);
+  bool writeString(const String& key, const String& value, bool commitAfterWrite = false);
+
+  bool readString(const char* key, char* value, size_t capacity, size_t* length = NULL);
+  template <size_t N>
+  bool readString(const char* key, FixedString<N>& value) {
+    return readString(key, value.data(), N);
+  }
+
+  // ESP_OK with the size of the blob, ESP_ERR_NVS_NOT_FOUND or why it could not be read
+  esp_err_t existsBlob(const char* key, size_t* length = NULL);
+  bool readBlob(const char* key, void* value, size_t capacity, size_t* length);
+  bool writeBlob(const char* key, const void* value, size_t length, bool commitAfterWrite = false);
+
+  // T is one of (u)int8_t, (u)int16_t, (u)int32_t, (u)int64_t
+  template <typename T>
+  bool readInt(const char* key, T& value) {
+    return read(key, typeOf(value), &value, sizeof(T), NULL);
+  }
+  template <typename T>
+  bool writeInt(const char* key, T value, bool commitAfterWrite = false) {
+    return update(key, typeOf(value), &value, sizeof(T), commitAfterWrite);
+  }
+
+  bool erase(const String& key, bool commitAfterWrite = false);
+  
+  bool commit();
+  void commitAsync(CommitCallback callback = NULL);
+  bool isDirty();
+
+ private:
+  enum Type_t { TYPE_STR, TYPE_BLOB, TYPE_U8, TYPE_I8, TYPE_U16, TYPE_I16, TYPE_U32, TYPE_I32, TYPE_U64, TYPE_I64 };
+
+  static Type_t typeOf(uint8_t) { return TYPE_U8; }
+  static Type_t typeOf(int8_t) { return TYPE_I8; }
+  static Type_t typeOf(uint16_t) { return TYPE_U16; }
+  static Type_t typeOf(int16_t) { return TYPE_I16; }
+  static Type_t typeOf(uint32_t) { return TYPE_U32; }
+  static Type_t typeOf(int32_t) { return TYPE_I32; }
+  static Type_t typeOf(uint64_t) { return TYPE_U64; }
+  static Type_t typeOf(int64_t) { return TYPE_I64; }
+
+  struct Entry {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    Type_t type;
+    bool present;
+    bool dirty;
+    std::vector<uint8_t> value;
+  };
+
+  Entry* find(const char* key);
+  esp_err_t load(const char* key, Type_t type, Entry** result);
+  bool read(const char* key, Type_t type, void* value, size_t capacity, size_t* length);
+  esp_err_t get(const char* key, Type_t type, void* value, size_t* length);
+  esp_err_t set(const Entry& entry);
+  bool update(const char* key, Type_t type, const void* value, size_t length, bool commitAfterWrite);
+  void scheduleCommit();
+  bool flush();
+  void run();
+
+  Logger LOG;
+  String name_;
+  nvs_handle handle_;
+  std::vector<Entry> cache_;
+  uint32_t commitDebounceMs_;
+  bool commitPending_;
+  uint32_t commitDue_;
+  std::vector<CommitCallback> callbacks_;
+
+  // mutex_ guards the cache and the commit state, flushMutex_ serializes the flash writes
+  std::mutex mutex_;
+  std::mutex flushMutex_;
+  std::condition_variable wakeup_;
+  std::thread task_;
+  bool async_;
+  bool stop_;
 };
\ No newline at end of file
@@ -0,0 +1,272 @@
+/* 
+ * This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+ * Copyright (c) 2019 Lars Brandt.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Config persistence against the NVS emulator: 'pio test -e native'.
+// Every test starts on an empty partition image.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <stddef.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "host/nvsemulator.h"
+#include "util/crc32.h"
+#include "util/nvs.h"
+
+#define TEST_IMAGE "test-config.bin"
+#define TEST_NAMESPACE "storage"
+
+//------------------------------------------------------------------------------
+void setUp()
+//------------------------------------------------------------------------------
+{
+  unlink(TEST_IMAGE);
+  unlink(TEST_IMAGE ".wear");
+  TEST_ASSERT_TRUE(NvsEmulator::open(TEST_IMAGE, 0x5000));
+}
+
+//------------------------------------------------------------------------------
+void tearDown()
+//------------------------------------------------------------------------------
+{
+  NvsEmulator::close();
+  unlink(TEST_IMAGE);
+  unlink(TEST_IMAGE ".wear");
+}
+
+//------------------------------------------------------------------------------
+static void writeRecord(uint16_t version, const void* data, uint16_t length)
+//------------------------------------------------------------------------------
+{
+  // a record as another firmware version would have written it
+  std::vector<uint8_t> record(sizeof(ConfigHeader_t) + length);
+  ConfigHeader_t header;
+  header.version = version;
+  header.length = length;
+  header.crc = Crc32::compute(data, length);
+  memcpy(record.data(), &header, sizeof(header));
+  memcpy(record.data() + sizeof(header), data, length);
+
+  NVS nvs(TEST_NAMESPACE);
+  TEST_ASSERT_TRUE(nvs.begin());
+  TEST_ASSERT_TRUE(nvs.writeBlob("config", record.data(), record.size()));
+  TEST_ASSERT_TRUE(nvs.commit());
+  nvs.end();
+}
+
+//------------------------------------------------------------------------------
+static ConfigHeader_t readHeader(size_t* length = NULL)
+//------------------------------------------------------------------------------
+{
+  uint8_t record[512];
+  size_t l = 0;
+  NVS nvs(TEST_NAMESPACE);
+  TEST_ASSERT_TRUE(nvs.begin());
+  TEST_ASSERT_TRUE(nvs.readBlob("config", record, sizeof(record), &l));
+  nvs.end();
+  ConfigHeader_t header;
+  memcpy(&header, record, sizeof(header));
+  if (length) {
+    *length = l;
+  }
+  return header;
+}
+
+//------------------------------------------------------------------------------
+static ConfigData_t testData()
+//------------------------------------------------------------------------------
+{
+  ConfigData_t data;
+  memset(&data, 0, sizeof(data));
+  strcpy(data.deviceName, "kitchen");
+  strcpy(data.timezone, "America/New_York");
+  strcpy(data.tzRule, "EST5EDT,M3.2.0,M11.1.0");
+  data.ntpServer = 1;
+  data.tickSync = 2;
+  return data;
+}
+
+//------------------------------------------------------------------------------
+void test_save_load()
+//------------------------------------------------------------------------------
+{
+  {
+    NVS nvs(TEST_NAMESPACE);
+    TEST_ASSERT_TRUE(nvs.begin());
+    Config config(nvs);
+    config.load();
+    config.setDeviceName("kitchen");
+    config.setTimezone("America/New_York");
+    config.setTzRule("EST5EDT,M3.2.0,M11.1.0");
+    config.setNtpServer(true);
+    config.setTickSync(2);
+    TEST_ASSERT_TRUE(config.save(false));
+    TEST_ASSERT_TRUE(nvs.commit());
+    nvs.end();
+  }
+
+  NVS nvs(TEST_NAMESPACE);
+  TEST_ASSERT_TRUE(nvs.begin());
+  Config config(nvs);
+  TEST_ASSERT_TRUE(config.load());
+  TEST_ASSERT_EQUAL_STRING("kitchen", config.getDeviceName().c_str());
+  TEST_ASSERT_EQUAL_STRING("America/New_York", config.getTimezone().c_str());
+  TEST_ASSERT_EQUAL_STRING("EST5EDT,M3.2.0,M11.1.0", config.getTzRule().c_str());
+  TEST_ASSERT_TRUE(config.isNtpServer());
+  TEST_ASSERT_EQUAL_UINT8(2, config.getTickSync());
+  nvs.end();
+}
+
+//------------------------------------------------------------------------------
+void test_legacy_migration()
+//------------------------------------------------------------------------------
+{
+  {
+    NVS nvs(TEST_NAMESPACE);
+    TEST_ASSERT_TRUE(nvs.begin());
+    TEST_ASSERT_TRUE(nvs.writeString("devicename", "hall"));
+    TEST_ASSERT_TRUE(nvs.writeString("timezone", "Asia/Tokyo"));
+    TEST_ASSERT_TRUE(nvs.commit());
+    nvs.end();
+  }
+
+  {
+    NVS nvs(TEST_NAMESPACE);
+    TEST_ASSERT_TRUE(nvs.begin());
+    Config config(nvs);
+    TEST_ASSERT_TRUE(config.load());
+    TEST_ASSERT_EQUAL_STRING("hall", config.getDeviceName().c_str());
+    TEST_ASSERT_EQUAL_STRING("Asia/Tokyo", config.getTimezone().c_str());
+    TEST_ASSERT_TRUE(nvs.commit());
+    nvs.end();
+  }
+
+  // the legacy keys are gone, the record took their place
+  NVS nvs(TEST_NAMESPACE);
+  TEST_ASSERT_TRUE(nvs.begin());
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs.existsString("devicename"));
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs.existsString("timezone"));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs.existsBlob("config"));
+  nvs.end();
+  TEST_ASSERT_EQUAL_UINT16(CONFIG_VERSION, readHeader().version);
+}
+
+//------------------------------------------------------------------------------
+void test_crc_corruption()
+//------------------------------------------------------------------------------
+{
+  ConfigData_t data = testData();
+  writeRecord(CONFIG_VERSION, &data, sizeof(data));
+  {
+    // one flipped bit in the data
+    uint8_t record[sizeof(ConfigHeader_t) + sizeof(ConfigData_t)];
+    size_t length;
+    NVS nvs(TEST_NAMESPACE);
+    TEST_ASSERT_TRUE(nvs.begin());
+    TEST_ASSERT_TRUE(nvs.readBlob("config", record, sizeof(record), &length));
+    record[sizeof(ConfigHeader_t) + 1] ^= 0x01;
+    TEST_ASSERT_TRUE(nvs.writeBlob("config", record, length));
+    TEST_ASSERT_TRUE(nvs.commit());
+    nvs.end();
+  }
+
+  NVS nvs(TEST_NAMESPACE);
+  TEST_ASSERT_TRUE(nvs.begin());
+  Config config(nvs);
+  TEST_ASSERT_FALSE(config.load());
+  TEST_ASSERT_EQUAL_STRING("Europe/Berlin", config.getTimezone().c_str());
+  TEST_ASSERT_FALSE(config.isNtpServer());
+  TEST_ASSERT_EQUAL_UINT8(0, config.getTickSync());
+  nvs.end();
+}
+
+//------------------------------------------------------------------------------
+void test_version_upgrade()
+//------------------------------------------------------------------------------
+{
+  // version 1 had the name and the timezone only
+  ConfigData_t data = testData();
+  writeRecord(1, &data, offsetof(ConfigData_t, tzRule));
+
+  {
+    NVS nvs(TEST_NAMESPACE);
+    TEST_ASSERT_TRUE(nvs.begin());
+    Config config(nvs);
+    TEST_ASSERT_TRUE(config.load());
+    TEST_ASSERT_EQUAL_STRING("kitchen", config.getDeviceName().c_str());
+    TEST_ASSERT_EQUAL_STRING("America/New_York", config.getTimezone().c_str());
+    // the new fields keep their defaults
+    TEST_ASSERT_EQUAL_STRING("", config.getTzRule().c_str());
+    TEST_ASSERT_FALSE(config.isNtpServer());
+    TEST_ASSERT_EQUAL_UINT8(0, config.getTickSync());
+    TEST_ASSERT_TRUE(nvs.commit());
+    nvs.end();
+  }
+
+  // rewritten as the current version
+  size_t length;
+  ConfigHeader_t header = readHeader(&length);
+  TEST_ASSERT_EQUAL_UINT16(CONFIG_VERSION, header.version);
+  TEST_ASSERT_EQUAL_UINT16(sizeof(ConfigData_t), header.length);
+  TEST_ASSERT_EQUAL(sizeof(ConfigHeader_t) + sizeof(ConfigData_t), length);
+}
+
+//------------------------------------------------------------------------------
+void test_newer_version()
+//------------------------------------------------------------------------------
+{
+  // after a downgrade: a longer record of a newer firmware
+  uint8_t data[sizeof(ConfigData_t) + 16];
+  memset(data, 0x5a, sizeof(data));
+  ConfigData_t known = testData();
+  memcpy(data, &known, sizeof(known));
+  writeRecord(CONFIG_VERSION + 1, data, sizeof(data));
+
+  {
+    NVS nvs(TEST_NAMESPACE);
+    TEST_ASSERT_TRUE(nvs.begin());
+    Config config(nvs);
+    TEST_ASSERT_TRUE(config.load());
+    TEST_ASSERT_EQUAL_STRING("kitchen", config.getDeviceName().c_str());
+    TEST_ASSERT_EQUAL_STRING("America/New_York", config.getTimezone().c_str());
+    TEST_ASSERT_TRUE(config.isNtpServer());
+    TEST_ASSERT_EQUAL_UINT8(2, config.getTickSync());
+    TEST_ASSERT_TRUE(nvs.commit());
+    nvs.end();
+  }
+
+  // left as it is, the newer firmware finds its fields again
+  size_t length;
+  ConfigHeader_t header = readHeader(&length);
+  TEST_ASSERT_EQUAL_UINT16(CONFIG_VERSION + 1, header.version);
+  TEST_ASSERT_EQUAL(sizeof(ConfigHeader_t) + sizeof(data), length);
+}
+
+//------------------------------------------------------------------------------
+int main()
+//------------------------------------------------------------------------------
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_save_load);
+  RUN_TEST(test_legacy_migration);
+  RUN_TEST(test_crc_corruption);
+  RUN_TEST(test_version_upgrade);
+  RUN_TEST(test_newer_version);
+  return UNITY_END();
+}
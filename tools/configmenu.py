@@ -0,0 +1,116 @@
+# This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+# Copyright (c) 2019 Lars Brandt.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+
+# AutoConnect menu: configserver_menu.json -> AutoConnectAux pages as C++ objects.
+#
+# As PlatformIO extra script (pre:) it generates src/configmenu_data.h from configserver_menu.json
+# before each build, if the header is missing or older than the JSON.
+# The JSON keeps the format of AutoConnect::load(), but it is read here instead of on the device: the
+# pages are objects built at startup, no JSON document on the heap and no parsing at boot.
+
+import json
+import os
+import re
+
+ARRANGE = {"vertical": "AC_Vertical", "horizontal": "AC_Horizontal"}
+
+
+def root_dir():
+    try:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    except NameError:
+        # SCons executes the script without __file__
+        return os.getcwd()
+
+
+def literal(value):
+    # a JSON string is a valid C string literal, non ASCII stays UTF-8
+    return json.dumps(str(value), ensure_ascii=False)
+
+
+def identifier(*parts):
+    words = [w for p in parts for w in re.split(r"[^0-9A-Za-z]+", p) if w]
+    return "configMenu" + "".join(w[0].upper() + w[1:] for w in words)
+
+
+def element(page, e):
+    kind = e["type"]
+    name = identifier(page, e["name"])
+    if kind == "ACInput":
+        args = [e["name"], e.get("value", ""), e.get("label", ""), e.get("pattern", ""), e.get("placeholder", "")]
+        return name, "static AutoConnectInput %s(%s);" % (name, ", ".join(literal(a) for a in args))
+    if kind == "ACSubmit":
+        args = [e["name"], e.get("value", ""), e.get("uri", "")]
+        return name, "static AutoConnectSubmit %s(%s);" % (name, ", ".join(literal(a) for a in args))
+    if kind == "ACCheckbox":
+        args = [literal(a) for a in (e["name"], e.get("value", ""), e.get("label", ""))]
+        args.append("true" if e.get("checked", False) else "false")
+        return name, "static AutoConnectCheckbox %s(%s);" % (name, ", ".join(args))
+    if kind == "ACRadio":
+        values = "{%s}" % ", ".join(literal(v) for v in e.get("value", []))
+        arrange = ARRANGE[e.get("arrange", "vertical")]
+        args = [literal(e["name"]), values, literal(e.get("label", "")), arrange, str(int(e.get("checked", 0)))]
+        return name, "static AutoConnectRadio %s(%s);" % (name, ", ".join(args))
+    if kind == "ACText":
+        args = [e["name"], e.get("value", ""), e.get("style", "")]
+        return name, "static AutoConnectText %s(%s);" % (name, ", ".join(literal(a) for a in args))
+    raise ValueError("configmenu: %s on %s is not supported" % (kind, page))
+
+
+def generate(json_path, header_path):
+    with open(json_path, encoding="utf-8") as f:
+        menu = json.load(f)
+    if isinstance(menu, dict):
+        menu = [menu]
+
+    out = []
+    out.append("// Generated by tools/configmenu.py from configserver_menu.json, do not edit.")
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#include <AutoConnect.h>")
+    out.append("")
+    out.append("#define CONFIG_MENU_PAGES %d" % len(menu))
+    out.append("")
+    pages = []
+    elements = 0
+    for page in menu:
+        names = []
+        out.append("// %s" % page["uri"])
+        for e in page.get("element", []):
+            name, line = element(page["uri"], e)
+            names.append(name)
+            out.append(line)
+        aux = identifier(page["uri"])
+        pages.append(aux)
+        elements += len(names)
+        out.append("static AutoConnectAux %s(%s, %s, %s, {%s});" % (aux, literal(page["uri"]), literal(page.get("title", "")),
+                                                                 "true" if page.get("menu", True) else "false", ", ".join(names)))
+        out.append("")
+    out.append("static AutoConnectAux* const configMenu[CONFIG_MENU_PAGES] = {%s};" % ", ".join("&" + p for p in pages))
+    out.append("")
+
+    with open(header_path, "w", newline="\n") as f:
+        f.write("\n".join(out))
+    print("configmenu: %d pages, %d elements -> %s" % (len(pages), elements, header_path))
+
+
+def paths():
+    root = root_dir()
+    return os.path.join(root, "configserver_menu.json"), os.path.join(root, "src", "configmenu_data.h")
+
+
+def build():
+    json_path, header_path = paths()
+    if not os.path.exists(header_path) or os.path.getmtime(header_path) < os.path.getmtime(json_path):
+        generate(json_path, header_path)
+
+
+if __name__ == "__main__":
+    generate(*paths())
+else:
+    build()
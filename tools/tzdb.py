@@ -0,0 +1,148 @@
+# This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+# Copyright (c) 2019 Lars Brandt.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+
+# Timezone table: Olson name -> POSIX TZ rule.
+#
+# As PlatformIO extra script (pre:) it generates src/time/tzdb_data.h from tools/zones.csv
+# before each build, if the header is missing or older than the CSV.
+#
+# From the command line it refreshes tools/zones.csv from a compiled tz database:
+#   python tools/tzdb.py --from-zoneinfo /usr/share/zoneinfo
+# The rule is the footer line of each TZif file, it describes the zone from the last transition on.
+
+import csv
+import os
+import sys
+
+SKIP = ("posix", "right", "Etc/Unknown", "localtime", "posixrules", "Factory")
+
+
+def root_dir():
+    try:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    except NameError:
+        # SCons executes the script without __file__
+        return os.getcwd()
+
+
+def read_footer(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(b"TZif"):
+        return None
+    lines = data.rstrip(b"\n").split(b"\n")
+    return lines[-1].decode("ascii") if lines else None
+
+
+def from_zoneinfo(zoneinfo, csv_path):
+    version = ""
+    zi = os.path.join(zoneinfo, "tzdata.zi")
+    if os.path.exists(zi):
+        with open(zi) as f:
+            version = f.readline().replace("# version", "").strip()
+
+    zones = []
+    for dirpath, dirnames, filenames in os.walk(zoneinfo):
+        dirnames[:] = sorted(d for d in dirnames if d not in SKIP)
+        for name in sorted(filenames):
+            path = os.path.join(dirpath, name)
+            zone = os.path.relpath(path, zoneinfo).replace(os.sep, "/")
+            if zone in SKIP or "." in name:
+                continue
+            rule = read_footer(path)
+            if rule:
+                zones.append((zone, rule))
+
+    with open(csv_path, "w", newline="") as f:
+        f.write("# tz database %s, generated by tools/tzdb.py\n" % version)
+        writer = csv.writer(f, lineterminator="\n")
+        for zone in sorted(zones):
+            writer.writerow(zone)
+    print("%d zones written to %s" % (len(zones), csv_path))
+
+
+def generate(csv_path, header_path):
+    version = ""
+    zones = []
+    with open(csv_path) as f:
+        for row in csv.reader(f):
+            if not row:
+                continue
+            if row[0].startswith("#"):
+                version = row[0].split()[3] if len(row[0].split()) > 3 else ""
+                continue
+            zones.append((row[0], row[1]))
+    # the lookup is a binary search with strcmp, so sort bytewise
+    zones.sort(key=lambda z: z[0].encode("ascii"))
+
+    rules = []
+    rule_offset = {}
+    rules_size = 0
+    for _, rule in zones:
+        if rule not in rule_offset:
+            rule_offset[rule] = rules_size
+            rules.append(rule)
+            rules_size += len(rule) + 1
+
+    names_size = 0
+    entries = []
+    for name, rule in zones:
+        entries.append((names_size, rule_offset[rule]))
+        names_size += len(name) + 1
+
+    if names_size > 0xFFFF or rules_size > 0xFFFF:
+        raise Exception("tz table too big for 16 bit offsets")
+
+    def literal(strings):
+        return "\n".join('    "%s\\0"' % s for s in strings)
+
+    out = []
+    out.append("// Generated by tools/tzdb.py from tools/zones.csv, do not edit.")
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append('#define TZDB_VERSION "%s"' % version)
+    out.append("#define TZDB_ZONES %d" % len(zones))
+    out.append("")
+    out.append("// %d bytes" % names_size)
+    out.append("static const char tzdbNames[] =")
+    out.append(literal(name for name, _ in zones) + ";")
+    out.append("")
+    out.append("// %d distinct rules, %d bytes" % (len(rules), rules_size))
+    out.append("static const char tzdbRules[] =")
+    out.append(literal(rules) + ";")
+    out.append("")
+    out.append("// offsets into tzdbNames and tzdbRules, sorted by name")
+    out.append("static const TzdbEntry_t tzdbEntries[TZDB_ZONES] = {")
+    for i in range(0, len(entries), 6):
+        out.append("    " + " ".join("{%d, %d}," % e for e in entries[i:i + 6]))
+    out.append("};")
+    out.append("")
+
+    with open(header_path, "w", newline="\n") as f:
+        f.write("\n".join(out))
+    print("tzdb: %d zones, %d rules -> %s" % (len(zones), len(rules), header_path))
+
+
+def paths():
+    root = root_dir()
+    return os.path.join(root, "tools", "zones.csv"), os.path.join(root, "src", "time", "tzdb_data.h")
+
+
+def build():
+    csv_path, header_path = paths()
+    if not os.path.exists(header_path) or os.path.getmtime(header_path) < os.path.getmtime(csv_path):
+        generate(csv_path, header_path)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 and sys.argv[1] == "--from-zoneinfo":
+        from_zoneinfo(sys.argv[2], paths()[0])
+    else:
+        generate(*paths())
+else:
+    build()
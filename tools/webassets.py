@@ -0,0 +1,116 @@
+# This file is part of the ESP32Clock distribution (https://github.com/zebrajaeger/Esp32Clock).
+# Copyright (c) 2019 Lars Brandt.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+
+# Static web assets: web/* -> gzip compressed arrays in flash.
+#
+# As PlatformIO extra script (pre:) it generates src/net/webassets_data.h from the files in web/
+# before each build, if the header is missing or older than one of them.
+# Each file is stored gzip compressed (reproducible, no timestamp) with a strong ETag, the CRC32 of
+# the compressed data. Pages are revalidated on every load (answered with 304 if unchanged), the
+# files they reference get '?v=<etag>' appended and are cached for a year.
+
+import gzip
+import os
+import re
+import zlib
+
+TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+}
+REVALIDATE = "no-cache"
+IMMUTABLE = "public, max-age=31536000, immutable"
+
+
+def root_dir():
+    try:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    except NameError:
+        # SCons executes the script without __file__
+        return os.getcwd()
+
+
+def compress(data):
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def etag(data):
+    return '"%08x"' % (zlib.crc32(data) & 0xFFFFFFFF)
+
+
+def generate(web_dir, header_path):
+    names = sorted(n for n in os.listdir(web_dir) if os.path.splitext(n)[1] in TYPES)
+    pages = [n for n in names if n.endswith(".html")]
+    assets = {}
+
+    # files referenced by the pages first, the pages embed their ETag
+    for name in names:
+        if name in pages:
+            continue
+        with open(os.path.join(web_dir, name), "rb") as f:
+            data = compress(f.read())
+        assets[name] = (data, etag(data), IMMUTABLE)
+    for name in pages:
+        with open(os.path.join(web_dir, name), "rb") as f:
+            text = f.read().decode("utf-8")
+        for other, (_, tag, _) in assets.items():
+            text = re.sub(r'(src|href)="/?%s"' % re.escape(other), r'\1="/%s?v=%s"' % (other, tag.strip('"')), text)
+        data = compress(text.encode("utf-8"))
+        assets[name] = (data, etag(data), REVALIDATE)
+
+    out = []
+    out.append("// Generated by tools/webassets.py from web/, do not edit.")
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#define WEB_ASSETS %d" % len(names))
+    out.append("")
+    raw = 0
+    for i, name in enumerate(names):
+        data, tag, _ = assets[name]
+        raw += os.path.getsize(os.path.join(web_dir, name))
+        out.append("// %s, %d bytes gzip" % (name, len(data)))
+        out.append("static const uint8_t webAsset%d[] = {" % i)
+        for j in range(0, len(data), 16):
+            out.append("    " + " ".join("0x%02x," % b for b in data[j:j + 16]))
+        out.append("};")
+        out.append("")
+    out.append("static const WebAsset_t webAssets[WEB_ASSETS] = {")
+    for i, name in enumerate(names):
+        data, tag, cache = assets[name]
+        content_type = TYPES[os.path.splitext(name)[1]]
+        out.append('    {"/%s", "%s", "%s", "%s", webAsset%d, %d},' % (name, content_type, tag.replace('"', '\\"'), cache, i, len(data)))
+    out.append("};")
+    out.append("")
+
+    with open(header_path, "w", newline="\n") as f:
+        f.write("\n".join(out))
+    size = sum(len(a[0]) for a in assets.values())
+    print("webassets: %d files, %d -> %d bytes -> %s" % (len(names), raw, size, header_path))
+
+
+def paths():
+    root = root_dir()
+    return os.path.join(root, "web"), os.path.join(root, "src", "net", "webassets_data.h")
+
+
+def build():
+    web_dir, header_path = paths()
+    newest = max(os.path.getmtime(os.path.join(web_dir, n)) for n in os.listdir(web_dir))
+    if not os.path.exists(header_path) or os.path.getmtime(header_path) < newest:
+        generate(web_dir, header_path)
+
+
+if __name__ == "__main__":
+    generate(*paths())
+else:
+    build()
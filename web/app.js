@@ -0,0 +1,43 @@
+// the AutoConnect pages are served on their own port
+var settings = document.getElementById("settings");
+settings.href = location.protocol + "//" + location.hostname + ":8080/_ac";
+
+function row(table, name, value) {
+  var tr = table.insertRow();
+  tr.insertCell().textContent = name;
+  var td = tr.insertCell();
+  td.className = "value";
+  td.textContent = value;
+}
+
+fetch("/boot")
+  .then(function (response) {
+    return response.json();
+  })
+  .then(function (timeline) {
+    var table = document.getElementById("boot");
+    timeline.stages.forEach(function (stage) {
+      row(table, stage.name, (stage.us / 1000).toFixed(1) + " ms");
+    });
+  });
+
+// pushed by the clock, the browser reconnects on its own
+function show(table, values, prefix) {
+  Object.keys(values).forEach(function (name) {
+    var value = values[name];
+    if (value !== null && typeof value === "object") {
+      show(table, value, prefix + name + ".");
+    } else {
+      row(table, prefix + name, value);
+    }
+  });
+}
+
+var events = new EventSource("/api/events");
+["time", "stats"].forEach(function (name) {
+  events.addEventListener(name, function (event) {
+    var table = document.getElementById(name);
+    table.textContent = "";
+    show(table, JSON.parse(event.data), "");
+  });
+});